@@ -302,6 +302,35 @@ end
 
 dependencies.imports()
 
+project "manifest-generator"
+kind "ConsoleApp"
+language "C++"
+
+files {"./src/manifest-generator/**.hpp", "./src/manifest-generator/**.cpp"}
+
+includedirs {"./src/manifest-generator", "./src/common", "%{prj.location}/src"}
+
+links {"common"}
+
+dependencies.imports()
+
+project "tests"
+kind "ConsoleApp"
+language "C++"
+
+-- Updater sources under test are built in directly, the tests' std_include.hpp stands in for the launcher's
+files {"./src/tests/**.hpp", "./src/tests/**.cpp"}
+files {"./src/launcher/updater/hash_cache.cpp", "./src/launcher/updater/segments.cpp", "./src/launcher/updater/file_table.cpp",
+       "./src/launcher/updater/path_index.cpp", "./src/launcher/updater/chunk_delta.cpp",
+       "./src/launcher/updater/filesystem_snapshot.cpp", "./src/launcher/updater/file_check.cpp",
+       "./src/launcher/updater/download_scheduler.cpp", "./src/launcher/updater/pack_plan.cpp"}
+
+includedirs {"./src/tests", "./src/launcher", "./src/common", "%{prj.location}/src"}
+
+links {"common"}
+
+dependencies.imports()
+
 group "Dependencies"
 dependencies.projects()
 
@@ -0,0 +1,203 @@
+#include "chunking.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace utils::chunking
+{
+	namespace
+	{
+		constexpr uint32_t index_magic = 0x31434458; // XDC1
+		constexpr uint32_t index_version = 1;
+
+		// The header is followed by one record per chunk, offsets follow from the lengths before them
+		struct index_header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t chunk_count;
+		};
+
+		struct index_record
+		{
+			uint32_t length;
+			uint8_t hash[cryptography::sha1::digest_size];
+		};
+
+		static_assert(sizeof(index_header) == 16);
+		static_assert(sizeof(index_record) == 24);
+
+		// Random values for every byte, generated deterministically so the server and all clients agree
+		constexpr std::array<uint64_t, 256> generate_gear_table()
+		{
+			std::array<uint64_t, 256> table{};
+			uint64_t state = 0x5851F42D4C957F2D;
+
+			for (auto& value : table)
+			{
+				state += 0x9E3779B97F4A7C15;
+				auto mixed = state;
+				mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9;
+				mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EB;
+				value = mixed ^ (mixed >> 31);
+			}
+
+			return table;
+		}
+
+		constexpr auto gear_table = generate_gear_table();
+
+		constexpr uint64_t get_mask(const size_t bits)
+		{
+			return ((uint64_t(1) << bits) - 1) << (64 - bits);
+		}
+
+		// Cutting is harder before the average size and easier after it, which keeps chunk sizes close to the average
+		constexpr auto strict_mask = get_mask(16);
+		constexpr auto loose_mask = get_mask(12);
+
+		static_assert(average_chunk_size == 16 * 1024, "Masks are tuned for 16 KiB chunks");
+
+		size_t find_cut(const uint8_t* data, const size_t size)
+		{
+			if (size <= min_chunk_size)
+			{
+				return size;
+			}
+
+			const auto limit = std::min(size, max_chunk_size);
+			const auto normal = std::min(limit, average_chunk_size);
+
+			uint64_t hash = 0;
+			auto i = min_chunk_size;
+
+			for (; i < normal; ++i)
+			{
+				hash = (hash << 1) + gear_table[data[i]];
+				if (!(hash & strict_mask))
+				{
+					return i + 1;
+				}
+			}
+
+			for (; i < limit; ++i)
+			{
+				hash = (hash << 1) + gear_table[data[i]];
+				if (!(hash & loose_mask))
+				{
+					return i + 1;
+				}
+			}
+
+			return limit;
+		}
+	}
+
+	std::vector<size_t> find_boundaries(const uint8_t* data, const size_t size)
+	{
+		std::vector<size_t> boundaries{};
+		boundaries.reserve(size / average_chunk_size + 1);
+
+		size_t offset = 0;
+		while (offset < size)
+		{
+			offset += find_cut(data + offset, size - offset);
+			boundaries.emplace_back(offset);
+		}
+
+		return boundaries;
+	}
+
+	std::vector<chunk> split(const uint8_t* data, const size_t size)
+	{
+		const auto boundaries = find_boundaries(data, size);
+
+		std::vector<std::string_view> messages{};
+		messages.reserve(boundaries.size());
+
+		size_t offset = 0;
+		for (const auto boundary : boundaries)
+		{
+			messages.emplace_back(reinterpret_cast<const char*>(data) + offset, boundary - offset);
+			offset = boundary;
+		}
+
+		const auto hashes = cryptography::sha1::compute_many(messages);
+
+		std::vector<chunk> chunks{};
+		chunks.reserve(boundaries.size());
+
+		offset = 0;
+		for (size_t i = 0; i < boundaries.size(); ++i)
+		{
+			chunks.push_back({offset, static_cast<uint32_t>(boundaries[i] - offset), hashes[i]});
+			offset = boundaries[i];
+		}
+
+		return chunks;
+	}
+
+	std::string write_index(const std::vector<chunk>& chunks)
+	{
+		index_header header{};
+		header.magic = index_magic;
+		header.version = index_version;
+		header.chunk_count = chunks.size();
+
+		std::string data{};
+		data.reserve(sizeof(header) + chunks.size() * sizeof(index_record));
+		data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (const auto& current : chunks)
+		{
+			index_record record{};
+			record.length = current.length;
+			std::memcpy(record.hash, current.hash.data(), sizeof(record.hash));
+
+			data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+		}
+
+		return data;
+	}
+
+	std::optional<std::vector<chunk>> parse_index(const void* data, const size_t size)
+	{
+		if (size < sizeof(index_header))
+		{
+			return {};
+		}
+
+		const auto* bytes = static_cast<const uint8_t*>(data);
+
+		index_header header{};
+		std::memcpy(&header, bytes, sizeof(header));
+
+		const auto records_size = size - sizeof(header);
+		if (header.magic != index_magic || header.version != index_version || records_size % sizeof(index_record) != 0
+			|| header.chunk_count != records_size / sizeof(index_record))
+		{
+			return {};
+		}
+
+		std::vector<chunk> chunks{};
+		chunks.reserve(static_cast<size_t>(header.chunk_count));
+
+		uint64_t offset = 0;
+		for (size_t i = 0; i < header.chunk_count; ++i)
+		{
+			index_record record{};
+			std::memcpy(&record, bytes + sizeof(header) + i * sizeof(record), sizeof(record));
+
+			if (record.length == 0 || record.length > max_chunk_size)
+			{
+				return {};
+			}
+
+			chunks.push_back({offset, record.length, cryptography::sha1::digest{record.hash}});
+			offset += record.length;
+		}
+
+		return {std::move(chunks)};
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+#include "cryptography.hpp"
+
+namespace utils::chunking
+{
+	// Boundaries only depend on the bytes right before them, so an edit moves at most the chunks around it
+	// and everything behind an insertion or deletion is cut exactly as before
+	constexpr size_t min_chunk_size = 4 * 1024;
+	constexpr size_t average_chunk_size = 16 * 1024;
+	constexpr size_t max_chunk_size = 64 * 1024;
+
+	// Smaller files are downloaded whole, the server only publishes chunk indices for larger ones
+	constexpr size_t min_indexed_file_size = 4 * 1024 * 1024;
+	constexpr auto index_extension = ".cdc";
+
+	struct chunk
+	{
+		uint64_t offset;
+		uint32_t length;
+		cryptography::sha1::digest hash;
+	};
+
+	// Returns the end offset of every chunk, the last one is always the size of the data
+	std::vector<size_t> find_boundaries(const uint8_t* data, size_t size);
+	std::vector<chunk> split(const uint8_t* data, size_t size);
+
+	// Chunk index as published next to a file on the update server
+	std::string write_index(const std::vector<chunk>& chunks);
+	std::optional<std::vector<chunk>> parse_index(const void* data, size_t size);
+}
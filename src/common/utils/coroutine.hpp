@@ -0,0 +1,478 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+namespace utils::coroutine
+{
+	template <typename T = void>
+	class task;
+
+	namespace detail
+	{
+		struct final_awaiter
+		{
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			template <typename Promise>
+			std::coroutine_handle<> await_suspend(const std::coroutine_handle<Promise> handle) const noexcept
+			{
+				const auto continuation = handle.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+
+			void await_resume() const noexcept
+			{
+			}
+		};
+
+		class promise_base
+		{
+		public:
+			std::suspend_always initial_suspend() const noexcept
+			{
+				return {};
+			}
+
+			final_awaiter final_suspend() const noexcept
+			{
+				return {};
+			}
+
+			void unhandled_exception() noexcept
+			{
+				this->exception = std::current_exception();
+			}
+
+			std::coroutine_handle<> continuation{};
+			std::exception_ptr exception{};
+		};
+
+		template <typename T>
+		class promise final : public promise_base
+		{
+		public:
+			task<T> get_return_object() noexcept;
+
+			template <typename U>
+			void return_value(U&& value)
+			{
+				this->value_.emplace(std::forward<U>(value));
+			}
+
+			T result()
+			{
+				if (this->exception)
+				{
+					std::rethrow_exception(this->exception);
+				}
+
+				return std::move(*this->value_);
+			}
+
+		private:
+			std::optional<T> value_{};
+		};
+
+		template <>
+		class promise<void> final : public promise_base
+		{
+		public:
+			task<void> get_return_object() noexcept;
+
+			void return_void() const noexcept
+			{
+			}
+
+			void result() const
+			{
+				if (this->exception)
+				{
+					std::rethrow_exception(this->exception);
+				}
+			}
+		};
+
+		// Starts running immediately and cleans up after itself, used to drive tasks from outside a coroutine
+		struct fire_and_forget
+		{
+			struct promise_type
+			{
+				fire_and_forget get_return_object() const noexcept
+				{
+					return {};
+				}
+
+				std::suspend_never initial_suspend() const noexcept
+				{
+					return {};
+				}
+
+				std::suspend_never final_suspend() const noexcept
+				{
+					return {};
+				}
+
+				void return_void() const noexcept
+				{
+				}
+
+				void unhandled_exception() const noexcept
+				{
+					std::terminate();
+				}
+			};
+		};
+	}
+
+	// Lazily started coroutine, runs once it is awaited
+	template <typename T>
+	class [[nodiscard]] task
+	{
+	public:
+		using promise_type = detail::promise<T>;
+
+		task() = default;
+
+		explicit task(const std::coroutine_handle<promise_type> handle)
+			: handle_(handle)
+		{
+		}
+
+		~task()
+		{
+			if (this->handle_)
+			{
+				this->handle_.destroy();
+			}
+		}
+
+		task(task&& obj) noexcept
+			: handle_(std::exchange(obj.handle_, {}))
+		{
+		}
+
+		task& operator=(task&& obj) noexcept
+		{
+			if (this != &obj)
+			{
+				if (this->handle_)
+				{
+					this->handle_.destroy();
+				}
+
+				this->handle_ = std::exchange(obj.handle_, {});
+			}
+
+			return *this;
+		}
+
+		task(const task&) = delete;
+		task& operator=(const task&) = delete;
+
+		auto operator co_await() const noexcept
+		{
+			struct awaiter
+			{
+				std::coroutine_handle<promise_type> handle;
+
+				bool await_ready() const noexcept
+				{
+					return !this->handle || this->handle.done();
+				}
+
+				std::coroutine_handle<> await_suspend(const std::coroutine_handle<> awaiting) const noexcept
+				{
+					this->handle.promise().continuation = awaiting;
+					return this->handle;
+				}
+
+				T await_resume() const
+				{
+					return this->handle.promise().result();
+				}
+			};
+
+			return awaiter{this->handle_};
+		}
+
+	private:
+		std::coroutine_handle<promise_type> handle_{};
+	};
+
+	namespace detail
+	{
+		template <typename T>
+		task<T> promise<T>::get_return_object() noexcept
+		{
+			return task<T>{std::coroutine_handle<promise<T>>::from_promise(*this)};
+		}
+
+		inline task<void> promise<void>::get_return_object() noexcept
+		{
+			return task<void>{std::coroutine_handle<promise<void>>::from_promise(*this)};
+		}
+
+		class sync_wait_state
+		{
+		public:
+			void notify()
+			{
+				std::lock_guard<std::mutex> _{this->mutex_};
+				this->done_ = true;
+				this->condition_.notify_all();
+			}
+
+			void wait()
+			{
+				std::unique_lock<std::mutex> lock{this->mutex_};
+				this->condition_.wait(lock, [this]()
+				{
+					return this->done_;
+				});
+			}
+
+			std::exception_ptr exception{};
+
+		private:
+			std::mutex mutex_{};
+			std::condition_variable condition_{};
+			bool done_{false};
+		};
+
+		inline fire_and_forget run_sync_wait(const task<void>& task, sync_wait_state& state)
+		{
+			try
+			{
+				co_await task;
+			}
+			catch (...)
+			{
+				state.exception = std::current_exception();
+			}
+
+			state.notify();
+		}
+
+		inline fire_and_forget run_detached(task<void> task)
+		{
+			try
+			{
+				co_await task;
+			}
+			catch (...)
+			{
+			}
+		}
+
+		template <typename T>
+		task<void> store_result(task<T> task, std::optional<T>& result)
+		{
+			result.emplace(co_await task);
+		}
+
+		struct when_all_state
+		{
+			std::atomic<size_t> remaining{0};
+			std::coroutine_handle<> continuation{};
+			std::mutex mutex{};
+			std::exception_ptr exception{};
+		};
+
+		inline fire_and_forget run_when_all_task(const task<void>& task, when_all_state& state)
+		{
+			try
+			{
+				co_await task;
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> _{state.mutex};
+				if (!state.exception)
+				{
+					state.exception = std::current_exception();
+				}
+			}
+
+			if (state.remaining.fetch_sub(1) == 1)
+			{
+				state.continuation.resume();
+			}
+		}
+
+		class when_all_awaiter
+		{
+		public:
+			explicit when_all_awaiter(std::vector<task<void>> tasks)
+				: tasks_(std::move(tasks))
+			{
+			}
+
+			bool await_ready() const noexcept
+			{
+				return this->tasks_.empty();
+			}
+
+			bool await_suspend(const std::coroutine_handle<> continuation)
+			{
+				// One extra reference is held while the tasks are started, so none of them can resume us early
+				this->state_.remaining = this->tasks_.size() + 1;
+				this->state_.continuation = continuation;
+
+				for (const auto& task : this->tasks_)
+				{
+					run_when_all_task(task, this->state_);
+				}
+
+				return this->state_.remaining.fetch_sub(1) != 1;
+			}
+
+			void await_resume() const
+			{
+				if (this->state_.exception)
+				{
+					std::rethrow_exception(this->state_.exception);
+				}
+			}
+
+		private:
+			std::vector<task<void>> tasks_;
+			when_all_state state_{};
+		};
+	}
+
+	// Runs all tasks concurrently and completes once every one of them has finished.
+	// The first exception thrown by any of the tasks is rethrown afterwards.
+	inline task<void> when_all(std::vector<task<void>> tasks)
+	{
+		co_await detail::when_all_awaiter{std::move(tasks)};
+	}
+
+	// Blocks the calling thread until the task has completed
+	template <typename T>
+	T sync_wait(task<T> task)
+	{
+		if constexpr (std::is_void_v<T>)
+		{
+			detail::sync_wait_state state{};
+			detail::run_sync_wait(task, state);
+			state.wait();
+
+			if (state.exception)
+			{
+				std::rethrow_exception(state.exception);
+			}
+		}
+		else
+		{
+			std::optional<T> result{};
+			sync_wait(detail::store_result(std::move(task), result));
+			return std::move(*result);
+		}
+	}
+
+	// Starts the task without waiting for it, exceptions it throws are discarded
+	inline void start_detached(task<void> task)
+	{
+		detail::run_detached(std::move(task));
+	}
+
+	namespace detail
+	{
+		// A fixed set of threads that resume coroutines doing blocking work like disk access and hashing.
+		// It lives until the process exits, its threads are never joined.
+		class blocking_pool
+		{
+		public:
+			static blocking_pool& get()
+			{
+				static auto* pool = new blocking_pool(std::max(4u, std::thread::hardware_concurrency()));
+				return *pool;
+			}
+
+			void post(const std::coroutine_handle<> handle)
+			{
+				{
+					std::lock_guard<std::mutex> _{this->mutex_};
+					this->handles_.push_back(handle);
+				}
+
+				this->condition_.notify_one();
+			}
+
+		private:
+			std::mutex mutex_{};
+			std::condition_variable condition_{};
+			std::deque<std::coroutine_handle<>> handles_{};
+
+			explicit blocking_pool(const unsigned thread_count)
+			{
+				for (unsigned i = 0; i < thread_count; ++i)
+				{
+					std::thread([this]()
+					{
+						this->run();
+					}).detach();
+				}
+			}
+
+			void run()
+			{
+				while (true)
+				{
+					std::coroutine_handle<> handle{};
+
+					{
+						std::unique_lock<std::mutex> lock{this->mutex_};
+						this->condition_.wait(lock, [this]()
+						{
+							return !this->handles_.empty();
+						});
+
+						handle = this->handles_.front();
+						this->handles_.pop_front();
+					}
+
+					handle.resume();
+				}
+			}
+		};
+	}
+
+	// Continues the awaiting coroutine on a thread of a bounded pool, used to keep blocking work off the
+	// caller's thread, like the network thread that resumes every transfer
+	inline auto switch_to_blocking_pool()
+	{
+		struct awaiter
+		{
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			void await_suspend(const std::coroutine_handle<> handle) const
+			{
+				detail::blocking_pool::get().post(handle);
+			}
+
+			void await_resume() const noexcept
+			{
+			}
+		};
+
+		return awaiter{};
+	}
+}
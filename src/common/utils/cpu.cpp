@@ -0,0 +1,127 @@
+#include "cpu.hpp"
+
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <immintrin.h>
+#define CPU_X86 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define CPU_X86 1
+#endif
+
+namespace utils::cpu
+{
+	namespace
+	{
+		struct features
+		{
+			bool ssse3{false};
+			bool sse41{false};
+			bool sha{false};
+			bool avx2{false};
+			bool avx512f{false};
+		};
+
+#ifdef CPU_X86
+		void cpuid(uint32_t (&registers)[4], const uint32_t leaf, const uint32_t subleaf)
+		{
+#ifdef _MSC_VER
+			int values[4]{};
+			__cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+
+			for (size_t i = 0; i < 4; ++i)
+			{
+				registers[i] = static_cast<uint32_t>(values[i]);
+			}
+#else
+			__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+		}
+
+		// The OS has to save the wider registers on context switches, otherwise they can not be used
+		uint64_t get_enabled_register_state()
+		{
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			uint32_t eax{}, edx{};
+			__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+		}
+
+		features detect_features()
+		{
+			features result{};
+
+			uint32_t registers[4]{};
+			cpuid(registers, 0, 0);
+
+			const auto max_leaf = registers[0];
+			if (max_leaf < 1)
+			{
+				return result;
+			}
+
+			cpuid(registers, 1, 0);
+			result.ssse3 = (registers[2] & (1u << 9)) != 0;
+			result.sse41 = (registers[2] & (1u << 19)) != 0;
+
+			const auto has_xsave = (registers[2] & (1u << 27)) != 0;
+			const auto register_state = has_xsave ? get_enabled_register_state() : 0;
+
+			// SSE and AVX state, plus the opmask and upper ZMM state for AVX-512
+			const auto avx_enabled = (register_state & 0x6) == 0x6;
+			const auto avx512_enabled = (register_state & 0xE6) == 0xE6;
+
+			if (max_leaf >= 7)
+			{
+				cpuid(registers, 7, 0);
+				result.sha = (registers[1] & (1u << 29)) != 0;
+				result.avx2 = avx_enabled && (registers[1] & (1u << 5)) != 0;
+				result.avx512f = avx512_enabled && (registers[1] & (1u << 16)) != 0;
+			}
+
+			return result;
+		}
+#else
+		features detect_features()
+		{
+			return {};
+		}
+#endif
+
+		const features& get_features()
+		{
+			static const auto result = detect_features();
+			return result;
+		}
+	}
+
+	bool has_ssse3()
+	{
+		return get_features().ssse3;
+	}
+
+	bool has_sse41()
+	{
+		return get_features().sse41;
+	}
+
+	bool has_sha()
+	{
+		return get_features().sha;
+	}
+
+	bool has_avx2()
+	{
+		return get_features().avx2;
+	}
+
+	bool has_avx512f()
+	{
+		return get_features().avx512f;
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+namespace utils::cpu
+{
+	// Instruction set extensions that can be used at runtime, detected once through cpuid
+	bool has_ssse3();
+	bool has_sse41();
+	bool has_sha();
+	bool has_avx2();
+	bool has_avx512f();
+}
@@ -1,95 +1,356 @@
-#include "string.hpp"
 #include "cryptography.hpp"
-#include "nt.hpp"
+#include "cryptography_lanes.hpp"
+#include "cpu.hpp"
 
-#include <gsl/gsl>
+#include <cstring>
+#include <utility>
+#include <algorithm>
 
-#include <bcrypt.h>
-#pragma comment(lib, "Bcrypt.lib")
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHA1_SHA_NI 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SHA1_TARGET(features)
+#else
+#define SHA1_TARGET(features) __attribute__((target(features)))
+#endif
 
 namespace utils::cryptography
 {
 	namespace
 	{
-		std::string compute_hash(const LPCWSTR hash_name, const uint8_t* data, const size_t length, const bool hex)
+		constexpr uint32_t sha1_initial_state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+		uint32_t rotate_left(const uint32_t value, const int bits)
+		{
+			return (value << bits) | (value >> (32 - bits));
+		}
+
+		uint32_t load_big_endian(const uint8_t* data)
+		{
+			return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16)
+				| (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+		}
+
+		void store_big_endian(uint8_t* data, const uint32_t value)
 		{
-			BCRYPT_ALG_HANDLE algorithm{};
-			if (FAILED(BCryptOpenAlgorithmProvider(&algorithm, hash_name, nullptr, 0)))
+			data[0] = static_cast<uint8_t>(value >> 24);
+			data[1] = static_cast<uint8_t>(value >> 16);
+			data[2] = static_cast<uint8_t>(value >> 8);
+			data[3] = static_cast<uint8_t>(value);
+		}
+
+		template <int Round>
+		inline void sha1_round_scalar(uint32_t (&v)[5], uint32_t (&w)[16], const uint8_t* block)
+		{
+			uint32_t value;
+			if constexpr (Round < 16)
+			{
+				value = load_big_endian(block + Round * 4);
+			}
+			else
 			{
-				return {};
+				value = rotate_left(w[(Round + 13) & 15] ^ w[(Round + 8) & 15] ^ w[(Round + 2) & 15] ^ w[Round & 15], 1);
 			}
 
-			auto _ = gsl::finally([&algorithm]()
+			w[Round & 15] = value;
+
+			// The working variables rotate by one position every round instead of being moved
+			auto& a = v[(80 - Round) % 5];
+			auto& b = v[(81 - Round) % 5];
+			auto& c = v[(82 - Round) % 5];
+			auto& d = v[(83 - Round) % 5];
+			auto& e = v[(84 - Round) % 5];
+
+			if constexpr (Round < 20)
 			{
-				BCryptCloseAlgorithmProvider(algorithm, 0);
-			});
+				e += ((b & (c ^ d)) ^ d) + 0x5A827999;
+			}
+			else if constexpr (Round < 40)
+			{
+				e += (b ^ c ^ d) + 0x6ED9EBA1;
+			}
+			else if constexpr (Round < 60)
+			{
+				e += ((b & c) | (d & (b | c))) + 0x8F1BBCDC;
+			}
+			else
+			{
+				e += (b ^ c ^ d) + 0xCA62C1D6;
+			}
+
+			e += rotate_left(a, 5) + value;
+			b = rotate_left(b, 30);
+		}
 
-			DWORD hash_obj_length{}, data_count{}, hash_data_length{};
-			if (FAILED(BCryptGetProperty(algorithm, BCRYPT_OBJECT_LENGTH,
-				reinterpret_cast<PBYTE>(&hash_obj_length),
-				sizeof(DWORD),
-				&data_count,
-				0)))
+		template <int... Rounds>
+		inline void sha1_block_scalar(uint32_t (&v)[5], const uint8_t* block, std::integer_sequence<int, Rounds...>)
+		{
+			uint32_t w[16];
+			(sha1_round_scalar<Rounds>(v, w, block), ...);
+		}
+
+		void sha1_compress_scalar(uint32_t* state, const uint8_t* blocks, size_t count)
+		{
+			while (count-- > 0)
 			{
-				return {};
+				uint32_t v[5] = {state[0], state[1], state[2], state[3], state[4]};
+				sha1_block_scalar(v, blocks, std::make_integer_sequence<int, 80>{});
+
+				for (size_t i = 0; i < 5; ++i)
+				{
+					state[i] += v[i];
+				}
+
+				blocks += sha1::block_size;
 			}
+		}
 
+#ifdef SHA1_SHA_NI
+		// One group of four rounds. The message words of the following groups are expanded alongside,
+		// which is why some steps only apply to a range of groups.
+		template <int Group>
+		SHA1_TARGET("sha,ssse3,sse4.1")
+		inline void sha1_rounds_sha_ni(__m128i& abcd, __m128i (&e)[2], __m128i (&message)[4], const uint8_t* block,
+		                               const __m128i mask)
+		{
+			constexpr auto current = Group % 4;
+			constexpr auto function = Group / 5;
+
+			if constexpr (Group < 4)
+			{
+				message[current] = _mm_shuffle_epi8(
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + Group * 16)), mask);
+			}
+
+			if constexpr (Group == 0)
+			{
+				e[0] = _mm_add_epi32(e[0], message[0]);
+			}
+			else
+			{
+				e[Group % 2] = _mm_sha1nexte_epu32(e[Group % 2], message[current]);
+			}
+
+			e[(Group + 1) % 2] = abcd;
+
+			if constexpr (Group >= 3 && Group <= 18)
+			{
+				message[(Group + 1) % 4] = _mm_sha1msg2_epu32(message[(Group + 1) % 4], message[current]);
+			}
+
+			abcd = _mm_sha1rnds4_epu32(abcd, e[Group % 2], function);
+
+			if constexpr (Group >= 1 && Group <= 16)
+			{
+				message[(Group + 3) % 4] = _mm_sha1msg1_epu32(message[(Group + 3) % 4], message[current]);
+			}
 
-			if (FAILED(BCryptGetProperty(algorithm, BCRYPT_HASH_LENGTH,
-				reinterpret_cast<PBYTE>(&hash_data_length),
-				sizeof(DWORD),
-				&data_count,
-				0)))
+			if constexpr (Group >= 2 && Group <= 17)
 			{
-				return {};
+				message[(Group + 2) % 4] = _mm_xor_si128(message[(Group + 2) % 4], message[current]);
+			}
+		}
+
+		template <int... Groups>
+		SHA1_TARGET("sha,ssse3,sse4.1")
+		inline void sha1_block_sha_ni(__m128i& abcd, __m128i (&e)[2], const uint8_t* block, const __m128i mask,
+		                              std::integer_sequence<int, Groups...>)
+		{
+			__m128i message[4]{};
+			(sha1_rounds_sha_ni<Groups>(abcd, e, message, block, mask), ...);
+		}
+
+		SHA1_TARGET("sha,ssse3,sse4.1")
+		void sha1_compress_sha_ni(uint32_t* state, const uint8_t* blocks, size_t count)
+		{
+			const auto mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+			auto abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+			auto e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+			while (count-- > 0)
+			{
+				const auto abcd_save = abcd;
+				const auto e0_save = e0;
+
+				__m128i e[2] = {e0, _mm_setzero_si128()};
+				sha1_block_sha_ni(abcd, e, blocks, mask, std::make_integer_sequence<int, 20>{});
+
+				e0 = _mm_sha1nexte_epu32(e[0], e0_save);
+				abcd = _mm_add_epi32(abcd, abcd_save);
+
+				blocks += sha1::block_size;
 			}
 
-			std::string hash_obj_data{}, hash_data{};
-			hash_obj_data.resize(hash_obj_length);
-			hash_data.resize(hash_data_length);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+			state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+		}
+#endif
+
+		// The fastest supported block function comes last
+		sha1::detail::compress_function get_sha1_compress()
+		{
+			static const auto function = sha1::detail::get_compress_functions().back();
+			return function;
+		}
 
-			BCRYPT_HASH_HANDLE hash_handle{};
+		void sha1_compute_many_sequential(const std::string_view* messages, const size_t count, uint8_t* digests)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				const auto hash = sha1::compute(reinterpret_cast<const uint8_t*>(messages[i].data()), messages[i].size());
+				std::memcpy(digests + i * sha1::digest_size, hash.data(), sha1::digest_size);
+			}
+		}
 
-			if (FAILED(BCryptCreateHash(
-				algorithm,
-				&hash_handle,
-				reinterpret_cast<PBYTE>(hash_obj_data.data()),
-				static_cast<ULONG>(hash_obj_data.size()),
-				NULL,
-				0,
-				0)))
+		// SHA-NI on a single message outruns four SSE2 lanes, but not eight or sixteen lanes
+		sha1::detail::compute_many_function select_sha1_compute_many()
+		{
+			if (cpu::has_avx512f())
 			{
-				return {};
+				return sha1::detail::compute_many_avx512;
 			}
 
-			if (FAILED(BCryptHashData(hash_handle, const_cast<PBYTE>(data),
-				static_cast<ULONG>(length), 0)))
+			if (cpu::has_avx2())
 			{
-				return {};
+				return sha1::detail::compute_many_avx2;
 			}
 
-			if (FAILED(BCryptFinishHash(
-				hash_handle,
-				reinterpret_cast<PBYTE>(hash_data.data()),
-				static_cast<ULONG>(hash_data.size()),
-				0)))
+			if (get_sha1_compress() != sha1_compress_scalar)
 			{
-				return {};
+				return sha1_compute_many_sequential;
 			}
 
-			if (!hex) return hash_data;
+			return sha1::detail::compute_many_sse2;
+		}
 
-			return string::dump_hex(hash_data, "");
+		sha1::detail::compute_many_function get_sha1_compute_many()
+		{
+			static const auto function = select_sha1_compute_many();
+			return function;
 		}
 	}
 
-	std::string sha1::compute(const std::string& data, const bool hex)
+	std::vector<sha1::detail::compress_function> sha1::detail::get_compress_functions()
 	{
-		return compute(reinterpret_cast<const uint8_t*>(data.data()), data.size(), hex);
+		std::vector<compress_function> functions{sha1_compress_scalar};
+
+#ifdef SHA1_SHA_NI
+		if (cpu::has_sha() && cpu::has_ssse3() && cpu::has_sse41())
+		{
+			functions.emplace_back(sha1_compress_sha_ni);
+		}
+#endif
+
+		return functions;
 	}
 
-	std::string sha1::compute(const uint8_t* data, const size_t length, const bool hex)
+	sha1::context::context()
+		: context(get_sha1_compress())
 	{
-		return compute_hash(BCRYPT_SHA1_ALGORITHM, data, length, hex);
+	}
+
+	sha1::context::context(const detail::compress_function compress)
+		: compress_(compress)
+	{
+		this->init();
+	}
+
+	void sha1::context::init()
+	{
+		std::memcpy(this->state_, sha1_initial_state, sizeof(this->state_));
+		this->buffer_size_ = 0;
+		this->length_ = 0;
+	}
+
+	void sha1::context::update(const void* data, size_t length)
+	{
+		const auto compress = this->compress_;
+		auto* bytes = static_cast<const uint8_t*>(data);
+
+		this->length_ += length;
+
+		if (this->buffer_size_ > 0)
+		{
+			const auto count = std::min(length, block_size - this->buffer_size_);
+			std::memcpy(this->buffer_ + this->buffer_size_, bytes, count);
+
+			this->buffer_size_ += count;
+			bytes += count;
+			length -= count;
+
+			if (this->buffer_size_ < block_size)
+			{
+				return;
+			}
+
+			compress(this->state_, this->buffer_, 1);
+			this->buffer_size_ = 0;
+		}
+
+		// Whole blocks are hashed straight from the input
+		const auto block_count = length / block_size;
+		if (block_count > 0)
+		{
+			compress(this->state_, bytes, block_count);
+
+			bytes += block_count * block_size;
+			length -= block_count * block_size;
+		}
+
+		std::memcpy(this->buffer_, bytes, length);
+		this->buffer_size_ = length;
+	}
+
+	sha1::digest sha1::context::final()
+	{
+		const auto bit_length = this->length_ * 8;
+
+		uint8_t padding[block_size * 2]{};
+		padding[0] = 0x80;
+
+		// The length has to end up in the last 8 bytes of a block
+		const auto padding_size = ((this->buffer_size_ < 56) ? 56 : 120) - this->buffer_size_;
+		for (size_t i = 0; i < 8; ++i)
+		{
+			padding[padding_size + i] = static_cast<uint8_t>(bit_length >> (56 - i * 8));
+		}
+
+		this->update(padding, padding_size + 8);
+
+		digest hash{};
+		for (size_t i = 0; i < 5; ++i)
+		{
+			store_big_endian(hash.data() + i * 4, this->state_[i]);
+		}
+
+		this->init();
+		return hash;
+	}
+
+	sha1::digest sha1::compute(const std::string& data)
+	{
+		return compute(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+	}
+
+	sha1::digest sha1::compute(const uint8_t* data, const size_t length)
+	{
+		context context{};
+		context.update(data, length);
+		return context.final();
+	}
+
+	std::vector<sha1::digest> sha1::compute_many(const std::vector<std::string_view>& messages)
+	{
+		// Digests are plain byte arrays, so the kernels write straight into the result
+		static_assert(sizeof(digest) == digest_size);
+
+		std::vector<digest> result(messages.size());
+		get_sha1_compute_many()(messages.data(), messages.size(), reinterpret_cast<uint8_t*>(result.data()));
+
+		return result;
 	}
 }
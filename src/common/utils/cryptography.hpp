@@ -1,12 +1,53 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "digest.hpp"
 
 namespace utils::cryptography
 {
 	namespace sha1
 	{
-		std::string compute(const std::string& data, bool hex = false);
-		std::string compute(const uint8_t* data, size_t length, bool hex = false);
+		constexpr size_t block_size = 64;
+		constexpr size_t digest_size = 20;
+
+		using digest = utils::digest<digest_size>;
+
+		namespace detail
+		{
+			using compress_function = void(*)(uint32_t* state, const uint8_t* blocks, size_t count);
+
+			// Every block function this CPU can run, the portable one comes first
+			std::vector<compress_function> get_compress_functions();
+		}
+
+		class context
+		{
+		public:
+			context();
+
+			// Uses the given block function instead of the fastest one, so implementations can be compared
+			explicit context(detail::compress_function compress);
+
+			void init();
+			void update(const void* data, size_t length);
+			digest final();
+
+		private:
+			detail::compress_function compress_{};
+			uint32_t state_[5]{};
+			uint8_t buffer_[block_size]{};
+			size_t buffer_size_{0};
+			uint64_t length_{0};
+		};
+
+		digest compute(const std::string& data);
+		digest compute(const uint8_t* data, size_t length);
+
+		// Hashes independent messages side by side in SIMD lanes, which keeps the lanes busy for small messages
+		std::vector<digest> compute_many(const std::vector<std::string_view>& messages);
 	}
 }
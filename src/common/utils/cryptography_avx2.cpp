@@ -0,0 +1,83 @@
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <array>
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include "cryptography_lanes.hpp"
+
+namespace utils::cryptography::sha1::detail
+{
+	namespace
+	{
+		struct avx2_lanes
+		{
+			using vector = __m256i;
+			static constexpr size_t count = 8;
+
+			static vector load(const uint32_t* values)
+			{
+				return _mm256_load_si256(reinterpret_cast<const __m256i*>(values));
+			}
+
+			static void store(uint32_t* values, const vector value)
+			{
+				_mm256_store_si256(reinterpret_cast<__m256i*>(values), value);
+			}
+
+			static vector set(const uint32_t value)
+			{
+				return _mm256_set1_epi32(static_cast<int>(value));
+			}
+
+			static vector add(const vector a, const vector b)
+			{
+				return _mm256_add_epi32(a, b);
+			}
+
+			static vector bit_xor(const vector a, const vector b)
+			{
+				return _mm256_xor_si256(a, b);
+			}
+
+			template <int Bits>
+			static vector rotate_left(const vector value)
+			{
+				return _mm256_or_si256(_mm256_slli_epi32(value, Bits), _mm256_srli_epi32(value, 32 - Bits));
+			}
+
+			static vector choose(const vector b, const vector c, const vector d)
+			{
+				return _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+			}
+
+			static vector parity(const vector b, const vector c, const vector d)
+			{
+				return _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+			}
+
+			static vector majority(const vector b, const vector c, const vector d)
+			{
+				return _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+			}
+		};
+	}
+
+	void compute_many_avx2(const std::string_view* messages, const size_t count, uint8_t* digests)
+	{
+		compute_many<avx2_lanes>(messages, count, digests);
+	}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,84 @@
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <array>
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+
+#include "cryptography_lanes.hpp"
+
+namespace utils::cryptography::sha1::detail
+{
+	namespace
+	{
+		// Ternary logic replaces the two or three instructions every round function needs otherwise
+		struct avx512_lanes
+		{
+			using vector = __m512i;
+			static constexpr size_t count = 16;
+
+			static vector load(const uint32_t* values)
+			{
+				return _mm512_load_si512(values);
+			}
+
+			static void store(uint32_t* values, const vector value)
+			{
+				_mm512_store_si512(values, value);
+			}
+
+			static vector set(const uint32_t value)
+			{
+				return _mm512_set1_epi32(static_cast<int>(value));
+			}
+
+			static vector add(const vector a, const vector b)
+			{
+				return _mm512_add_epi32(a, b);
+			}
+
+			static vector bit_xor(const vector a, const vector b)
+			{
+				return _mm512_xor_si512(a, b);
+			}
+
+			template <int Bits>
+			static vector rotate_left(const vector value)
+			{
+				return _mm512_rol_epi32(value, Bits);
+			}
+
+			static vector choose(const vector b, const vector c, const vector d)
+			{
+				return _mm512_ternarylogic_epi32(b, c, d, 0xCA);
+			}
+
+			static vector parity(const vector b, const vector c, const vector d)
+			{
+				return _mm512_ternarylogic_epi32(b, c, d, 0x96);
+			}
+
+			static vector majority(const vector b, const vector c, const vector d)
+			{
+				return _mm512_ternarylogic_epi32(b, c, d, 0xE8);
+			}
+		};
+	}
+
+	void compute_many_avx512(const std::string_view* messages, const size_t count, uint8_t* digests)
+	{
+		compute_many<avx512_lanes>(messages, count, digests);
+	}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,207 @@
+#pragma once
+
+// Multi-buffer SHA-1, shared by the kernels for every instruction set.
+// Each kernel translation unit includes this after switching the compiler to its target,
+// so the standard headers used here have to be included before that.
+
+#include "cryptography.hpp"
+
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <array>
+
+namespace utils::cryptography::sha1::detail
+{
+	using compute_many_function = void(*)(const std::string_view* messages, size_t count, uint8_t* digests);
+
+	void compute_many_sse2(const std::string_view* messages, size_t count, uint8_t* digests);
+	void compute_many_avx2(const std::string_view* messages, size_t count, uint8_t* digests);
+	void compute_many_avx512(const std::string_view* messages, size_t count, uint8_t* digests);
+
+	constexpr uint32_t lane_initial_state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+	template <typename Lanes, int Round>
+	inline void lane_round(typename Lanes::vector (&v)[5], typename Lanes::vector (&w)[16],
+	                       const uint32_t (&words)[16][Lanes::count])
+	{
+		typename Lanes::vector value;
+		if constexpr (Round < 16)
+		{
+			value = Lanes::load(words[Round]);
+		}
+		else
+		{
+			value = Lanes::template rotate_left<1>(Lanes::parity(w[(Round + 13) & 15], w[(Round + 8) & 15],
+			                                                     Lanes::bit_xor(w[(Round + 2) & 15], w[Round & 15])));
+		}
+
+		w[Round & 15] = value;
+
+		auto& a = v[(80 - Round) % 5];
+		auto& b = v[(81 - Round) % 5];
+		auto& c = v[(82 - Round) % 5];
+		auto& d = v[(83 - Round) % 5];
+		auto& e = v[(84 - Round) % 5];
+
+		if constexpr (Round < 20)
+		{
+			e = Lanes::add(e, Lanes::add(Lanes::choose(b, c, d), Lanes::set(0x5A827999)));
+		}
+		else if constexpr (Round < 40)
+		{
+			e = Lanes::add(e, Lanes::add(Lanes::parity(b, c, d), Lanes::set(0x6ED9EBA1)));
+		}
+		else if constexpr (Round < 60)
+		{
+			e = Lanes::add(e, Lanes::add(Lanes::majority(b, c, d), Lanes::set(0x8F1BBCDC)));
+		}
+		else
+		{
+			e = Lanes::add(e, Lanes::add(Lanes::parity(b, c, d), Lanes::set(0xCA62C1D6)));
+		}
+
+		e = Lanes::add(e, Lanes::add(Lanes::template rotate_left<5>(a), value));
+		b = Lanes::template rotate_left<30>(b);
+	}
+
+	template <typename Lanes, int... Rounds>
+	inline void lane_block(typename Lanes::vector (&v)[5], const uint32_t (&words)[16][Lanes::count],
+	                       std::integer_sequence<int, Rounds...>)
+	{
+		typename Lanes::vector w[16];
+		(lane_round<Lanes, Rounds>(v, w, words), ...);
+	}
+
+	// Every lane works through its own message, lanes that finish pick up the next pending one.
+	// Lanes without work hash a dummy block, their result is thrown away.
+	template <typename Lanes>
+	void compute_many(const std::string_view* messages, const size_t count, uint8_t* digests)
+	{
+		constexpr auto lane_count = Lanes::count;
+
+		struct lane
+		{
+			bool active;
+			size_t message;
+			size_t block;
+			size_t full_blocks;
+			size_t block_count;
+			uint8_t tail[block_size * 2];
+		};
+
+		static constexpr uint8_t empty_block[block_size]{};
+
+		lane lanes[lane_count]{};
+		alignas(64) uint32_t state[5][lane_count]{};
+		alignas(64) uint32_t words[16][lane_count]{};
+
+		size_t next_message = 0;
+
+		const auto assign_message = [&](const size_t index)
+		{
+			auto& current = lanes[index];
+			current.active = next_message < count;
+			if (!current.active)
+			{
+				return;
+			}
+
+			current.message = next_message++;
+
+			const auto& message = messages[current.message];
+			const auto remaining = message.size() % block_size;
+
+			current.block = 0;
+			current.full_blocks = message.size() / block_size;
+			current.block_count = current.full_blocks + (remaining < 56 ? 1 : 2);
+
+			std::memset(current.tail, 0, sizeof(current.tail));
+			std::memcpy(current.tail, message.data() + current.full_blocks * block_size, remaining);
+			current.tail[remaining] = 0x80;
+
+			const auto tail_size = (current.block_count - current.full_blocks) * block_size;
+			const auto bit_length = static_cast<uint64_t>(message.size()) * 8;
+			for (size_t i = 0; i < 8; ++i)
+			{
+				current.tail[tail_size - 1 - i] = static_cast<uint8_t>(bit_length >> (i * 8));
+			}
+
+			for (size_t i = 0; i < 5; ++i)
+			{
+				state[i][index] = lane_initial_state[i];
+			}
+		};
+
+		for (size_t i = 0; i < lane_count; ++i)
+		{
+			assign_message(i);
+		}
+
+		while (true)
+		{
+			bool any_active = false;
+
+			for (size_t i = 0; i < lane_count; ++i)
+			{
+				const auto& current = lanes[i];
+				const uint8_t* block = empty_block;
+
+				if (current.active)
+				{
+					any_active = true;
+					block = current.block < current.full_blocks
+						        ? reinterpret_cast<const uint8_t*>(messages[current.message].data()) + current.block * block_size
+						        : current.tail + (current.block - current.full_blocks) * block_size;
+				}
+
+				for (size_t t = 0; t < 16; ++t)
+				{
+					const auto* bytes = block + t * 4;
+					words[t][i] = (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16)
+						| (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+				}
+			}
+
+			if (!any_active)
+			{
+				break;
+			}
+
+			typename Lanes::vector v[5];
+			for (size_t i = 0; i < 5; ++i)
+			{
+				v[i] = Lanes::load(state[i]);
+			}
+
+			const auto initial = std::to_array(v);
+			lane_block<Lanes>(v, words, std::make_integer_sequence<int, 80>{});
+
+			for (size_t i = 0; i < 5; ++i)
+			{
+				Lanes::store(state[i], Lanes::add(v[i], initial[i]));
+			}
+
+			for (size_t i = 0; i < lane_count; ++i)
+			{
+				auto& current = lanes[i];
+				if (!current.active || ++current.block < current.block_count)
+				{
+					continue;
+				}
+
+				auto* digest = digests + current.message * digest_size;
+				for (size_t j = 0; j < 5; ++j)
+				{
+					const auto value = state[j][i];
+					digest[j * 4 + 0] = static_cast<uint8_t>(value >> 24);
+					digest[j * 4 + 1] = static_cast<uint8_t>(value >> 16);
+					digest[j * 4 + 2] = static_cast<uint8_t>(value >> 8);
+					digest[j * 4 + 3] = static_cast<uint8_t>(value);
+				}
+
+				assign_message(i);
+			}
+		}
+	}
+}
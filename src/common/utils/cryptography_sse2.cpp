@@ -0,0 +1,70 @@
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <array>
+#include <immintrin.h>
+
+#include "cryptography_lanes.hpp"
+
+namespace utils::cryptography::sha1::detail
+{
+	namespace
+	{
+		struct sse2_lanes
+		{
+			using vector = __m128i;
+			static constexpr size_t count = 4;
+
+			static vector load(const uint32_t* values)
+			{
+				return _mm_load_si128(reinterpret_cast<const __m128i*>(values));
+			}
+
+			static void store(uint32_t* values, const vector value)
+			{
+				_mm_store_si128(reinterpret_cast<__m128i*>(values), value);
+			}
+
+			static vector set(const uint32_t value)
+			{
+				return _mm_set1_epi32(static_cast<int>(value));
+			}
+
+			static vector add(const vector a, const vector b)
+			{
+				return _mm_add_epi32(a, b);
+			}
+
+			static vector bit_xor(const vector a, const vector b)
+			{
+				return _mm_xor_si128(a, b);
+			}
+
+			template <int Bits>
+			static vector rotate_left(const vector value)
+			{
+				return _mm_or_si128(_mm_slli_epi32(value, Bits), _mm_srli_epi32(value, 32 - Bits));
+			}
+
+			static vector choose(const vector b, const vector c, const vector d)
+			{
+				return _mm_xor_si128(d, _mm_and_si128(b, _mm_xor_si128(c, d)));
+			}
+
+			static vector parity(const vector b, const vector c, const vector d)
+			{
+				return _mm_xor_si128(_mm_xor_si128(b, c), d);
+			}
+
+			static vector majority(const vector b, const vector c, const vector d)
+			{
+				return _mm_or_si128(_mm_and_si128(b, c), _mm_and_si128(d, _mm_or_si128(b, c)));
+			}
+		};
+	}
+
+	void compute_many_sse2(const std::string_view* messages, const size_t count, uint8_t* digests)
+	{
+		compute_many<sse2_lanes>(messages, count, digests);
+	}
+}
@@ -0,0 +1,132 @@
+#include "digest.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <emmintrin.h>
+#define DIGEST_SSE2 1
+#endif
+
+namespace utils::detail
+{
+	namespace
+	{
+		constexpr char hex_digits[] = "0123456789ABCDEF";
+
+		int decode_nibble(const char c)
+		{
+			if (c >= '0' && c <= '9') return c - '0';
+			if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+			if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+			return -1;
+		}
+
+#ifdef DIGEST_SSE2
+		// Turns 16 nibbles into their hex digits, values above 9 are moved up to 'A'
+		__m128i nibbles_to_hex(const __m128i nibbles)
+		{
+			const auto letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('A' - '0' - 10));
+			return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+		}
+
+		void encode_hex_16(const uint8_t* data, char* hex)
+		{
+			const auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			const auto mask = _mm_set1_epi8(0xF);
+
+			const auto high = nibbles_to_hex(_mm_and_si128(_mm_srli_epi16(input, 4), mask));
+			const auto low = nibbles_to_hex(_mm_and_si128(input, mask));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(hex), _mm_unpacklo_epi8(high, low));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 16), _mm_unpackhi_epi8(high, low));
+		}
+
+		// Maps 16 hex characters to their values, fails if any of them is not a hex digit
+		bool hex_to_nibbles(const __m128i text, __m128i& nibbles)
+		{
+			// Digits already have the lowercase bit set, so this only folds letters
+			const auto digit = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+			const auto letter = _mm_sub_epi8(_mm_or_si128(text, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+
+			const auto is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+			const auto is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+
+			if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xFFFF)
+			{
+				return false;
+			}
+
+			nibbles = _mm_or_si128(_mm_and_si128(is_digit, digit),
+			                       _mm_andnot_si128(is_digit, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+			return true;
+		}
+
+		bool decode_hex_16(const char* hex, uint8_t* data)
+		{
+			__m128i first{};
+			__m128i second{};
+
+			if (!hex_to_nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex)), first) ||
+				!hex_to_nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 16)), second))
+			{
+				return false;
+			}
+
+			// Each 16 bit lane holds the high nibble in its low byte and the low nibble in its high byte
+			const auto mask = _mm_set1_epi16(0xFF);
+			const auto combine = [&](const __m128i nibbles)
+			{
+				return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, mask), 4), _mm_srli_epi16(nibbles, 8));
+			};
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(data), _mm_packus_epi16(combine(first), combine(second)));
+			return true;
+		}
+#endif
+	}
+
+	void encode_hex(const uint8_t* data, const size_t size, char* hex)
+	{
+		size_t i = 0;
+
+#ifdef DIGEST_SSE2
+		for (; i + 16 <= size; i += 16)
+		{
+			encode_hex_16(data + i, hex + i * 2);
+		}
+#endif
+
+		for (; i < size; ++i)
+		{
+			hex[i * 2] = hex_digits[data[i] >> 4];
+			hex[i * 2 + 1] = hex_digits[data[i] & 0xF];
+		}
+	}
+
+	bool decode_hex(const char* hex, const size_t size, uint8_t* data)
+	{
+		size_t i = 0;
+
+#ifdef DIGEST_SSE2
+		for (; i + 16 <= size; i += 16)
+		{
+			if (!decode_hex_16(hex + i * 2, data + i))
+			{
+				return false;
+			}
+		}
+#endif
+
+		for (; i < size; ++i)
+		{
+			const auto high = decode_nibble(hex[i * 2]);
+			const auto low = decode_nibble(hex[i * 2 + 1]);
+			if (high < 0 || low < 0)
+			{
+				return false;
+			}
+
+			data[i] = static_cast<uint8_t>((high << 4) | low);
+		}
+
+		return true;
+	}
+}
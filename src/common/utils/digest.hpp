@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <cstring>
+#include <cstdint>
+
+namespace utils
+{
+	namespace detail
+	{
+		// Hex text holds two characters per byte, encoding produces uppercase digits
+		void encode_hex(const uint8_t* data, size_t size, char* hex);
+		bool decode_hex(const char* hex, size_t size, uint8_t* data);
+	}
+
+	// Fixed-size binary hash value, hex is only produced or consumed at text boundaries
+	template <size_t Size>
+	class digest
+	{
+	public:
+		static constexpr size_t hex_size = Size * 2;
+
+		digest() = default;
+
+		explicit digest(const void* data)
+		{
+			std::memcpy(this->bytes_.data(), data, Size);
+		}
+
+		static std::optional<digest> from_hex(const std::string_view hex)
+		{
+			digest result{};
+			if (hex.size() != hex_size || !detail::decode_hex(hex.data(), Size, result.bytes_.data()))
+			{
+				return {};
+			}
+
+			return {result};
+		}
+
+		std::string to_hex() const
+		{
+			std::string result(hex_size, '\0');
+			detail::encode_hex(this->bytes_.data(), Size, result.data());
+			return result;
+		}
+
+		static constexpr size_t size()
+		{
+			return Size;
+		}
+
+		const uint8_t* data() const
+		{
+			return this->bytes_.data();
+		}
+
+		uint8_t* data()
+		{
+			return this->bytes_.data();
+		}
+
+		std::string_view view() const
+		{
+			return {reinterpret_cast<const char*>(this->bytes_.data()), Size};
+		}
+
+		bool operator==(const digest& obj) const
+		{
+			return std::memcmp(this->bytes_.data(), obj.bytes_.data(), Size) == 0;
+		}
+
+		bool operator!=(const digest& obj) const
+		{
+			return !(*this == obj);
+		}
+
+		bool operator<(const digest& obj) const
+		{
+			return std::memcmp(this->bytes_.data(), obj.bytes_.data(), Size) < 0;
+		}
+
+	private:
+		std::array<uint8_t, Size> bytes_{};
+	};
+}
+
+template <size_t Size>
+struct std::hash<utils::digest<Size>>
+{
+	size_t operator()(const utils::digest<Size>& value) const noexcept
+	{
+		// Digests are already uniformly distributed
+		size_t result{};
+		std::memcpy(&result, value.data(), std::min(sizeof(result), Size));
+		return result;
+	}
+};
@@ -1,6 +1,14 @@
 #include "http.hpp"
+#include "io.hpp"
 #include <curl/curl.h>
 #include <gsl/gsl>
+#include <zlib.h>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <chrono>
 
 #pragma comment(lib, "ws2_32.lib")
 
@@ -8,15 +16,175 @@ namespace utils::http
 {
 	namespace
 	{
-		struct progress_helper
+		// Shares the DNS cache, TLS sessions and open connections between all transfers
+		class share_handle
 		{
+		public:
+			share_handle()
+			{
+				curl_global_init(CURL_GLOBAL_DEFAULT);
+
+				this->share_ = curl_share_init();
+				if (!this->share_)
+				{
+					return;
+				}
+
+				curl_share_setopt(this->share_, CURLSHOPT_LOCKFUNC, lock_callback);
+				curl_share_setopt(this->share_, CURLSHOPT_UNLOCKFUNC, unlock_callback);
+				curl_share_setopt(this->share_, CURLSHOPT_USERDATA, this);
+				curl_share_setopt(this->share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+				curl_share_setopt(this->share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+				curl_share_setopt(this->share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+			}
+
+			~share_handle()
+			{
+				if (this->share_)
+				{
+					curl_share_cleanup(this->share_);
+				}
+
+				curl_global_cleanup();
+			}
+
+			share_handle(share_handle&&) = delete;
+			share_handle(const share_handle&) = delete;
+			share_handle& operator=(share_handle&&) = delete;
+			share_handle& operator=(const share_handle&) = delete;
+
+			CURLSH* get() const
+			{
+				return this->share_;
+			}
+
+		private:
+			CURLSH* share_{};
+			std::mutex mutexes_[CURL_LOCK_DATA_LAST]{};
+
+			static void lock_callback(CURL* /*handle*/, const curl_lock_data data, curl_lock_access /*access*/, void* userptr)
+			{
+				static_cast<share_handle*>(userptr)->mutexes_[data].lock();
+			}
+
+			static void unlock_callback(CURL* /*handle*/, const curl_lock_data data, void* userptr)
+			{
+				static_cast<share_handle*>(userptr)->mutexes_[data].unlock();
+			}
+		};
+
+		share_handle& get_share_handle()
+		{
+			static share_handle share{};
+			return share;
+		}
+
+		struct transfer_helper
+		{
+			CURL* curl{};
+			sink* output{};
 			const std::function<void(size_t)>* callback{};
+			std::unique_ptr<inflate_sink> decoder{};
 			std::exception_ptr exception{};
+			response result{};
+			bool began{false};
+
+			uint64_t received_bytes{0};
+			std::chrono::steady_clock::time_point last_activity{};
 		};
 
+		bool has_header(const headers& headers, const std::string_view name)
+		{
+			return std::any_of(headers.begin(), headers.end(), [&](const std::pair<const std::string, std::string>& header)
+			{
+				return header.first.size() == name.size() && std::equal(header.first.begin(), header.first.end(), name.begin(),
+				                                                        [](const char a, const char b)
+				                                                        {
+					                                                        return tolower(a) == tolower(b);
+				                                                        });
+			});
+		}
+
+		bool is_compressed(const response& response)
+		{
+			const auto encoding = response.headers.find("content-encoding");
+			if (encoding == response.headers.end())
+			{
+				return false;
+			}
+
+			std::string value = encoding->second;
+			std::transform(value.begin(), value.end(), value.begin(), [](const char c)
+			{
+				return static_cast<char>(tolower(c));
+			});
+
+			return value == "gzip" || value == "x-gzip" || value == "deflate";
+		}
+
+		void begin_response(transfer_helper& helper)
+		{
+			if (helper.began)
+			{
+				return;
+			}
+
+			helper.began = true;
+			curl_easy_getinfo(helper.curl, CURLINFO_RESPONSE_CODE, &helper.result.code);
+
+			if (is_compressed(helper.result))
+			{
+				helper.decoder = std::make_unique<inflate_sink>(*helper.output);
+				helper.output = helper.decoder.get();
+			}
+
+			helper.output->begin(helper.result);
+		}
+
+		std::string trim(const std::string& text)
+		{
+			const auto start = text.find_first_not_of(" \t\r\n");
+			if (start == std::string::npos)
+			{
+				return {};
+			}
+
+			const auto end = text.find_last_not_of(" \t\r\n");
+			return text.substr(start, end - start + 1);
+		}
+
+		size_t header_callback(char* buffer, const size_t size, const size_t nitems, void* userdata)
+		{
+			auto* helper = static_cast<transfer_helper*>(userdata);
+
+			const auto total_size = size * nitems;
+			const std::string line{buffer, total_size};
+
+			// Every status line starts a new header block, e.g. after a redirect
+			if (line.starts_with("HTTP/"))
+			{
+				helper->result.headers.clear();
+				return total_size;
+			}
+
+			const auto separator = line.find(':');
+			if (separator != std::string::npos)
+			{
+				auto name = trim(line.substr(0, separator));
+				std::transform(name.begin(), name.end(), name.begin(), [](const char input)
+				{
+					return static_cast<char>(tolower(input));
+				});
+
+				helper->result.headers[name] = trim(line.substr(separator + 1));
+			}
+
+			return total_size;
+		}
+
 		int progress_callback(void *clientp, const curl_off_t /*dltotal*/, const curl_off_t dlnow, const curl_off_t /*ultotal*/, const curl_off_t /*ulnow*/)
 		{
-			auto* helper = static_cast<progress_helper*>(clientp);
+			auto* helper = static_cast<transfer_helper*>(clientp);
 
 			try
 			{
@@ -36,27 +204,582 @@ namespace utils::http
 	
 		size_t write_callback(void* contents, const size_t size, const size_t nmemb, void* userp)
 		{
-			auto* buffer = static_cast<std::string*>(userp);
+			auto* helper = static_cast<transfer_helper*>(userp);
 
 			const auto total_size = size * nmemb;
-			buffer->append(static_cast<char*>(contents), total_size);
+
+			try
+			{
+				helper->received_bytes += total_size;
+				helper->last_activity = std::chrono::steady_clock::now();
+
+				begin_response(*helper);
+				helper->output->write(contents, total_size);
+			}
+			catch (...)
+			{
+				helper->exception = std::current_exception();
+				return 0;
+			}
+
 			return total_size;
 		}
+
+		constexpr size_t default_max_active_transfers = 16;
+		constexpr auto stall_timeout = std::chrono::seconds(5);
+
+		struct transfer
+		{
+			CURL* curl{};
+			transfer_helper helper{};
+			CURLcode result{CURLE_OK};
+			std::coroutine_handle<> handle{};
+		};
+
+		// Runs every transfer on a single thread through one multi handle and resumes
+		// the awaiting coroutine on that thread once its transfer is done
+		class transfer_engine
+		{
+		public:
+			transfer_engine()
+			{
+				get_share_handle();
+
+				this->multi_ = curl_multi_init();
+				if (!this->multi_)
+				{
+					throw std::runtime_error("Failed to create curl multi handle");
+				}
+
+				curl_multi_setopt(this->multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+				this->thread_ = std::thread([this]()
+				{
+					this->run();
+				});
+			}
+
+			~transfer_engine()
+			{
+				this->stopped_ = true;
+				curl_multi_wakeup(this->multi_);
+
+				if (this->thread_.joinable())
+				{
+					this->thread_.join();
+				}
+
+				for (auto* curl : this->idle_handles_)
+				{
+					curl_easy_cleanup(curl);
+				}
+
+				curl_multi_cleanup(this->multi_);
+			}
+
+			transfer_engine(transfer_engine&&) = delete;
+			transfer_engine(const transfer_engine&) = delete;
+			transfer_engine& operator=(transfer_engine&&) = delete;
+			transfer_engine& operator=(const transfer_engine&) = delete;
+
+			// Easy handles are kept around after a transfer, so their connections can be reused
+			CURL* acquire_handle()
+			{
+				CURL* curl{};
+
+				{
+					std::lock_guard<std::mutex> _{this->mutex_};
+					if (!this->idle_handles_.empty())
+					{
+						curl = this->idle_handles_.back();
+						this->idle_handles_.pop_back();
+					}
+				}
+
+				if (curl)
+				{
+					curl_easy_reset(curl);
+				}
+				else
+				{
+					curl = curl_easy_init();
+					if (!curl)
+					{
+						return nullptr;
+					}
+				}
+
+				curl_easy_setopt(curl, CURLOPT_SHARE, get_share_handle().get());
+				curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+				curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+				curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
+				return curl;
+			}
+
+			void release_handle(CURL* curl)
+			{
+				std::lock_guard<std::mutex> _{this->mutex_};
+				this->idle_handles_.emplace_back(curl);
+			}
+
+			void set_max_active_transfers(const size_t count)
+			{
+				this->max_active_transfers_ = std::max(1ull, count);
+				curl_multi_wakeup(this->multi_);
+			}
+
+			transfer_stats get_stats()
+			{
+				std::lock_guard<std::mutex> _{this->mutex_};
+				return this->stats_;
+			}
+
+			bool is_engine_thread() const
+			{
+				return std::this_thread::get_id() == this->thread_.get_id();
+			}
+
+			auto perform(transfer& transfer)
+			{
+				struct awaiter
+				{
+					transfer_engine& engine;
+					struct transfer& transfer;
+
+					bool await_ready() const noexcept
+					{
+						return false;
+					}
+
+					void await_suspend(const std::coroutine_handle<> handle) const
+					{
+						this->transfer.handle = handle;
+						this->engine.submit(this->transfer);
+					}
+
+					void await_resume() const noexcept
+					{
+					}
+				};
+
+				return awaiter{*this, transfer};
+			}
+
+		private:
+			CURLM* multi_{};
+			std::thread thread_{};
+			std::atomic_bool stopped_{false};
+			std::atomic<size_t> max_active_transfers_{default_max_active_transfers};
+			std::vector<transfer*> active_transfers_{};
+			uint64_t finished_bytes_{0};
+
+			std::mutex mutex_{};
+			std::deque<transfer*> pending_transfers_{};
+			std::vector<CURL*> idle_handles_{};
+			transfer_stats stats_{};
+
+			void submit(transfer& transfer)
+			{
+				{
+					std::lock_guard<std::mutex> _{this->mutex_};
+					this->pending_transfers_.emplace_back(&transfer);
+				}
+
+				curl_multi_wakeup(this->multi_);
+			}
+
+			void start_pending_transfers()
+			{
+				std::vector<transfer*> failed_transfers{};
+
+				{
+					std::lock_guard<std::mutex> _{this->mutex_};
+
+					while (this->active_transfers_.size() < this->max_active_transfers_ && !this->pending_transfers_.empty())
+					{
+						auto* transfer = this->pending_transfers_.front();
+						this->pending_transfers_.pop_front();
+
+						curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+
+						if (curl_multi_add_handle(this->multi_, transfer->curl) != CURLM_OK)
+						{
+							transfer->result = CURLE_FAILED_INIT;
+							failed_transfers.emplace_back(transfer);
+							continue;
+						}
+
+						this->active_transfers_.emplace_back(transfer);
+					}
+				}
+
+				for (auto* transfer : failed_transfers)
+				{
+					transfer->handle.resume();
+				}
+			}
+
+			void finish_transfers()
+			{
+				int messages_left{};
+				while (auto* message = curl_multi_info_read(this->multi_, &messages_left))
+				{
+					if (message->msg != CURLMSG_DONE)
+					{
+						continue;
+					}
+
+					char* pointer{};
+					curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &pointer);
+
+					auto* transfer = reinterpret_cast<struct transfer*>(pointer);
+					transfer->result = message->data.result;
+
+					curl_multi_remove_handle(this->multi_, message->easy_handle);
+
+					this->finished_bytes_ += transfer->helper.received_bytes;
+					std::erase(this->active_transfers_, transfer);
+
+					transfer->handle.resume();
+				}
+			}
+
+			void update_stats()
+			{
+				const auto now = std::chrono::steady_clock::now();
+
+				transfer_stats stats{};
+				stats.received_bytes = this->finished_bytes_;
+				stats.active_transfers = this->active_transfers_.size();
+
+				for (const auto* transfer : this->active_transfers_)
+				{
+					stats.received_bytes += transfer->helper.received_bytes;
+
+					// Connecting and waiting for the server to answer is not a stall, timing starts with the first body byte
+					if (transfer->helper.received_bytes > 0 && now - transfer->helper.last_activity >= stall_timeout)
+					{
+						++stats.stalled_transfers;
+					}
+				}
+
+				std::lock_guard<std::mutex> _{this->mutex_};
+				stats.queued_transfers = this->pending_transfers_.size();
+				this->stats_ = stats;
+			}
+
+			void run()
+			{
+				while (!this->stopped_)
+				{
+					this->start_pending_transfers();
+
+					int running_transfers{};
+					curl_multi_perform(this->multi_, &running_transfers);
+
+					this->update_stats();
+					this->finish_transfers();
+
+					curl_multi_poll(this->multi_, nullptr, 0, 1000, nullptr);
+				}
+			}
+		};
+
+		transfer_engine& get_transfer_engine()
+		{
+			static transfer_engine engine{};
+			return engine;
+		}
+
+		coroutine::task<void> fetch_into_promise(std::string url, headers headers,
+		                                         std::shared_ptr<std::promise<std::optional<std::string>>> promise)
+		{
+			try
+			{
+				memory_sink sink{};
+				if (co_await fetch(std::move(url), sink, std::move(headers)))
+				{
+					promise->set_value({std::move(sink.get_data())});
+				}
+				else
+				{
+					promise->set_value({});
+				}
+			}
+			catch (...)
+			{
+				promise->set_exception(std::current_exception());
+			}
+		}
 	}
 
-	std::optional<std::string> get_data(const std::string& url, const headers& headers, const std::function<void(size_t)>& callback)
+	void memory_sink::write(const void* data, const size_t length)
 	{
-		curl_slist* header_list = nullptr;
-		auto* curl = curl_easy_init();
-		if (!curl)
+		this->data_.append(static_cast<const char*>(data), length);
+	}
+
+	std::string& memory_sink::get_data()
+	{
+		return this->data_;
+	}
+
+	file_sink::file_sink(const std::string& file, const bool append)
+		: file_(file)
+	{
+		const auto pos = file.find_last_of("/\\");
+		if (pos != std::string::npos)
 		{
-			return {};
+			io::create_directory(file.substr(0, pos));
+		}
+
+		this->stream_.open(file, std::ios::binary | std::ios::out | (append ? std::ios::app : std::ios::trunc));
+		this->buffer_ = std::make_unique<char[]>(buffer_capacity);
+	}
+
+	file_sink::~file_sink()
+	{
+		this->close();
+	}
+
+	void file_sink::write(const void* data, size_t length)
+	{
+		const auto* bytes = static_cast<const char*>(data);
+		this->size_ += length;
+
+		while (length > 0)
+		{
+			if (this->buffer_size_ == buffer_capacity)
+			{
+				this->flush();
+			}
+
+			const auto chunk = std::min(length, buffer_capacity - this->buffer_size_);
+			std::memcpy(this->buffer_.get() + this->buffer_size_, bytes, chunk);
+
+			this->buffer_size_ += chunk;
+			bytes += chunk;
+			length -= chunk;
+		}
+	}
+
+	bool file_sink::is_open() const
+	{
+		return this->stream_.is_open();
+	}
+
+	bool file_sink::close()
+	{
+		if (!this->stream_.is_open())
+		{
+			return false;
+		}
+
+		this->flush();
+		this->stream_.close();
+
+		return !this->stream_.fail();
+	}
+
+	void file_sink::truncate()
+	{
+		this->stream_.close();
+		this->stream_.open(this->file_, std::ios::binary | std::ios::out | std::ios::trunc);
+
+		this->buffer_size_ = 0;
+		this->size_ = 0;
+
+		if (!this->stream_.is_open())
+		{
+			throw std::runtime_error("Failed to truncate " + this->file_);
+		}
+	}
+
+	size_t file_sink::get_size() const
+	{
+		return this->size_;
+	}
+
+	void file_sink::flush()
+	{
+		if (this->buffer_size_ == 0)
+		{
+			return;
+		}
+
+		this->stream_.write(this->buffer_.get(), static_cast<std::streamsize>(this->buffer_size_));
+		this->buffer_size_ = 0;
+
+		if (this->stream_.fail())
+		{
+			throw std::runtime_error("Failed to write downloaded data to disk");
 		}
+	}
+
+	void hash_sink::write(const void* data, const size_t length)
+	{
+		this->context_.update(data, length);
+	}
+
+	cryptography::sha1::digest hash_sink::get_hash()
+	{
+		return this->context_.final();
+	}
+
+	void hash_sink::reset()
+	{
+		this->context_.init();
+	}
+
+	tee_sink::tee_sink(sink& first, sink& second)
+		: first_(first)
+		, second_(second)
+	{
+	}
+
+	void tee_sink::begin(const response& response)
+	{
+		this->first_.begin(response);
+		this->second_.begin(response);
+	}
+
+	void tee_sink::write(const void* data, const size_t length)
+	{
+		this->first_.write(data, length);
+		this->second_.write(data, length);
+	}
+
+	inflate_sink::inflate_sink(sink& output)
+		: output_(output)
+		, stream_(std::make_unique<z_stream_s>())
+		, buffer_(std::make_unique<uint8_t[]>(buffer_capacity))
+	{
+		this->reset(false);
+	}
+
+	inflate_sink::~inflate_sink()
+	{
+		inflateEnd(this->stream_.get());
+	}
+
+	void inflate_sink::begin(const response& response)
+	{
+		this->output_.begin(response);
+	}
+
+	void inflate_sink::write(const void* data, const size_t length)
+	{
+		// Some servers send deflate without the zlib header, which only shows once the header check fails,
+		// so the first bytes are kept to decode them again as raw deflate
+		const auto replay = this->header_.size();
+		if (!this->raw_ && replay < 2)
+		{
+			this->header_.append(static_cast<const char*>(data), std::min(length, 2 - replay));
+		}
+
+		if (!this->decode(data, length))
+		{
+			this->reset(true);
+			this->decode(this->header_.data(), replay);
+			this->decode(data, length);
+		}
+	}
+
+	bool inflate_sink::decode(const void* data, const size_t length)
+	{
+		auto& stream = *this->stream_;
+		stream.next_in = static_cast<const Bytef*>(data);
+		stream.avail_in = static_cast<uInt>(length);
+
+		while (stream.avail_in > 0)
+		{
+			// Concatenated gzip members are decoded one after another
+			if (this->complete_)
+			{
+				inflateReset(&stream);
+				this->complete_ = false;
+			}
+
+			stream.next_out = this->buffer_.get();
+			stream.avail_out = static_cast<uInt>(buffer_capacity);
+
+			const auto result = inflate(&stream, Z_NO_FLUSH);
+			if (result == Z_DATA_ERROR && !this->raw_ && !this->decoded_ && stream.total_in <= 2)
+			{
+				return false;
+			}
+
+			if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+			{
+				throw std::runtime_error("Invalid compressed data");
+			}
+
+			const auto produced = buffer_capacity - stream.avail_out;
+			if (produced > 0)
+			{
+				this->decoded_ = true;
+				this->output_.write(this->buffer_.get(), produced);
+			}
+
+			if (result == Z_STREAM_END)
+			{
+				this->complete_ = true;
+			}
+			else if (result == Z_BUF_ERROR && produced == 0)
+			{
+				throw std::runtime_error("Invalid compressed data");
+			}
+		}
+
+		return true;
+	}
+
+	bool inflate_sink::is_complete() const
+	{
+		return this->complete_;
+	}
+
+	void inflate_sink::reset(const bool raw)
+	{
+		if (this->stream_->state)
+		{
+			inflateEnd(this->stream_.get());
+		}
+
+		*this->stream_ = {};
+		this->raw_ = raw;
+		this->complete_ = false;
+
+		// 15 + 32 detects gzip and zlib headers, negative window bits mean no header at all
+		if (inflateInit2(this->stream_.get(), raw ? -15 : 15 + 32) != Z_OK)
+		{
+			throw std::runtime_error("Failed to initialize decompression");
+		}
+	}
+
+	coroutine::task<bool> fetch(std::string url, sink& sink, headers headers, std::function<void(size_t)> callback)
+	{
+		auto& engine = get_transfer_engine();
+
+		// Ranges address the encoded body, so they are always requested unencoded
+		if (!has_header(headers, "Accept-Encoding") && !has_header(headers, "Range"))
+		{
+			headers["Accept-Encoding"] = "gzip, deflate";
+		}
+
+		transfer current{};
+		current.curl = engine.acquire_handle();
+		if (!current.curl)
+		{
+			co_return false;
+		}
+
+		curl_slist* header_list = nullptr;
 
 		auto _ = gsl::finally([&]()
 		{
 			curl_slist_free_all(header_list);
-			curl_easy_cleanup(curl);
+			engine.release_handle(current.curl);
 		});
 		
 		for(const auto& header : headers)
@@ -65,14 +788,18 @@ namespace utils::http
 			header_list = curl_slist_append(header_list, data.data());
 		}
 
-		std::string buffer{};
-		progress_helper helper{};
+		auto* curl = current.curl;
+		auto& helper = current.helper;
+		helper.curl = curl;
+		helper.output = &sink;
 		helper.callback = &callback;
 		
 		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
 		curl_easy_setopt(curl, CURLOPT_URL, url.data());
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &helper);
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &helper);
 		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
 		curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &helper);
 		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
@@ -80,15 +807,24 @@ namespace utils::http
 		curl_easy_setopt(curl, CURLOPT_USERAGENT, "xlabs-updater/1.0");
 		curl_easy_setopt(curl, CURLOPT_FAILONERROR, true);
 
+		co_await engine.perform(current);
+
 		// Due to CURLOPT_FAILONERROR, CURLE_OK will not be met when the server returns 400 or 500
-		if (curl_easy_perform(curl) == CURLE_OK)
+		if (current.result == CURLE_OK)
 		{
 			long http_code = 0;
 			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
 			if (http_code >= 200) 
 			{
-				return { std::move(buffer) };
+				begin_response(helper);
+
+				if (helper.decoder && !helper.decoder->is_complete())
+				{
+					co_return false;
+				}
+
+				co_return true;
 			}
 
 			throw std::runtime_error("Bad status code " + std::to_string(http_code) + " met while trying to download file " + url);
@@ -99,14 +835,48 @@ namespace utils::http
 			std::rethrow_exception(helper.exception);
 		}
 
-		return {};
+		co_return false;
 	}
 
-	std::future<std::optional<std::string>> get_data_async(const std::string& url, const headers& headers)
+	void set_max_concurrent_transfers(const size_t count)
 	{
-		return std::async(std::launch::async, [url, headers]()
+		get_transfer_engine().set_max_active_transfers(count);
+	}
+
+	transfer_stats get_transfer_stats()
+	{
+		return get_transfer_engine().get_stats();
+	}
+
+	bool download(const std::string& url, sink& sink, const headers& headers, const std::function<void(size_t)>& callback)
+	{
+		// Blocking here would stall every other transfer, coroutines must await fetch instead
+		if (get_transfer_engine().is_engine_thread())
 		{
-			return get_data(url, headers);
-		});
+			throw std::runtime_error("Blocking download of " + url + " started from the transfer thread");
+		}
+
+		return coroutine::sync_wait(fetch(url, sink, headers, callback));
+	}
+
+	std::optional<std::string> get_data(const std::string& url, const headers& headers, const std::function<void(size_t)>& callback)
+	{
+		memory_sink sink{};
+		if (!download(url, sink, headers, callback))
+		{
+			return {};
+		}
+
+		return { std::move(sink.get_data()) };
+	}
+
+	std::future<std::optional<std::string>> get_data_async(const std::string& url, const headers& headers)
+	{
+		auto promise = std::make_shared<std::promise<std::optional<std::string>>>();
+		auto future = promise->get_future();
+
+		coroutine::start_detached(fetch_into_promise(url, headers, std::move(promise)));
+
+		return future;
 	}
 }
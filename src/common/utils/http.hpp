@@ -3,11 +3,156 @@
 #include <string>
 #include <optional>
 #include <future>
+#include <fstream>
+#include <unordered_map>
+
+#include "cryptography.hpp"
+#include "coroutine.hpp"
+
+struct z_stream_s;
 
 namespace utils::http
 {
 	using headers = std::unordered_map<std::string, std::string>;
 
+	struct response
+	{
+		long code{};
+		http::headers headers{}; // Names are lowercase
+	};
+
+	struct transfer_stats
+	{
+		uint64_t received_bytes{}; // Total body bytes received since startup
+		size_t active_transfers{};
+		size_t queued_transfers{};
+		size_t stalled_transfers{}; // Active transfers that received data before, but not for a while
+	};
+
+	class sink
+	{
+	public:
+		virtual ~sink() = default;
+
+		// Called once the response headers are known, before any body data is written
+		virtual void begin(const response& /*response*/)
+		{
+		}
+
+		virtual void write(const void* data, size_t length) = 0;
+	};
+
+	class memory_sink final : public sink
+	{
+	public:
+		void write(const void* data, size_t length) override;
+
+		std::string& get_data();
+
+	private:
+		std::string data_{};
+	};
+
+	class file_sink final : public sink
+	{
+	public:
+		explicit file_sink(const std::string& file, bool append = false);
+		~file_sink() override;
+
+		file_sink(file_sink&&) = delete;
+		file_sink(const file_sink&) = delete;
+		file_sink& operator=(file_sink&&) = delete;
+		file_sink& operator=(const file_sink&) = delete;
+
+		void write(const void* data, size_t length) override;
+
+		bool is_open() const;
+		bool close();
+
+		void truncate();
+
+		size_t get_size() const;
+
+	private:
+		static constexpr size_t buffer_capacity = 0x10000;
+
+		std::string file_{};
+		std::ofstream stream_{};
+		std::unique_ptr<char[]> buffer_{};
+		size_t buffer_size_{0};
+		size_t size_{0};
+
+		void flush();
+	};
+
+	class hash_sink final : public sink
+	{
+	public:
+		void write(const void* data, size_t length) override;
+
+		cryptography::sha1::digest get_hash();
+
+		void reset();
+
+	private:
+		cryptography::sha1::context context_{};
+	};
+
+	class tee_sink final : public sink
+	{
+	public:
+		tee_sink(sink& first, sink& second);
+
+		void begin(const response& response) override;
+		void write(const void* data, size_t length) override;
+
+	private:
+		sink& first_;
+		sink& second_;
+	};
+
+	// Decompresses gzip, zlib or raw deflate data while it arrives and passes the result on
+	class inflate_sink final : public sink
+	{
+	public:
+		explicit inflate_sink(sink& output);
+		~inflate_sink() override;
+
+		inflate_sink(inflate_sink&&) = delete;
+		inflate_sink(const inflate_sink&) = delete;
+		inflate_sink& operator=(inflate_sink&&) = delete;
+		inflate_sink& operator=(const inflate_sink&) = delete;
+
+		void begin(const response& response) override;
+		void write(const void* data, size_t length) override;
+
+		// False if the compressed stream was cut off
+		bool is_complete() const;
+
+	private:
+		static constexpr size_t buffer_capacity = 0x10000;
+
+		sink& output_;
+		std::unique_ptr<z_stream_s> stream_;
+		std::unique_ptr<uint8_t[]> buffer_{};
+		std::string header_{};
+		bool raw_{false};
+		bool decoded_{false};
+		bool complete_{false};
+
+		void reset(bool raw);
+		bool decode(const void* data, size_t length);
+	};
+
+	// Responses are requested with gzip or deflate encoding unless the headers ask for something else or a range,
+	// sinks always receive the decoded body.
+	// Transfers run concurrently on a single background thread, at most the given number at once
+	coroutine::task<bool> fetch(std::string url, sink& sink, headers headers = {}, std::function<void(size_t)> callback = {});
+	void set_max_concurrent_transfers(size_t count);
+	transfer_stats get_transfer_stats();
+
+	bool download(const std::string& url, sink& sink, const headers& headers = {}, const std::function<void(size_t)>& callback = {});
+
 	std::optional<std::string> get_data(const std::string& url, const headers& headers = {}, const std::function<void(size_t)>& callback = {});
 	std::future<std::optional<std::string>> get_data_async(const std::string& url, const headers& headers = {});
 }
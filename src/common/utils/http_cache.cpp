@@ -0,0 +1,260 @@
+#include "http_cache.hpp"
+#include "cryptography.hpp"
+#include "io.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace utils::http
+{
+	namespace
+	{
+		constexpr uint32_t entry_magic = 0x31524858; // XHR1
+		constexpr uint32_t entry_version = 1;
+
+		// Every cache file is this header, followed by the ETag, the Last-Modified value and the body
+		struct entry_header
+		{
+			uint32_t magic;
+			uint32_t version;
+			int64_t stored_at; // Seconds since the epoch
+			uint8_t body_hash[cryptography::sha1::digest_size];
+			uint32_t etag_length;
+			uint32_t last_modified_length;
+			uint32_t reserved;
+			uint64_t body_size;
+		};
+
+		static_assert(sizeof(entry_header) == 56);
+
+		class response_sink final : public sink
+		{
+		public:
+			void begin(const response& response) override
+			{
+				this->response_ = response;
+			}
+
+			void write(const void* data, const size_t length) override
+			{
+				this->body_.append(static_cast<const char*>(data), length);
+			}
+
+			const response& get_response() const
+			{
+				return this->response_;
+			}
+
+			std::string& get_body()
+			{
+				return this->body_;
+			}
+
+		private:
+			response response_{};
+			std::string body_{};
+		};
+
+		int64_t get_current_time()
+		{
+			return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		std::string get_header(const response& response, const std::string& name)
+		{
+			const auto header = response.headers.find(name);
+			return header != response.headers.end() ? header->second : std::string{};
+		}
+	}
+
+	cache::cache(std::string directory)
+		: directory_(std::move(directory))
+	{
+	}
+
+	void cache::set_policy(std::string url_prefix, const cache_policy policy)
+	{
+		this->policies_.emplace_back(std::move(url_prefix), policy);
+	}
+
+	coroutine::task<std::optional<std::string>> cache::get(std::string url, headers headers) const
+	{
+		const auto policy = this->get_policy(url);
+		const auto file = this->get_file(url, headers);
+		const auto now = get_current_time();
+
+		auto cached = load(file);
+		if (cached && now >= cached->stored_at && now - cached->stored_at < policy.max_age.count())
+		{
+			co_return std::move(cached->body);
+		}
+
+		if (cached && !cached->etag.empty())
+		{
+			headers["If-None-Match"] = cached->etag;
+		}
+
+		if (cached && !cached->last_modified.empty())
+		{
+			headers["If-Modified-Since"] = cached->last_modified;
+		}
+
+		response_sink sink{};
+		auto result = false;
+		std::exception_ptr error{};
+
+		// Transport errors are what stale entries are kept for, they only propagate if there is none
+		try
+		{
+			result = co_await fetch(url, sink, std::move(headers));
+		}
+		catch (const std::exception& e)
+		{
+			logger::write("Failed to fetch {}: {}", url, e.what());
+			error = std::current_exception();
+		}
+
+		const auto code = sink.get_response().code;
+
+		if (result && code == 304 && cached)
+		{
+			// Only the age matters for the policy, without one the entry does not have to be written again
+			if (policy.max_age.count() > 0)
+			{
+				cached->stored_at = now;
+				store(file, *cached);
+			}
+
+			co_return std::move(cached->body);
+		}
+
+		if (result && code >= 200 && code < 300)
+		{
+			entry fresh{};
+			fresh.stored_at = now;
+			fresh.etag = get_header(sink.get_response(), "etag");
+			fresh.last_modified = get_header(sink.get_response(), "last-modified");
+			fresh.body = std::move(sink.get_body());
+
+			if (!fresh.etag.empty() || !fresh.last_modified.empty() || policy.max_age.count() > 0 || policy.use_stale_on_error)
+			{
+				store(file, fresh);
+			}
+
+			co_return std::move(fresh.body);
+		}
+
+		if (cached && policy.use_stale_on_error)
+		{
+			co_return std::move(cached->body);
+		}
+
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+
+		co_return std::optional<std::string>{};
+	}
+
+	std::optional<std::string> cache::get_data(const std::string& url, const headers& headers) const
+	{
+		return coroutine::sync_wait(this->get(url, headers));
+	}
+
+	cache_policy cache::get_policy(const std::string& url) const
+	{
+		const std::pair<std::string, cache_policy>* match = nullptr;
+
+		for (const auto& policy : this->policies_)
+		{
+			if (url.starts_with(policy.first) && (!match || policy.first.size() > match->first.size()))
+			{
+				match = &policy;
+			}
+		}
+
+		return match ? match->second : cache_policy{};
+	}
+
+	std::string cache::get_file(const std::string& url, const headers& headers) const
+	{
+		// Request headers like Accept can change the response, so they are part of the key
+		std::vector<std::pair<std::string, std::string>> sorted_headers(headers.begin(), headers.end());
+		std::sort(sorted_headers.begin(), sorted_headers.end());
+
+		auto key = url;
+		for (const auto& header : sorted_headers)
+		{
+			key += "\n" + header.first + ": " + header.second;
+		}
+
+		return this->directory_ + "/" + cryptography::sha1::compute(key).to_hex();
+	}
+
+	std::optional<cache::entry> cache::load(const std::string& file)
+	{
+		std::string data{};
+		if (!io::read_file(file, &data) || data.size() < sizeof(entry_header))
+		{
+			return {};
+		}
+
+		entry_header header{};
+		std::memcpy(&header, data.data(), sizeof(header));
+
+		if (header.magic != entry_magic || header.version != entry_version
+			|| sizeof(header) + static_cast<uint64_t>(header.etag_length) + header.last_modified_length + header.body_size != data.size())
+		{
+			return {};
+		}
+
+		const std::string_view view{data};
+		auto offset = sizeof(header);
+
+		entry result{};
+		result.stored_at = header.stored_at;
+		result.etag = view.substr(offset, header.etag_length);
+		offset += header.etag_length;
+		result.last_modified = view.substr(offset, header.last_modified_length);
+		offset += header.last_modified_length;
+		result.body = view.substr(offset);
+
+		// A damaged body must not be served as if the server had confirmed it
+		if (cryptography::sha1::compute(result.body) != cryptography::sha1::digest{header.body_hash})
+		{
+			return {};
+		}
+
+		return {std::move(result)};
+	}
+
+	void cache::store(const std::string& file, const entry& entry)
+	{
+		entry_header header{};
+		header.magic = entry_magic;
+		header.version = entry_version;
+		header.stored_at = entry.stored_at;
+		header.etag_length = static_cast<uint32_t>(entry.etag.size());
+		header.last_modified_length = static_cast<uint32_t>(entry.last_modified.size());
+		header.body_size = entry.body.size();
+
+		const auto body_hash = cryptography::sha1::compute(entry.body);
+		std::memcpy(header.body_hash, body_hash.data(), sizeof(header.body_hash));
+
+		std::string data{};
+		data.reserve(sizeof(header) + entry.etag.size() + entry.last_modified.size() + entry.body.size());
+		data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+		data.append(entry.etag);
+		data.append(entry.last_modified);
+		data.append(entry.body);
+
+		// Written next to the entry first, so a crash never leaves a truncated entry behind
+		const auto temp_file = file + ".tmp";
+		if (io::write_file(temp_file, data) && !io::move_file(temp_file, file, true))
+		{
+			io::remove_file(temp_file);
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <chrono>
+
+#include "http.hpp"
+
+namespace utils::http
+{
+	struct cache_policy
+	{
+		// Entries younger than this are served without asking the server at all
+		std::chrono::seconds max_age{0};
+
+		// Serve the cached body when the server can not be reached or answers with an error
+		bool use_stale_on_error{false};
+	};
+
+	// On-disk cache for small responses that are read as a whole, like manifests and API calls.
+	// Bodies are stored with their ETag and Last-Modified validators, so later requests are made
+	// conditional and a 304 is answered from disk.
+	class cache
+	{
+	public:
+		explicit cache(std::string directory);
+
+		// The policy of the longest matching URL prefix applies, other URLs are revalidated every time.
+		// Policies have to be set up before the cache is used.
+		void set_policy(std::string url_prefix, cache_policy policy);
+
+		coroutine::task<std::optional<std::string>> get(std::string url, headers headers = {}) const;
+		std::optional<std::string> get_data(const std::string& url, const headers& headers = {}) const;
+
+	private:
+		struct entry
+		{
+			int64_t stored_at{};
+			std::string etag{};
+			std::string last_modified{};
+			std::string body{};
+		};
+
+		std::string directory_;
+		std::vector<std::pair<std::string, cache_policy>> policies_{};
+
+		cache_policy get_policy(const std::string& url) const;
+		std::string get_file(const std::string& url, const headers& headers) const;
+
+		static std::optional<entry> load(const std::string& file);
+		static void store(const std::string& file, const entry& entry);
+	};
+}
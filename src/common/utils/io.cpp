@@ -4,14 +4,99 @@
 
 namespace utils::io
 {
+	namespace
+	{
+		// Paths are passed to the ANSI file APIs everywhere, names the code page can not represent would come out
+		// mangled and point at nothing or at another file
+		std::optional<std::string> to_ansi_name(const std::wstring_view name)
+		{
+			const auto length = static_cast<int>(name.size());
+
+			BOOL lossy = FALSE;
+			std::string result(static_cast<size_t>(WideCharToMultiByte(CP_ACP, WC_NO_BEST_FIT_CHARS, name.data(), length,
+			                                                           nullptr, 0, nullptr, &lossy)), '\0');
+			WideCharToMultiByte(CP_ACP, WC_NO_BEST_FIT_CHARS, name.data(), length, result.data(), static_cast<int>(result.size()),
+			                    nullptr, &lossy);
+
+			if (lossy || result.empty())
+			{
+				return {};
+			}
+
+			return {std::move(result)};
+		}
+	}
+
+	mapped_file::mapped_file(const std::string& file)
+	{
+		this->file_handle_ = CreateFileA(file.data(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+		                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (this->file_handle_ == INVALID_HANDLE_VALUE)
+		{
+			this->file_handle_ = nullptr;
+			return;
+		}
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(this->file_handle_, &size) || size.QuadPart == 0)
+		{
+			return;
+		}
+
+		this->mapping_handle_ = CreateFileMappingA(this->file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!this->mapping_handle_)
+		{
+			return;
+		}
+
+		this->view_ = static_cast<const uint8_t*>(MapViewOfFile(this->mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+		if (this->view_)
+		{
+			this->size_ = static_cast<size_t>(size.QuadPart);
+		}
+	}
+
+	mapped_file::~mapped_file()
+	{
+		if (this->view_)
+		{
+			UnmapViewOfFile(this->view_);
+		}
+
+		if (this->mapping_handle_)
+		{
+			CloseHandle(this->mapping_handle_);
+		}
+
+		if (this->file_handle_)
+		{
+			CloseHandle(this->file_handle_);
+		}
+	}
+
+	bool mapped_file::is_valid() const
+	{
+		return this->view_ != nullptr;
+	}
+
+	const uint8_t* mapped_file::data() const
+	{
+		return this->view_;
+	}
+
+	size_t mapped_file::size() const
+	{
+		return this->size_;
+	}
+
 	bool remove_file(const std::string& file)
 	{
 		return DeleteFileA(file.data()) == TRUE;
 	}
 
-	bool move_file(const std::string& src, const std::string& target)
+	bool move_file(const std::string& src, const std::string& target, const bool overwrite)
 	{
-		return MoveFileA(src.data(), target.data()) == TRUE;
+		return MoveFileExA(src.data(), target.data(), overwrite ? MOVEFILE_REPLACE_EXISTING : 0) == TRUE;
 	}
 
 	bool file_exists(const std::string& file)
@@ -89,6 +174,38 @@ namespace utils::io
 		return 0;
 	}
 
+	std::optional<file_metadata> get_file_metadata(const std::string& file)
+	{
+		auto* const handle = CreateFileA(file.data(), FILE_READ_ATTRIBUTES,
+		                                 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+		                                 OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			return {};
+		}
+
+		BY_HANDLE_FILE_INFORMATION info{};
+		const auto result = GetFileInformationByHandle(handle, &info);
+		CloseHandle(handle);
+
+		if (!result || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			return {};
+		}
+
+		const auto make_uint64 = [](const DWORD high, const DWORD low)
+		{
+			return (static_cast<uint64_t>(high) << 32) | low;
+		};
+
+		file_metadata metadata{};
+		metadata.size = make_uint64(info.nFileSizeHigh, info.nFileSizeLow);
+		metadata.last_write_time = make_uint64(info.ftLastWriteTime.dwHighDateTime, info.ftLastWriteTime.dwLowDateTime);
+		metadata.file_id = make_uint64(info.nFileIndexHigh, info.nFileIndexLow);
+
+		return metadata;
+	}
+
 	bool create_directory(const std::string& directory)
 	{
 		return std::filesystem::create_directories(directory);
@@ -126,6 +243,77 @@ namespace utils::io
 		return files;
 	}
 
+	std::optional<directory_listing> read_directory(const std::string& directory)
+	{
+		auto* const handle = CreateFileA(directory.data(), FILE_LIST_DIRECTORY,
+		                                 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+		                                 OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			return {};
+		}
+
+		directory_listing listing{};
+		listing.system_calls = 2; // Opening and closing the directory
+
+		// Every query fills the buffer with as many entries as fit
+		std::vector<uint64_t> buffer(64 * 1024 / sizeof(uint64_t));
+		auto info_class = FileIdBothDirectoryRestartInfo;
+
+		while (true)
+		{
+			++listing.system_calls;
+			if (!GetFileInformationByHandleEx(handle, info_class, buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(uint64_t))))
+			{
+				if (GetLastError() == ERROR_NO_MORE_FILES)
+				{
+					break;
+				}
+
+				CloseHandle(handle);
+				return {};
+			}
+
+			info_class = FileIdBothDirectoryInfo;
+
+			const auto* data = reinterpret_cast<const uint8_t*>(buffer.data());
+			while (true)
+			{
+				const auto* info = reinterpret_cast<const FILE_ID_BOTH_DIR_INFO*>(data);
+				const auto name_length = static_cast<int>(info->FileNameLength / sizeof(wchar_t));
+				const std::wstring_view name{info->FileName, static_cast<size_t>(name_length)};
+
+				// Entries that can not be named without loss are left out instead of mangled
+				auto converted_name = name != L"." && name != L".." ? to_ansi_name(name) : std::nullopt;
+				if (converted_name)
+				{
+					directory_entry entry{};
+					entry.name = std::move(*converted_name);
+
+					entry.is_directory = (info->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+					entry.is_reparse_point = (info->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+
+					// Same values get_file_metadata reads through the file handle
+					entry.metadata.size = static_cast<uint64_t>(info->EndOfFile.QuadPart);
+					entry.metadata.last_write_time = static_cast<uint64_t>(info->LastWriteTime.QuadPart);
+					entry.metadata.file_id = static_cast<uint64_t>(info->FileId.QuadPart);
+
+					listing.entries.emplace_back(std::move(entry));
+				}
+
+				if (!info->NextEntryOffset)
+				{
+					break;
+				}
+
+				data += info->NextEntryOffset;
+			}
+		}
+
+		CloseHandle(handle);
+		return {std::move(listing)};
+	}
+
 	void copy_folder(const std::filesystem::path& src, const std::filesystem::path& target)
 	{
 		std::filesystem::copy(src, target,
@@ -3,19 +3,69 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <optional>
 
 namespace utils::io
 {
+	struct file_metadata
+	{
+		uint64_t size;
+		uint64_t last_write_time;
+		uint64_t file_id;
+
+		bool operator==(const file_metadata&) const = default;
+	};
+
+	struct directory_entry
+	{
+		std::string name;
+		file_metadata metadata;
+		bool is_directory;
+		bool is_reparse_point;
+	};
+
+	struct directory_listing
+	{
+		std::vector<directory_entry> entries;
+		size_t system_calls;
+	};
+
+	class mapped_file final
+	{
+	public:
+		explicit mapped_file(const std::string& file);
+		~mapped_file();
+
+		mapped_file(mapped_file&&) = delete;
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(mapped_file&&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		bool is_valid() const;
+		const uint8_t* data() const;
+		size_t size() const;
+
+	private:
+		void* file_handle_{};
+		void* mapping_handle_{};
+		const uint8_t* view_{};
+		size_t size_{};
+	};
+
 	bool remove_file(const std::string& file);
-	bool move_file(const std::string& src, const std::string& target);
+	bool move_file(const std::string& src, const std::string& target, bool overwrite = false);
 	bool file_exists(const std::string& file);
 	bool write_file(const std::string& file, const std::string& data, bool append = false);
 	bool read_file(const std::string& file, std::string* data);
 	std::string read_file(const std::string& file);
 	size_t file_size(const std::string& file);
+	std::optional<file_metadata> get_file_metadata(const std::string& file);
 	bool create_directory(const std::string& directory);
 	bool directory_exists(const std::string& directory);
 	bool directory_is_empty(const std::string& directory);
 	std::vector<std::string> list_files(const std::string& directory, bool recursive = false);
+
+	// Reads names and metadata of all entries in one directory, without opening any of them
+	std::optional<directory_listing> read_directory(const std::string& directory);
 	void copy_folder(const std::filesystem::path& src, const std::filesystem::path& target);
 }
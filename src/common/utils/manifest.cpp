@@ -0,0 +1,280 @@
+#include "manifest.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace utils::manifest
+{
+	namespace
+	{
+		constexpr uint32_t manifest_magic = 0x31464D58; // XMF1
+		// Version 2 adds the compressed size and patch tables, images without either are still written
+		// as version 1 so older clients keep reading them
+		constexpr uint32_t manifest_version = 1;
+		constexpr uint32_t extended_manifest_version = 2;
+
+		// The image is the header, followed by the entries, one compressed size per entry (version 2 only), the chunk
+		// hash table, the patch table and the string table. Every entry has a fixed size, so the image can be mapped
+		// and queried in place.
+		struct manifest_header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t entry_count;
+			uint32_t chunk_count;
+			uint32_t string_table_size;
+			uint32_t patch_count;
+		};
+
+		struct manifest_entry
+		{
+			uint64_t size;
+			uint64_t chunk_size;
+			uint32_t name_offset;
+			uint32_t name_length;
+			uint32_t first_chunk;
+			uint32_t chunk_count;
+			uint8_t hash[hash_size];
+			uint32_t first_patch; // Patches of an entry run up to the first patch of the next one
+		};
+
+		struct manifest_patch
+		{
+			uint8_t source_hash[hash_size];
+			uint32_t reserved;
+			uint64_t size;
+		};
+
+		static_assert(sizeof(manifest_header) == 24);
+		static_assert(sizeof(manifest_entry) == 56);
+		static_assert(sizeof(manifest_patch) == 32);
+
+		const manifest_entry& get_entry(const uint8_t* entries, const size_t index)
+		{
+			return reinterpret_cast<const manifest_entry*>(entries)[index];
+		}
+
+		std::string_view get_name(const manifest_entry& entry, const char* strings)
+		{
+			return {strings + entry.name_offset, entry.name_length};
+		}
+	}
+
+	std::optional<binary_manifest> binary_manifest::parse(const void* data, const size_t size)
+	{
+		if (size < sizeof(manifest_header))
+		{
+			return {};
+		}
+
+		const auto* bytes = static_cast<const uint8_t*>(data);
+		const auto& header = *reinterpret_cast<const manifest_header*>(bytes);
+
+		if (header.magic != manifest_magic || (header.version != manifest_version && header.version != extended_manifest_version)
+			|| (header.version == manifest_version && header.patch_count != 0))
+		{
+			return {};
+		}
+
+		const auto entries_size = static_cast<uint64_t>(header.entry_count) * sizeof(manifest_entry);
+		const auto compressed_sizes_size = header.version == extended_manifest_version
+			                                   ? static_cast<uint64_t>(header.entry_count) * sizeof(uint64_t)
+			                                   : 0;
+		const auto chunks_size = static_cast<uint64_t>(header.chunk_count) * hash_size;
+		const auto patches_size = static_cast<uint64_t>(header.patch_count) * sizeof(manifest_patch);
+
+		if (sizeof(manifest_header) + entries_size + compressed_sizes_size + chunks_size + patches_size
+			+ header.string_table_size != size)
+		{
+			return {};
+		}
+
+		binary_manifest manifest{};
+		manifest.entries_ = bytes + sizeof(manifest_header);
+		manifest.compressed_sizes_ = compressed_sizes_size
+			                             ? reinterpret_cast<const uint64_t*>(manifest.entries_ + entries_size)
+			                             : nullptr;
+		manifest.chunk_hashes_ = manifest.entries_ + entries_size + compressed_sizes_size;
+		manifest.patches_ = manifest.chunk_hashes_ + chunks_size;
+		manifest.strings_ = reinterpret_cast<const char*>(manifest.patches_ + patches_size);
+		manifest.entry_count_ = header.entry_count;
+		manifest.patch_count_ = header.patch_count;
+
+		// Everything is validated once, so lookups do not need any checks
+		for (size_t i = 0; i < manifest.entry_count_; ++i)
+		{
+			const auto& entry = get_entry(manifest.entries_, i);
+
+			if (static_cast<uint64_t>(entry.name_offset) + entry.name_length > header.string_table_size
+				|| static_cast<uint64_t>(entry.first_chunk) + entry.chunk_count > header.chunk_count
+				|| entry.first_patch > header.patch_count)
+			{
+				return {};
+			}
+
+			if (i > 0 && get_entry(manifest.entries_, i - 1).first_patch > entry.first_patch)
+			{
+				return {};
+			}
+
+			if (i > 0 && get_name(get_entry(manifest.entries_, i - 1), manifest.strings_) >= get_name(entry, manifest.strings_))
+			{
+				return {};
+			}
+		}
+
+		return {manifest};
+	}
+
+	size_t binary_manifest::size() const
+	{
+		return this->entry_count_;
+	}
+
+	entry_view binary_manifest::get(const size_t index) const
+	{
+		const auto& entry = get_entry(this->entries_, index);
+
+		entry_view view{};
+		view.name = get_name(entry, this->strings_);
+		view.size = entry.size;
+		view.hash = entry.hash;
+		view.chunk_size = entry.chunk_size;
+		view.chunk_count = entry.chunk_count;
+		view.chunk_hashes = this->chunk_hashes_ + static_cast<size_t>(entry.first_chunk) * hash_size;
+
+		const auto end_patch = index + 1 < this->entry_count_
+			                       ? get_entry(this->entries_, index + 1).first_patch
+			                       : static_cast<uint32_t>(this->patch_count_);
+		view.patch_count = end_patch - entry.first_patch;
+		view.patches = this->patches_ + static_cast<size_t>(entry.first_patch) * sizeof(manifest_patch);
+		view.compressed_size = this->compressed_sizes_ ? this->compressed_sizes_[index] : 0;
+
+		return view;
+	}
+
+	patch entry_view::get_patch(const size_t index) const
+	{
+		// The table follows the chunk hashes, so records are not necessarily aligned
+		manifest_patch record{};
+		std::memcpy(&record, this->patches + index * sizeof(manifest_patch), sizeof(record));
+
+		patch result{};
+		result.source_hash = cryptography::sha1::digest{record.source_hash};
+		result.size = record.size;
+
+		return result;
+	}
+
+	std::optional<entry_view> binary_manifest::find(const std::string_view name) const
+	{
+		size_t low = 0;
+		size_t high = this->entry_count_;
+
+		while (low < high)
+		{
+			const auto middle = low + (high - low) / 2;
+			const auto current = get_name(get_entry(this->entries_, middle), this->strings_);
+
+			if (current == name)
+			{
+				return {this->get(middle)};
+			}
+
+			if (current < name)
+			{
+				low = middle + 1;
+			}
+			else
+			{
+				high = middle;
+			}
+		}
+
+		return {};
+	}
+
+	std::string write_binary_manifest(std::vector<entry> entries)
+	{
+		std::sort(entries.begin(), entries.end(), [](const entry& a, const entry& b)
+		{
+			return a.name < b.name;
+		});
+
+		std::string chunk_table{};
+		std::string patch_table{};
+		std::vector<uint64_t> compressed_sizes{};
+		std::string string_table{};
+		std::vector<manifest_entry> records{};
+		records.reserve(entries.size());
+
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			const auto& current = entries[i];
+
+			if (i > 0 && entries[i - 1].name == current.name)
+			{
+				throw std::runtime_error("Duplicate manifest entry: " + current.name);
+			}
+
+			manifest_entry record{};
+			record.size = current.size;
+			record.chunk_size = current.chunk_size;
+			record.name_offset = static_cast<uint32_t>(string_table.size());
+			record.name_length = static_cast<uint32_t>(current.name.size());
+			record.first_chunk = static_cast<uint32_t>(chunk_table.size() / hash_size);
+			record.chunk_count = static_cast<uint32_t>(current.chunk_hashes.size());
+			record.first_patch = static_cast<uint32_t>(patch_table.size() / sizeof(manifest_patch));
+			std::memcpy(record.hash, current.hash.data(), hash_size);
+
+			for (const auto& chunk_hash : current.chunk_hashes)
+			{
+				chunk_table.append(chunk_hash.view());
+			}
+
+			for (const auto& current_patch : current.patches)
+			{
+				manifest_patch patch_record{};
+				std::memcpy(patch_record.source_hash, current_patch.source_hash.data(), hash_size);
+				patch_record.size = current_patch.size;
+
+				patch_table.append(reinterpret_cast<const char*>(&patch_record), sizeof(patch_record));
+			}
+
+			string_table.append(current.name);
+			records.emplace_back(record);
+			compressed_sizes.emplace_back(current.compressed_size);
+		}
+
+		manifest_header header{};
+		header.magic = manifest_magic;
+		const auto has_compressed_sizes = std::any_of(compressed_sizes.begin(), compressed_sizes.end(), [](const uint64_t size)
+		{
+			return size != 0;
+		});
+
+		if (!has_compressed_sizes && patch_table.empty())
+		{
+			compressed_sizes.clear();
+		}
+
+		header.version = compressed_sizes.empty() ? manifest_version : extended_manifest_version;
+		header.entry_count = static_cast<uint32_t>(records.size());
+		header.chunk_count = static_cast<uint32_t>(chunk_table.size() / hash_size);
+		header.string_table_size = static_cast<uint32_t>(string_table.size());
+		header.patch_count = static_cast<uint32_t>(patch_table.size() / sizeof(manifest_patch));
+
+		std::string data{};
+		data.reserve(sizeof(header) + records.size() * sizeof(manifest_entry) + compressed_sizes.size() * sizeof(uint64_t)
+			+ chunk_table.size() + patch_table.size() + string_table.size());
+		data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+		data.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(manifest_entry));
+		data.append(reinterpret_cast<const char*>(compressed_sizes.data()), compressed_sizes.size() * sizeof(uint64_t));
+		data.append(chunk_table);
+		data.append(patch_table);
+		data.append(string_table);
+
+		return data;
+	}
+}
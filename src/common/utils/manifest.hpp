@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+#include "cryptography.hpp"
+
+namespace utils::manifest
+{
+	// Requested through the Accept header, servers that do not know it keep sending files.json
+	constexpr auto binary_content_type = "application/vnd.xlabs.manifest";
+	constexpr size_t hash_size = cryptography::sha1::digest_size;
+
+	// Entries with a compressed size are also published gzip compressed as <directory><name><extension>
+	constexpr auto compressed_directory = ".compressed/";
+	constexpr auto compressed_extension = ".gz";
+
+	// Binary patch from an older version of the file, the target is always the version in the manifest
+	struct patch
+	{
+		cryptography::sha1::digest source_hash{};
+		uint64_t size{};
+	};
+
+	struct entry_view
+	{
+		std::string_view name;
+		uint64_t size;
+		const uint8_t* hash;
+		uint64_t chunk_size;
+		uint32_t chunk_count;
+		const uint8_t* chunk_hashes; // chunk_count consecutive hashes
+		uint32_t patch_count;
+		const uint8_t* patches;
+		uint64_t compressed_size; // 0 if there is no compressed variant
+
+		patch get_patch(size_t index) const;
+	};
+
+	// Read-only view of a binary manifest image, entries are read in place and nothing is allocated.
+	// The image has to outlive the view.
+	class binary_manifest
+	{
+	public:
+		static std::optional<binary_manifest> parse(const void* data, size_t size);
+
+		size_t size() const;
+		entry_view get(size_t index) const;
+
+		// Entries are sorted by name, so lookups are a binary search
+		std::optional<entry_view> find(std::string_view name) const;
+
+	private:
+		binary_manifest() = default;
+
+		const uint8_t* entries_{};
+		const uint64_t* compressed_sizes_{};
+		const uint8_t* chunk_hashes_{};
+		const uint8_t* patches_{};
+		const char* strings_{};
+		size_t entry_count_{};
+		size_t patch_count_{};
+	};
+
+	struct entry
+	{
+		std::string name{};
+		uint64_t size{};
+		cryptography::sha1::digest hash{};
+		uint64_t chunk_size{};
+		std::vector<cryptography::sha1::digest> chunk_hashes{};
+		std::vector<patch> patches{};
+		uint64_t compressed_size{};
+	};
+
+	std::string write_binary_manifest(std::vector<entry> entries);
+}
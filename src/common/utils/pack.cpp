@@ -0,0 +1,155 @@
+#include "pack.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace utils::pack
+{
+	namespace
+	{
+		constexpr uint32_t index_magic = 0x314B5058; // XPK1
+		constexpr uint32_t index_version = 1;
+
+		// The index is the header, followed by the pack records and the member records
+		struct index_header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t pack_count;
+			uint32_t member_count;
+		};
+
+		struct pack_record
+		{
+			uint8_t hash[cryptography::sha1::digest_size];
+			uint32_t reserved;
+			uint64_t size;
+		};
+
+		struct member_record
+		{
+			uint8_t hash[cryptography::sha1::digest_size];
+			uint32_t pack;
+			uint32_t length;
+			uint32_t reserved;
+			uint64_t offset;
+		};
+
+		static_assert(sizeof(index_header) == 16);
+		static_assert(sizeof(pack_record) == 32);
+		static_assert(sizeof(member_record) == 40);
+	}
+
+	const member* index::find(const cryptography::sha1::digest& hash) const
+	{
+		const auto entry = std::lower_bound(this->members.begin(), this->members.end(), hash, [](const member& a, const cryptography::sha1::digest& b)
+		{
+			return a.hash < b;
+		});
+
+		return entry != this->members.end() && entry->hash == hash ? &*entry : nullptr;
+	}
+
+	std::string get_name(const cryptography::sha1::digest& pack_hash)
+	{
+		return pack_hash.to_hex() + extension;
+	}
+
+	std::string write_index(index index)
+	{
+		std::sort(index.members.begin(), index.members.end(), [](const member& a, const member& b)
+		{
+			return a.hash < b.hash;
+		});
+
+		index_header header{};
+		header.magic = index_magic;
+		header.version = index_version;
+		header.pack_count = static_cast<uint32_t>(index.packs.size());
+		header.member_count = static_cast<uint32_t>(index.members.size());
+
+		std::string data{};
+		data.reserve(sizeof(header) + index.packs.size() * sizeof(pack_record) + index.members.size() * sizeof(member_record));
+		data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (const auto& current : index.packs)
+		{
+			pack_record record{};
+			std::memcpy(record.hash, current.hash.data(), sizeof(record.hash));
+			record.size = current.size;
+
+			data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+		}
+
+		for (const auto& current : index.members)
+		{
+			member_record record{};
+			std::memcpy(record.hash, current.hash.data(), sizeof(record.hash));
+			record.pack = current.pack;
+			record.length = current.length;
+			record.offset = current.offset;
+
+			data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+		}
+
+		return data;
+	}
+
+	std::optional<index> parse_index(const void* data, const size_t size)
+	{
+		if (size < sizeof(index_header))
+		{
+			return {};
+		}
+
+		const auto* bytes = static_cast<const uint8_t*>(data);
+
+		index_header header{};
+		std::memcpy(&header, bytes, sizeof(header));
+
+		if (header.magic != index_magic || header.version != index_version
+			|| size != sizeof(header) + static_cast<uint64_t>(header.pack_count) * sizeof(pack_record)
+			+ static_cast<uint64_t>(header.member_count) * sizeof(member_record))
+		{
+			return {};
+		}
+
+		index result{};
+		result.packs.reserve(header.pack_count);
+		result.members.reserve(header.member_count);
+
+		const auto* records = bytes + sizeof(header);
+		for (size_t i = 0; i < header.pack_count; ++i)
+		{
+			pack_record record{};
+			std::memcpy(&record, records + i * sizeof(record), sizeof(record));
+
+			result.packs.push_back({cryptography::sha1::digest{record.hash}, record.size});
+		}
+
+		records += static_cast<size_t>(header.pack_count) * sizeof(pack_record);
+		for (size_t i = 0; i < header.member_count; ++i)
+		{
+			member_record record{};
+			std::memcpy(&record, records + i * sizeof(record), sizeof(record));
+
+			member current{};
+			current.hash = cryptography::sha1::digest{record.hash};
+			current.pack = record.pack;
+			current.length = record.length;
+			current.offset = record.offset;
+
+			// Members have to lie inside their pack and be sorted, so lookups can be a binary search
+			if (current.pack >= result.packs.size() || current.length == 0 || current.length > max_member_size
+				|| current.length > result.packs[current.pack].size || current.offset > result.packs[current.pack].size - current.length
+				|| (!result.members.empty() && !(result.members.back().hash < current.hash)))
+			{
+				return {};
+			}
+
+			result.members.emplace_back(current);
+		}
+
+		return {std::move(result)};
+	}
+}
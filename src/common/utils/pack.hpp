@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+#include "cryptography.hpp"
+
+namespace utils::pack
+{
+	// Small files are also published concatenated into packs below this folder, together with an index
+	// that locates every member by its hash. Many outdated small files then cost a few range requests.
+	constexpr auto directory = ".packs/";
+	constexpr auto index_name = "index.bin";
+	constexpr auto extension = ".pack";
+
+	constexpr size_t max_member_size = 256 * 1024;
+	constexpr size_t max_pack_size = 16 * 1024 * 1024;
+
+	struct pack
+	{
+		cryptography::sha1::digest hash;
+		uint64_t size;
+	};
+
+	struct member
+	{
+		cryptography::sha1::digest hash;
+		uint32_t pack;
+		uint32_t length;
+		uint64_t offset;
+	};
+
+	struct index
+	{
+		std::vector<pack> packs{};
+		std::vector<member> members{}; // Sorted by hash
+
+		const member* find(const cryptography::sha1::digest& hash) const;
+	};
+
+	// Packs are named after their content, so an outdated index can never point into a different pack
+	std::string get_name(const cryptography::sha1::digest& pack_hash);
+
+	std::string write_index(index index);
+	std::optional<index> parse_index(const void* data, size_t size);
+}
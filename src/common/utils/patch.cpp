@@ -0,0 +1,725 @@
+#include "patch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <zlib.h>
+
+namespace utils::patch
+{
+	namespace
+	{
+		constexpr uint32_t patch_magic = 0x31545058; // XPT1
+
+		// The header is followed by the compressed control, diff and extra streams.
+		// Every control entry copies diff bytes added onto the old file, then extra bytes, then seeks in the old file.
+		struct patch_header
+		{
+			uint32_t magic;
+			uint32_t reserved;
+			uint64_t old_size;
+			uint64_t new_size;
+			uint64_t stream_sizes[3];
+			uint64_t compressed_sizes[3];
+		};
+
+		struct control_entry
+		{
+			int64_t diff_length;
+			int64_t extra_length;
+			int64_t seek;
+		};
+
+		static_assert(sizeof(patch_header) == 72);
+		static_assert(sizeof(control_entry) == 24);
+
+		// Suffix sorting needs 8 bytes per input byte with 32 bit indices
+		constexpr size_t max_old_size = 0x7FFFFFFE;
+
+		// Positions in the old file are tracked as signed offsets, larger files could overflow them
+		constexpr uint64_t max_apply_size = std::numeric_limits<int64_t>::max() / 4;
+
+		std::string compress(const std::string_view data)
+		{
+			auto size = compressBound(static_cast<uLong>(data.size()));
+
+			std::string result{};
+			result.resize(size);
+
+			if (compress2(reinterpret_cast<Bytef*>(result.data()), &size, reinterpret_cast<const Bytef*>(data.data()),
+			              static_cast<uLong>(data.size()), Z_BEST_COMPRESSION) != Z_OK)
+			{
+				throw std::runtime_error("Failed to compress patch");
+			}
+
+			result.resize(size);
+			return result;
+		}
+
+		// Inflates one stream of a patch on demand, the streams are consumed front to back, so none of them
+		// has to be held in memory. Sizes come from the patch and are only trusted as far as the data reaches.
+		class stream_reader
+		{
+		public:
+			stream_reader(const std::string_view data, const uint64_t size)
+				: remaining_(size)
+			{
+				this->stream_.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(data.data()));
+				this->stream_.avail_in = static_cast<uInt>(data.size());
+				this->valid_ = data.size() <= UINT32_MAX && inflateInit(&this->stream_) == Z_OK;
+			}
+
+			~stream_reader()
+			{
+				if (this->valid_)
+				{
+					inflateEnd(&this->stream_);
+				}
+			}
+
+			stream_reader(stream_reader&&) = delete;
+			stream_reader(const stream_reader&) = delete;
+			stream_reader& operator=(stream_reader&&) = delete;
+			stream_reader& operator=(const stream_reader&) = delete;
+
+			bool read(void* buffer, const size_t length)
+			{
+				if (!this->valid_ || length > this->remaining_)
+				{
+					return false;
+				}
+
+				this->stream_.next_out = static_cast<Bytef*>(buffer);
+				this->stream_.avail_out = static_cast<uInt>(length);
+
+				while (this->stream_.avail_out > 0)
+				{
+					// Running out of input ends in Z_BUF_ERROR, the stream is shorter than it claims
+					const auto result = inflate(&this->stream_, Z_NO_FLUSH);
+					if (result != Z_OK && (result != Z_STREAM_END || this->stream_.avail_out > 0))
+					{
+						return false;
+					}
+				}
+
+				this->remaining_ -= length;
+				return true;
+			}
+
+			uint64_t get_remaining() const
+			{
+				return this->remaining_;
+			}
+
+			// Every byte has to be consumed and the stream has to end there, which also checks its checksum
+			bool is_complete()
+			{
+				if (!this->valid_ || this->remaining_ > 0)
+				{
+					return false;
+				}
+
+				uint8_t byte{};
+				this->stream_.next_out = &byte;
+				this->stream_.avail_out = 1;
+
+				return inflate(&this->stream_, Z_NO_FLUSH) == Z_STREAM_END && this->stream_.avail_out == 1;
+			}
+
+		private:
+			z_stream stream_{};
+			uint64_t remaining_;
+			bool valid_{false};
+		};
+
+		// Larsson and Sadakane's suffix sorting, as used by bsdiff
+		class suffix_sorter
+		{
+		public:
+			suffix_sorter(const uint8_t* data, const int32_t size)
+				: indices_(static_cast<size_t>(size) + 1)
+				, groups_(static_cast<size_t>(size) + 1)
+			{
+				int32_t buckets[256]{};
+
+				for (int32_t i = 0; i < size; ++i)
+				{
+					++buckets[data[i]];
+				}
+
+				for (int32_t i = 1; i < 256; ++i)
+				{
+					buckets[i] += buckets[i - 1];
+				}
+
+				for (int32_t i = 255; i > 0; --i)
+				{
+					buckets[i] = buckets[i - 1];
+				}
+
+				buckets[0] = 0;
+
+				for (int32_t i = 0; i < size; ++i)
+				{
+					this->indices_[++buckets[data[i]]] = i;
+				}
+
+				this->indices_[0] = size;
+
+				for (int32_t i = 0; i < size; ++i)
+				{
+					this->groups_[i] = buckets[data[i]];
+				}
+
+				this->groups_[size] = 0;
+
+				for (int32_t i = 1; i < 256; ++i)
+				{
+					if (buckets[i] == buckets[i - 1] + 1)
+					{
+						this->indices_[buckets[i]] = -1;
+					}
+				}
+
+				this->indices_[0] = -1;
+
+				for (int32_t h = 1; this->indices_[0] != -(size + 1); h += h)
+				{
+					int32_t length = 0;
+					int32_t i = 0;
+
+					while (i < size + 1)
+					{
+						if (this->indices_[i] < 0)
+						{
+							length -= this->indices_[i];
+							i -= this->indices_[i];
+						}
+						else
+						{
+							if (length)
+							{
+								this->indices_[i - length] = -length;
+							}
+
+							length = this->groups_[this->indices_[i]] + 1 - i;
+							this->split(i, length, h);
+							i += length;
+							length = 0;
+						}
+					}
+
+					if (length)
+					{
+						this->indices_[i - length] = -length;
+					}
+				}
+
+				for (int32_t i = 0; i < size + 1; ++i)
+				{
+					this->indices_[this->groups_[i]] = i;
+				}
+
+				this->groups_.clear();
+				this->groups_.shrink_to_fit();
+			}
+
+			const std::vector<int32_t>& get_indices() const
+			{
+				return this->indices_;
+			}
+
+		private:
+			std::vector<int32_t> indices_;
+			std::vector<int32_t> groups_;
+
+			int32_t key(const int32_t index, const int32_t h) const
+			{
+				return this->groups_[this->indices_[index] + h];
+			}
+
+			void split(const int32_t start, const int32_t length, const int32_t h)
+			{
+				if (length < 16)
+				{
+					for (auto k = start; k < start + length;)
+					{
+						auto j = 1;
+						auto x = this->key(k, h);
+
+						for (auto i = 1; k + i < start + length; ++i)
+						{
+							const auto value = this->key(k + i, h);
+							if (value < x)
+							{
+								x = value;
+								j = 0;
+							}
+
+							if (value == x)
+							{
+								std::swap(this->indices_[k + j], this->indices_[k + i]);
+								++j;
+							}
+						}
+
+						for (auto i = 0; i < j; ++i)
+						{
+							this->groups_[this->indices_[k + i]] = k + j - 1;
+						}
+
+						if (j == 1)
+						{
+							this->indices_[k] = -1;
+						}
+
+						k += j;
+					}
+
+					return;
+				}
+
+				const auto x = this->key(start + length / 2, h);
+				auto jj = 0;
+				auto kk = 0;
+
+				for (auto i = start; i < start + length; ++i)
+				{
+					const auto value = this->key(i, h);
+					if (value < x)
+					{
+						++jj;
+					}
+					else if (value == x)
+					{
+						++kk;
+					}
+				}
+
+				jj += start;
+				kk += jj;
+
+				auto i = start;
+				auto j = 0;
+				auto k = 0;
+
+				while (i < jj)
+				{
+					const auto value = this->key(i, h);
+					if (value < x)
+					{
+						++i;
+					}
+					else if (value == x)
+					{
+						std::swap(this->indices_[i], this->indices_[jj + j]);
+						++j;
+					}
+					else
+					{
+						std::swap(this->indices_[i], this->indices_[kk + k]);
+						++k;
+					}
+				}
+
+				while (jj + j < kk)
+				{
+					if (this->key(jj + j, h) == x)
+					{
+						++j;
+					}
+					else
+					{
+						std::swap(this->indices_[jj + j], this->indices_[kk + k]);
+						++k;
+					}
+				}
+
+				if (jj > start)
+				{
+					this->split(start, jj - start, h);
+				}
+
+				for (i = 0; i < kk - jj; ++i)
+				{
+					this->groups_[this->indices_[jj + i]] = kk - 1;
+				}
+
+				if (jj == kk - 1)
+				{
+					this->indices_[jj] = -1;
+				}
+
+				if (start + length > kk)
+				{
+					this->split(kk, start + length - kk, h);
+				}
+			}
+		};
+
+		size_t get_match_length(const std::string_view a, const std::string_view b)
+		{
+			const auto length = std::min(a.size(), b.size());
+
+			size_t i = 0;
+			while (i < length && a[i] == b[i])
+			{
+				++i;
+			}
+
+			return i;
+		}
+
+		// Binary search over the sorted suffixes of the old data for the longest match of the given data
+		size_t search(const std::vector<int32_t>& indices, const std::string_view old_data, const std::string_view data,
+		              size_t start, size_t end, size_t& position)
+		{
+			while (end - start >= 2)
+			{
+				const auto middle = start + (end - start) / 2;
+				const auto suffix = old_data.substr(static_cast<size_t>(indices[middle]));
+
+				const auto length = std::min(suffix.size(), data.size());
+				if (std::memcmp(suffix.data(), data.data(), length) < 0)
+				{
+					start = middle;
+				}
+				else
+				{
+					end = middle;
+				}
+			}
+
+			const auto start_length = get_match_length(old_data.substr(static_cast<size_t>(indices[start])), data);
+			const auto end_length = get_match_length(old_data.substr(static_cast<size_t>(indices[end])), data);
+
+			if (start_length > end_length)
+			{
+				position = static_cast<size_t>(indices[start]);
+				return start_length;
+			}
+
+			position = static_cast<size_t>(indices[end]);
+			return end_length;
+		}
+
+		void append(std::string& stream, const void* data, const size_t length)
+		{
+			stream.append(static_cast<const char*>(data), length);
+		}
+	}
+
+	std::string get_name(const cryptography::sha1::digest& source_hash, const cryptography::sha1::digest& target_hash)
+	{
+		return source_hash.to_hex() + "-" + target_hash.to_hex() + ".xpatch";
+	}
+
+	std::string create(const std::string_view old_data, const std::string_view new_data)
+	{
+		if (old_data.size() > max_old_size)
+		{
+			throw std::runtime_error("File is too large to be patched");
+		}
+
+		const suffix_sorter sorter{reinterpret_cast<const uint8_t*>(old_data.data()), static_cast<int32_t>(old_data.size())};
+		const auto& indices = sorter.get_indices();
+
+		std::string control{};
+		std::string diff{};
+		std::string extra{};
+
+		const auto old_size = static_cast<int64_t>(old_data.size());
+		const auto new_size = static_cast<int64_t>(new_data.size());
+
+		int64_t scan = 0;
+		int64_t length = 0;
+		int64_t position = 0;
+		int64_t last_scan = 0;
+		int64_t last_position = 0;
+		int64_t last_offset = 0;
+
+		// Greedily looks for matches that differ from the old data at the previous offset in more than 8 bytes,
+		// everything in between becomes diff bytes at the previous offset
+		while (scan < new_size)
+		{
+			int64_t old_score = 0;
+
+			for (auto scan_start = scan += length; scan < new_size; ++scan)
+			{
+				size_t match_position{};
+				length = static_cast<int64_t>(search(indices, old_data, new_data.substr(static_cast<size_t>(scan)), 0,
+				                                     old_data.size(), match_position));
+				position = static_cast<int64_t>(match_position);
+
+				for (; scan_start < scan + length; ++scan_start)
+				{
+					if (scan_start + last_offset < old_size && old_data[scan_start + last_offset] == new_data[scan_start])
+					{
+						++old_score;
+					}
+				}
+
+				if ((length == old_score && length != 0) || length > old_score + 8)
+				{
+					break;
+				}
+
+				if (scan + last_offset < old_size && old_data[scan + last_offset] == new_data[scan])
+				{
+					--old_score;
+				}
+			}
+
+			if (length == old_score && scan != new_size)
+			{
+				continue;
+			}
+
+			// Extends the previous match forwards and the new one backwards as long as more than half of the bytes agree
+			int64_t forward_length = 0;
+			int64_t score = 0;
+			int64_t best_score = 0;
+
+			for (int64_t i = 0; last_scan + i < scan && last_position + i < old_size;)
+			{
+				if (old_data[last_position + i] == new_data[last_scan + i])
+				{
+					++score;
+				}
+
+				++i;
+				if (score * 2 - i > best_score * 2 - forward_length)
+				{
+					best_score = score;
+					forward_length = i;
+				}
+			}
+
+			int64_t backward_length = 0;
+			if (scan < new_size)
+			{
+				score = 0;
+				best_score = 0;
+
+				for (int64_t i = 1; scan >= last_scan + i && position >= i; ++i)
+				{
+					if (old_data[position - i] == new_data[scan - i])
+					{
+						++score;
+					}
+
+					if (score * 2 - i > best_score * 2 - backward_length)
+					{
+						best_score = score;
+						backward_length = i;
+					}
+				}
+			}
+
+			if (last_scan + forward_length > scan - backward_length)
+			{
+				const auto overlap = (last_scan + forward_length) - (scan - backward_length);
+
+				score = 0;
+				best_score = 0;
+				int64_t best_overlap = 0;
+
+				for (int64_t i = 0; i < overlap; ++i)
+				{
+					if (new_data[last_scan + forward_length - overlap + i] == old_data[last_position + forward_length - overlap + i])
+					{
+						++score;
+					}
+
+					if (new_data[scan - backward_length + i] == old_data[position - backward_length + i])
+					{
+						--score;
+					}
+
+					if (score > best_score)
+					{
+						best_score = score;
+						best_overlap = i + 1;
+					}
+				}
+
+				forward_length += best_overlap - overlap;
+				backward_length -= best_overlap;
+			}
+
+			for (int64_t i = 0; i < forward_length; ++i)
+			{
+				diff.push_back(static_cast<char>(new_data[last_scan + i] - old_data[last_position + i]));
+			}
+
+			const auto extra_length = (scan - backward_length) - (last_scan + forward_length);
+			extra.append(new_data.substr(static_cast<size_t>(last_scan + forward_length), static_cast<size_t>(extra_length)));
+
+			const control_entry entry{forward_length, extra_length, (position - backward_length) - (last_position + forward_length)};
+			append(control, &entry, sizeof(entry));
+
+			last_scan = scan - backward_length;
+			last_position = position - backward_length;
+			last_offset = position - scan;
+		}
+
+		patch_header header{};
+		header.magic = patch_magic;
+		header.old_size = old_data.size();
+		header.new_size = new_data.size();
+
+		const std::string* streams[] = {&control, &diff, &extra};
+		std::string compressed[3]{};
+
+		for (size_t i = 0; i < 3; ++i)
+		{
+			compressed[i] = compress(*streams[i]);
+			header.stream_sizes[i] = streams[i]->size();
+			header.compressed_sizes[i] = compressed[i].size();
+		}
+
+		std::string result{};
+		append(result, &header, sizeof(header));
+
+		for (const auto& stream : compressed)
+		{
+			result.append(stream);
+		}
+
+		return result;
+	}
+
+	bool apply(const std::string_view old_data, const std::string_view patch, const uint64_t expected_size,
+	           const std::function<void(const void*, size_t)>& output)
+	{
+		if (patch.size() < sizeof(patch_header))
+		{
+			return false;
+		}
+
+		patch_header header{};
+		std::memcpy(&header, patch.data(), sizeof(header));
+
+		if (header.magic != patch_magic || header.old_size != old_data.size() || header.new_size != expected_size
+			|| old_data.size() > max_apply_size || expected_size > max_apply_size || header.stream_sizes[0] % sizeof(control_entry) != 0)
+		{
+			return false;
+		}
+
+		std::string_view compressed_streams[3]{};
+		size_t offset = sizeof(header);
+
+		for (size_t i = 0; i < 3; ++i)
+		{
+			if (header.compressed_sizes[i] > patch.size() - offset)
+			{
+				return false;
+			}
+
+			compressed_streams[i] = patch.substr(offset, static_cast<size_t>(header.compressed_sizes[i]));
+			offset += static_cast<size_t>(header.compressed_sizes[i]);
+		}
+
+		stream_reader control{compressed_streams[0], header.stream_sizes[0]};
+		stream_reader diff{compressed_streams[1], header.stream_sizes[1]};
+		stream_reader extra{compressed_streams[2], header.stream_sizes[2]};
+
+		constexpr size_t buffer_size = 0x10000;
+		const auto buffer = std::make_unique<char[]>(buffer_size);
+
+		uint64_t new_position = 0;
+		int64_t old_position = 0;
+
+		while (control.get_remaining() > 0)
+		{
+			control_entry entry{};
+			if (!control.read(&entry, sizeof(entry)))
+			{
+				return false;
+			}
+
+			if (entry.diff_length < 0 || entry.extra_length < 0
+				|| static_cast<uint64_t>(entry.diff_length) > expected_size - new_position)
+			{
+				return false;
+			}
+
+			for (int64_t done = 0; done < entry.diff_length;)
+			{
+				const auto count = static_cast<size_t>(std::min<int64_t>(entry.diff_length - done, buffer_size));
+				if (!diff.read(buffer.get(), count))
+				{
+					return false;
+				}
+
+				// Bytes outside of the old file only come from the diff
+				for (size_t j = 0; j < count; ++j)
+				{
+					const auto source = old_position + done + static_cast<int64_t>(j);
+					if (source >= 0 && static_cast<uint64_t>(source) < old_data.size())
+					{
+						buffer[j] = static_cast<char>(buffer[j] + old_data[static_cast<size_t>(source)]);
+					}
+				}
+
+				output(buffer.get(), count);
+				done += static_cast<int64_t>(count);
+			}
+
+			new_position += static_cast<uint64_t>(entry.diff_length);
+			old_position += entry.diff_length;
+
+			if (static_cast<uint64_t>(entry.extra_length) > expected_size - new_position)
+			{
+				return false;
+			}
+
+			for (int64_t done = 0; done < entry.extra_length;)
+			{
+				const auto count = static_cast<size_t>(std::min<int64_t>(entry.extra_length - done, buffer_size));
+				if (!extra.read(buffer.get(), count))
+				{
+					return false;
+				}
+
+				output(buffer.get(), count);
+				done += static_cast<int64_t>(count);
+			}
+
+			new_position += static_cast<uint64_t>(entry.extra_length);
+
+			// Seeks never leave the old file by more than the size of the new one in valid patches
+			const auto min_position = -static_cast<int64_t>(expected_size);
+			const auto max_position = static_cast<int64_t>(old_data.size() + expected_size);
+			if (entry.seek < min_position - old_position || entry.seek > max_position - old_position)
+			{
+				return false;
+			}
+
+			old_position += entry.seek;
+		}
+
+		return new_position == expected_size && control.is_complete() && diff.is_complete() && extra.is_complete();
+	}
+
+	std::optional<std::string> apply(const std::string_view old_data, const std::string_view patch, const uint64_t expected_size)
+	{
+		std::string result{};
+		result.reserve(static_cast<size_t>(expected_size));
+
+		if (!apply(old_data, patch, expected_size, [&](const void* data, const size_t length)
+		{
+			result.append(static_cast<const char*>(data), length);
+		}))
+		{
+			return {};
+		}
+
+		return {std::move(result)};
+	}
+}
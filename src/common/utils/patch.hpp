@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <functional>
+#include <cstdint>
+
+#include "cryptography.hpp"
+
+namespace utils::patch
+{
+	// Patches are published in this directory next to the data files, named after the versions they connect
+	constexpr auto directory = ".patches/";
+
+	std::string get_name(const cryptography::sha1::digest& source_hash, const cryptography::sha1::digest& target_hash);
+
+	// bsdiff style patch, the bytes that moved are stored as differences to the old file,
+	// which compresses well for rebuilt executables where mostly addresses change
+	std::string create(std::string_view old_data, std::string_view new_data);
+
+	// Streams the new file through the output as it is produced. Corrupted patches and patches that do not
+	// produce a file of the expected size fail, the output may have received part of the file by then.
+	bool apply(std::string_view old_data, std::string_view patch, uint64_t expected_size,
+	           const std::function<void(const void*, size_t)>& output);
+	std::optional<std::string> apply(std::string_view old_data, std::string_view patch, uint64_t expected_size);
+}
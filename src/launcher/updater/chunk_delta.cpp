@@ -0,0 +1,55 @@
+#include "std_include.hpp"
+
+#include "chunk_delta.hpp"
+
+namespace updater
+{
+	delta_plan plan_delta(const std::vector<utils::chunking::chunk>& chunks, const uint8_t* local, const size_t local_size)
+	{
+		std::unordered_map<utils::cryptography::sha1::digest, const utils::chunking::chunk*> local_chunks{};
+
+		const auto local_split = utils::chunking::split(local, local_size);
+		local_chunks.reserve(local_split.size());
+
+		for (const auto& chunk : local_split)
+		{
+			local_chunks.emplace(chunk.hash, &chunk);
+		}
+
+		delta_plan plan{};
+
+		for (const auto& chunk : chunks)
+		{
+			const auto entry = local_chunks.find(chunk.hash);
+			if (entry != local_chunks.end() && entry->second->length == chunk.length)
+			{
+				plan.reused.push_back({chunk.offset, entry->second->offset, chunk.length});
+				continue;
+			}
+
+			if (!plan.missing.empty())
+			{
+				auto& last = plan.missing.back();
+				const auto end = last.start + last.length;
+
+				if (end + max_delta_gap >= chunk.offset)
+				{
+					last.length = static_cast<size_t>(chunk.offset + chunk.length - last.start);
+					continue;
+				}
+			}
+
+			segment segment{};
+			segment.start = static_cast<size_t>(chunk.offset);
+			segment.length = chunk.length;
+			plan.missing.emplace_back(segment);
+		}
+
+		for (const auto& segment : plan.missing)
+		{
+			plan.missing_size += segment.length;
+		}
+
+		return plan;
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "segments.hpp"
+
+#include <utils/chunking.hpp>
+
+namespace updater
+{
+	// Runs of missing chunks closer than this are fetched together, the reused bytes in between are cheaper
+	// than another request
+	constexpr size_t max_delta_gap = 16 * 1024;
+
+	struct reused_chunk
+	{
+		uint64_t offset;
+		uint64_t local_offset;
+		uint32_t length;
+	};
+
+	struct delta_plan
+	{
+		std::vector<reused_chunk> reused{};
+		std::vector<segment> missing{};
+		size_t missing_size{};
+	};
+
+	// Cuts the local copy the same way the server did and looks up every published chunk in it
+	delta_plan plan_delta(const std::vector<utils::chunking::chunk>& chunks, const uint8_t* local, size_t local_size);
+}
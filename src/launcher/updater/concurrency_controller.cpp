@@ -0,0 +1,146 @@
+#include "std_include.hpp"
+#include "concurrency_controller.hpp"
+
+namespace updater
+{
+	namespace
+	{
+		constexpr auto sample_window = std::chrono::seconds(2);
+
+		// Smooths the throughput over windows, a single slow window should not halve the limit
+		constexpr double smoothing_factor = 0.5;
+
+		// An increase has to improve throughput by this much, otherwise the link is considered saturated
+		constexpr double required_gain = 0.05;
+		constexpr double tolerated_drop = 0.3;
+
+		// Saturated links are probed again after this many windows
+		constexpr size_t probe_interval = 5;
+
+		// A single slow server does not mean the link is overloaded, only a share of stalled transfers does.
+		// The same stalls are seen again in the next windows, so the limit gets time to take effect.
+		constexpr double stalled_share = 0.25;
+		constexpr size_t min_stalled_transfers = 2;
+		constexpr size_t stall_cooldown = 3;
+	}
+
+	concurrency_controller::concurrency_controller(const size_t initial_limit, const size_t minimum_limit, const size_t maximum_limit)
+		: limit_(std::clamp(initial_limit, minimum_limit, maximum_limit))
+		, minimum_limit_(minimum_limit)
+		, maximum_limit_(maximum_limit)
+		, windows_since_decrease_(stall_cooldown)
+	{
+	}
+
+	size_t concurrency_controller::get_limit() const
+	{
+		return this->limit_;
+	}
+
+	size_t concurrency_controller::get_maximum_limit() const
+	{
+		return this->maximum_limit_;
+	}
+
+	void concurrency_controller::restart()
+	{
+		this->window_start_ = {};
+		this->window_start_bytes_ = 0;
+		this->throughput_ = 0.0;
+		this->baseline_throughput_ = 0.0;
+		this->last_action_ = action::none;
+		this->hold_windows_ = 0;
+		this->windows_since_decrease_ = stall_cooldown;
+	}
+
+	std::optional<concurrency_decision> concurrency_controller::sample(const utils::http::transfer_stats& stats)
+	{
+		const auto now = std::chrono::steady_clock::now();
+
+		if (this->window_start_ == std::chrono::steady_clock::time_point{})
+		{
+			this->window_start_ = now;
+			this->window_start_bytes_ = stats.received_bytes;
+			return {};
+		}
+
+		const auto elapsed = std::chrono::duration<double>(now - this->window_start_).count();
+		if (now - this->window_start_ < sample_window)
+		{
+			return {};
+		}
+
+		const auto current_throughput = static_cast<double>(stats.received_bytes - this->window_start_bytes_) / elapsed;
+		const auto previous_throughput = this->throughput_;
+
+		this->throughput_ = previous_throughput > 0.0
+			                    ? smoothing_factor * current_throughput + (1.0 - smoothing_factor) * previous_throughput
+			                    : current_throughput;
+
+		this->window_start_ = now;
+		this->window_start_bytes_ = stats.received_bytes;
+
+		++this->windows_since_decrease_;
+
+		const auto stalled = stats.stalled_transfers >= min_stalled_transfers
+			&& static_cast<double>(stats.stalled_transfers) >= stalled_share * static_cast<double>(stats.active_transfers);
+
+		if (stalled)
+		{
+			return this->windows_since_decrease_ > stall_cooldown
+				       ? this->apply(action::decrease, "transfers stalled", stats.stalled_transfers)
+				       : this->apply(action::none, "waiting for the last decrease", stats.stalled_transfers);
+		}
+
+		if (previous_throughput > 0.0 && current_throughput < previous_throughput * (1.0 - tolerated_drop))
+		{
+			return this->apply(action::decrease, "throughput dropped", stats.stalled_transfers);
+		}
+
+		// Without queued work a higher limit would not be used anyway
+		if (stats.active_transfers < this->limit_ || stats.queued_transfers == 0)
+		{
+			return this->apply(action::none, "limit not reached", stats.stalled_transfers);
+		}
+
+		if (this->last_action_ == action::increase && this->throughput_ < this->baseline_throughput_ * (1.0 + required_gain))
+		{
+			this->hold_windows_ = 0;
+			return this->apply(action::hold, "no gain from last increase", stats.stalled_transfers);
+		}
+
+		if (this->last_action_ == action::hold && ++this->hold_windows_ < probe_interval)
+		{
+			return this->apply(action::hold, "saturated", stats.stalled_transfers);
+		}
+
+		return this->apply(action::increase, "probing", stats.stalled_transfers);
+	}
+
+	concurrency_decision concurrency_controller::apply(const action action, const char* reason, const size_t stalled_transfers)
+	{
+		if (action == action::increase)
+		{
+			this->baseline_throughput_ = this->throughput_;
+			this->limit_ = std::min(this->limit_ + 1, this->maximum_limit_);
+		}
+		else if (action == action::decrease)
+		{
+			this->limit_ = std::max(this->limit_ / 2, this->minimum_limit_);
+			this->windows_since_decrease_ = 0;
+		}
+
+		if (action != action::none)
+		{
+			this->last_action_ = action;
+		}
+
+		concurrency_decision decision{};
+		decision.limit = this->limit_;
+		decision.throughput = static_cast<size_t>(this->throughput_);
+		decision.stalled_transfers = stalled_transfers;
+		decision.reason = reason;
+
+		return decision;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "progress_listener.hpp"
+
+#include <utils/http.hpp>
+
+#include <chrono>
+
+namespace updater
+{
+	// Adjusts the number of active transfers from the measured throughput.
+	// The limit grows by one while that keeps paying off and is halved when throughput collapses or a meaningful
+	// share of the transfers stalls.
+	class concurrency_controller
+	{
+	public:
+		static constexpr size_t default_initial_limit = 4;
+		static constexpr size_t default_minimum_limit = 1;
+		static constexpr size_t default_maximum_limit = 32;
+
+		concurrency_controller(size_t initial_limit = default_initial_limit, size_t minimum_limit = default_minimum_limit,
+		                       size_t maximum_limit = default_maximum_limit);
+
+		size_t get_limit() const;
+		size_t get_maximum_limit() const;
+
+		// Starts a new measurement, the limit is kept
+		void restart();
+
+		// Returns a decision whenever a full sampling window has passed
+		std::optional<concurrency_decision> sample(const utils::http::transfer_stats& stats);
+
+	private:
+		enum class action
+		{
+			none,
+			increase,
+			decrease,
+			hold,
+		};
+
+		size_t limit_;
+		size_t minimum_limit_;
+		size_t maximum_limit_;
+
+		std::chrono::steady_clock::time_point window_start_{};
+		uint64_t window_start_bytes_{0};
+
+		double throughput_{0.0};
+		double baseline_throughput_{0.0};
+
+		action last_action_{action::none};
+		size_t hold_windows_{0};
+		size_t windows_since_decrease_;
+
+		concurrency_decision apply(action action, const char* reason, size_t stalled_transfers);
+	};
+}
@@ -0,0 +1,100 @@
+#include "std_include.hpp"
+#include "download_queue.hpp"
+
+namespace updater
+{
+	download_queue::download_queue(const scheduling_policy policy, const size_t worker_count)
+		: scheduler_(create_download_scheduler(policy, worker_count))
+	{
+	}
+
+	bool download_queue::push(file_info file)
+	{
+		std::unique_lock<std::mutex> lock{this->mutex_};
+		if (this->closed_)
+		{
+			return false;
+		}
+
+		this->total_size_ += file.size;
+		this->files_.emplace_back(std::move(file));
+		this->scheduler_->add(this->files_.size() - 1, this->files_.back().size);
+
+		// Only a worker the scheduler hands a file to is resumed, the others stay parked until there is one for them
+		for (auto entry = this->waiters_.begin(); entry != this->waiters_.end(); ++entry)
+		{
+			const auto index = this->scheduler_->next(entry->worker);
+			if (!index)
+			{
+				continue;
+			}
+
+			const auto waiter = *entry;
+			this->waiters_.erase(entry);
+			*waiter.result = &this->files_[*index];
+
+			lock.unlock();
+			waiter.handle.resume();
+
+			break;
+		}
+
+		return true;
+	}
+
+	void download_queue::close()
+	{
+		std::deque<waiter> waiters{};
+
+		{
+			std::lock_guard<std::mutex> _{this->mutex_};
+			this->closed_ = true;
+			waiters.swap(this->waiters_);
+		}
+
+		for (const auto& waiter : waiters)
+		{
+			*waiter.result = nullptr;
+			waiter.handle.resume();
+		}
+	}
+
+	bool download_queue::is_closed() const
+	{
+		std::lock_guard<std::mutex> _{this->mutex_};
+		return this->closed_;
+	}
+
+	size_t download_queue::size() const
+	{
+		std::lock_guard<std::mutex> _{this->mutex_};
+		return this->files_.size();
+	}
+
+	size_t download_queue::get_total_size() const
+	{
+		std::lock_guard<std::mutex> _{this->mutex_};
+		return this->total_size_;
+	}
+
+	bool download_queue::wait(const size_t worker, const std::coroutine_handle<> handle, const file_info** result)
+	{
+		std::lock_guard<std::mutex> _{this->mutex_};
+
+		const auto index = this->scheduler_->next(worker);
+		if (index)
+		{
+			*result = &this->files_[*index];
+			return false;
+		}
+
+		if (this->closed_)
+		{
+			*result = nullptr;
+			return false;
+		}
+
+		this->waiters_.push_back({worker, handle, result});
+		return true;
+	}
+}
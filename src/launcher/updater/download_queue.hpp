@@ -0,0 +1,75 @@
+#pragma once
+
+#include "download_scheduler.hpp"
+
+#include <coroutine>
+#include <deque>
+
+namespace updater
+{
+	// Hands outdated files to download workers while the scan is still looking for more of them.
+	// Workers that run dry are suspended until the next file is pushed or the queue is closed,
+	// they resume on the thread that pushed the file.
+	class download_queue
+	{
+	public:
+		download_queue(scheduling_policy policy, size_t worker_count);
+
+		// Returns false once the queue is closed, the producer can stop looking for files then
+		bool push(file_info file);
+
+		// No more files will be pushed, queued files are still handed out and waiting workers get nothing
+		void close();
+
+		bool is_closed() const;
+
+		// Files pushed so far, their addresses stay valid for the lifetime of the queue
+		size_t size() const;
+		size_t get_total_size() const;
+
+		auto next(const size_t worker)
+		{
+			struct awaiter
+			{
+				download_queue& queue;
+				size_t worker;
+				const file_info* result{nullptr};
+
+				bool await_ready() const noexcept
+				{
+					return false;
+				}
+
+				bool await_suspend(const std::coroutine_handle<> awaiting)
+				{
+					return this->queue.wait(this->worker, awaiting, &this->result);
+				}
+
+				const file_info* await_resume() const noexcept
+				{
+					return this->result;
+				}
+			};
+
+			return awaiter{*this, worker};
+		}
+
+	private:
+		struct waiter
+		{
+			size_t worker;
+			std::coroutine_handle<> handle;
+			const file_info** result;
+		};
+
+		mutable std::mutex mutex_{};
+		std::unique_ptr<download_scheduler> scheduler_;
+		std::deque<file_info> files_{};
+		std::deque<waiter> waiters_{};
+		size_t total_size_{0};
+		bool closed_{false};
+
+		// Either takes a file right away and returns false, or parks the worker and returns true
+		bool wait(size_t worker, std::coroutine_handle<> handle, const file_info** result);
+	};
+}
@@ -0,0 +1,259 @@
+#include "std_include.hpp"
+#include "download_scheduler.hpp"
+
+#include <deque>
+
+namespace updater
+{
+	namespace
+	{
+		std::vector<size_t> get_indices_by_size(const std::vector<file_info>& files)
+		{
+			std::vector<size_t> indices(files.size());
+			for (size_t i = 0; i < indices.size(); ++i)
+			{
+				indices[i] = i;
+			}
+
+			std::stable_sort(indices.begin(), indices.end(), [&](const size_t a, const size_t b)
+			{
+				return files[a].size > files[b].size;
+			});
+
+			return indices;
+		}
+
+		struct queued_file
+		{
+			size_t index;
+			size_t size;
+		};
+
+		// Larger files first, ties are broken by their position so the order stays deterministic
+		struct larger_file_first
+		{
+			bool operator()(const queued_file& a, const queued_file& b) const
+			{
+				return a.size != b.size ? a.size > b.size : a.index < b.index;
+			}
+		};
+
+		// Hands out files in the order they were added, whichever worker asks first gets the next one
+		class ordered_scheduler final : public download_scheduler
+		{
+		public:
+			void add(const size_t index, size_t /*size*/) override
+			{
+				this->files_.push_back(index);
+			}
+
+			std::optional<size_t> next(size_t /*worker*/) override
+			{
+				if (this->files_.empty())
+				{
+					return {};
+				}
+
+				const auto index = this->files_.front();
+				this->files_.pop_front();
+				return index;
+			}
+
+		private:
+			std::deque<size_t> files_{};
+		};
+
+		// Always hands out the largest queued file
+		class longest_first_scheduler final : public download_scheduler
+		{
+		public:
+			void add(const size_t index, const size_t size) override
+			{
+				this->files_.insert({index, size});
+			}
+
+			std::optional<size_t> next(size_t /*worker*/) override
+			{
+				if (this->files_.empty())
+				{
+					return {};
+				}
+
+				const auto index = this->files_.begin()->index;
+				this->files_.erase(this->files_.begin());
+				return index;
+			}
+
+		private:
+			std::set<queued_file, larger_file_first> files_{};
+		};
+
+		// Alternates between the largest and the smallest queued file, so small files keep
+		// finishing while the big ones are still in flight
+		class interleaved_scheduler final : public download_scheduler
+		{
+		public:
+			void add(const size_t index, const size_t size) override
+			{
+				this->files_.insert({index, size});
+			}
+
+			std::optional<size_t> next(size_t /*worker*/) override
+			{
+				if (this->files_.empty())
+				{
+					return {};
+				}
+
+				const auto take_large = this->take_large_;
+				this->take_large_ = !this->take_large_;
+
+				const auto entry = take_large ? this->files_.begin() : std::prev(this->files_.end());
+				const auto index = entry->index;
+				this->files_.erase(entry);
+				return index;
+			}
+
+		private:
+			std::set<queued_file, larger_file_first> files_{};
+			bool take_large_{true};
+		};
+
+		// Assigns every file to the worker with the fewest queued bytes as it arrives. Workers take the largest
+		// file of their own queue, so a big file that arrives late does not wait behind the small ones.
+		// Workers that run dry take the smallest file of the most loaded worker.
+		class byte_balanced_scheduler final : public download_scheduler
+		{
+		public:
+			explicit byte_balanced_scheduler(const size_t worker_count)
+				: queues_(std::max(size_t(1), worker_count))
+			{
+			}
+
+			void add(const size_t index, const size_t size) override
+			{
+				auto& queue = *std::min_element(this->queues_.begin(), this->queues_.end(),
+				                                [](const worker_queue& a, const worker_queue& b)
+				                                {
+					                                return a.bytes < b.bytes;
+				                                });
+
+				queue.files.insert({index, size});
+				queue.bytes += size;
+			}
+
+			std::optional<size_t> next(const size_t worker) override
+			{
+				auto& own_queue = this->queues_[worker % this->queues_.size()];
+				if (!own_queue.files.empty())
+				{
+					return take(own_queue, own_queue.files.begin());
+				}
+
+				// Queues holding only empty files have no bytes, the file count tells them apart from empty queues
+				auto& busiest_queue = *std::max_element(this->queues_.begin(), this->queues_.end(),
+				                                        [](const worker_queue& a, const worker_queue& b)
+				                                        {
+					                                        return std::make_pair(a.bytes, a.files.size())
+						                                        < std::make_pair(b.bytes, b.files.size());
+				                                        });
+
+				if (busiest_queue.files.empty())
+				{
+					return {};
+				}
+
+				return take(busiest_queue, std::prev(busiest_queue.files.end()));
+			}
+
+		private:
+			struct worker_queue
+			{
+				std::set<queued_file, larger_file_first> files{};
+				size_t bytes{0};
+			};
+
+			std::vector<worker_queue> queues_;
+
+			static size_t take(worker_queue& queue, const std::set<queued_file, larger_file_first>::iterator entry)
+			{
+				const auto file = *entry;
+				queue.files.erase(entry);
+				queue.bytes -= file.size;
+				return file.index;
+			}
+		};
+	}
+
+	std::unique_ptr<download_scheduler> create_download_scheduler(const scheduling_policy policy, const size_t worker_count)
+	{
+		switch (policy)
+		{
+		case scheduling_policy::manifest_order:
+			return std::make_unique<ordered_scheduler>();
+		case scheduling_policy::byte_balanced:
+			return std::make_unique<byte_balanced_scheduler>(worker_count);
+		case scheduling_policy::interleaved:
+			return std::make_unique<interleaved_scheduler>();
+		case scheduling_policy::longest_first:
+		default:
+			return std::make_unique<longest_first_scheduler>();
+		}
+	}
+
+	std::unique_ptr<download_scheduler> create_download_scheduler(const scheduling_policy policy, const std::vector<file_info>& files,
+	                                                              const size_t worker_count)
+	{
+		auto scheduler = create_download_scheduler(policy, worker_count);
+
+		// Balancing works best when the largest files are placed first
+		if (policy == scheduling_policy::byte_balanced)
+		{
+			for (const auto index : get_indices_by_size(files))
+			{
+				scheduler->add(index, files[index].size);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				scheduler->add(i, files[i].size);
+			}
+		}
+
+		return scheduler;
+	}
+
+	std::optional<scheduling_policy> parse_scheduling_policy(const std::string& name)
+	{
+		for (const auto policy : {
+			     scheduling_policy::manifest_order, scheduling_policy::longest_first, scheduling_policy::byte_balanced,
+			     scheduling_policy::interleaved
+		     })
+		{
+			if (name == get_scheduling_policy_name(policy))
+			{
+				return policy;
+			}
+		}
+
+		return {};
+	}
+
+	const char* get_scheduling_policy_name(const scheduling_policy policy)
+	{
+		switch (policy)
+		{
+		case scheduling_policy::manifest_order:
+			return "manifest-order";
+		case scheduling_policy::byte_balanced:
+			return "byte-balanced";
+		case scheduling_policy::interleaved:
+			return "interleaved";
+		case scheduling_policy::longest_first:
+		default:
+			return "longest-first";
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "file_info.hpp"
+
+namespace updater
+{
+	enum class scheduling_policy
+	{
+		manifest_order,
+		longest_first,
+		byte_balanced,
+		interleaved,
+	};
+
+	// Decides which file a download worker picks up next
+	class download_scheduler
+	{
+	public:
+		virtual ~download_scheduler() = default;
+
+		// Queues another file, files may keep arriving while workers are already downloading
+		virtual void add(size_t index, size_t size) = 0;
+
+		// Returns the index of the next file, or nothing if no file is queued right now
+		virtual std::optional<size_t> next(size_t worker) = 0;
+	};
+
+	std::unique_ptr<download_scheduler> create_download_scheduler(scheduling_policy policy, size_t worker_count);
+	std::unique_ptr<download_scheduler> create_download_scheduler(scheduling_policy policy, const std::vector<file_info>& files,
+	                                                              size_t worker_count);
+
+	std::optional<scheduling_policy> parse_scheduling_policy(const std::string& name);
+	const char* get_scheduling_policy_name(scheduling_policy policy);
+}
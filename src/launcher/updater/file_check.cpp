@@ -0,0 +1,91 @@
+#include "std_include.hpp"
+
+#include "file_check.hpp"
+
+namespace updater
+{
+	std::optional<utils::io::file_metadata> find_file_metadata(const filesystem_snapshot& snapshot, const std::string& path)
+	{
+		const auto* entry = snapshot.find(path);
+		if (!entry || entry->is_directory)
+		{
+			return {};
+		}
+
+		return entry->metadata;
+	}
+
+	std::optional<bool> check_cached_file(const hash_cache& cache, const std::string& path,
+	                                      const std::optional<utils::io::file_metadata>& current, const uint64_t size,
+	                                      const utils::cryptography::sha1::digest& hash, const bool use_cache,
+	                                      utils::io::file_metadata& metadata)
+	{
+		if (!current || current->size != size)
+		{
+			return true;
+		}
+
+		metadata = *current;
+
+		// Only hash files whose size, timestamp or identity changed since they were last verified
+		if (use_cache)
+		{
+			const auto cached_hash = cache.find(path, metadata);
+			if (cached_hash)
+			{
+				return *cached_hash != hash;
+			}
+		}
+
+		return {};
+	}
+
+	batch_hasher::batch_hasher(hash_cache& cache, callback on_hashed)
+		: cache_(cache)
+		, on_hashed_(std::move(on_hashed))
+	{
+	}
+
+	bool batch_hasher::add(const size_t index, std::string path, const utils::io::file_metadata& metadata, const uint64_t size)
+	{
+		pending_file pending{index, std::move(path), metadata, {}};
+		if (!utils::io::read_file(pending.path, &pending.data) || pending.data.size() != size)
+		{
+			return false;
+		}
+
+		this->batch_size_ += pending.data.size();
+		this->batch_.emplace_back(std::move(pending));
+
+		if (this->batch_size_ >= max_batch_hash_size)
+		{
+			this->flush();
+		}
+
+		return true;
+	}
+
+	void batch_hasher::flush()
+	{
+		std::vector<std::string_view> messages{};
+		messages.reserve(this->batch_.size());
+
+		for (const auto& pending : this->batch_)
+		{
+			messages.emplace_back(pending.data);
+		}
+
+		const auto hashes = utils::cryptography::sha1::compute_many(messages);
+
+		// The batch is taken first, the callback may stop the scan
+		std::vector<pending_file> batch{};
+		batch.swap(this->batch_);
+		this->batch_size_ = 0;
+
+		for (size_t i = 0; i < batch.size(); ++i)
+		{
+			this->cache_.store(batch[i].path, batch[i].metadata, hashes[i]);
+			this->on_hashed_(batch[i].index, hashes[i]);
+		}
+	}
+}
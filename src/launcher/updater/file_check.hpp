@@ -0,0 +1,49 @@
+#pragma once
+
+#include "hash_cache.hpp"
+#include "filesystem_snapshot.hpp"
+
+namespace updater
+{
+	// Small files are read in batches and hashed together, see sha1::compute_many
+	constexpr size_t max_batch_hash_file_size = 256 * 1024;
+	constexpr size_t max_batch_hash_size = 32 * 1024 * 1024;
+
+	// Metadata of a file as the snapshot saw it, nothing if it is missing or a directory
+	std::optional<utils::io::file_metadata> find_file_metadata(const filesystem_snapshot& snapshot, const std::string& path);
+
+	// Decides from the metadata and the hash cache alone whether a file is outdated. Nothing is returned if the
+	// file changed since it was last verified, it has to be hashed then and stored under the given metadata.
+	std::optional<bool> check_cached_file(const hash_cache& cache, const std::string& path,
+	                                      const std::optional<utils::io::file_metadata>& current, uint64_t size,
+	                                      const utils::cryptography::sha1::digest& hash, bool use_cache,
+	                                      utils::io::file_metadata& metadata);
+
+	// Small files are read up front and hashed together across the SHA-1 lanes, every hash is stored in the cache
+	class batch_hasher
+	{
+	public:
+		using callback = std::function<void(size_t index, const utils::cryptography::sha1::digest& hash)>;
+
+		batch_hasher(hash_cache& cache, callback on_hashed);
+
+		// False if the file can not be read or does not have the expected size
+		bool add(size_t index, std::string path, const utils::io::file_metadata& metadata, uint64_t size);
+		void flush();
+
+	private:
+		struct pending_file
+		{
+			size_t index;
+			std::string path;
+			utils::io::file_metadata metadata;
+			std::string data;
+		};
+
+		hash_cache& cache_;
+		callback on_hashed_;
+
+		std::vector<pending_file> batch_{};
+		size_t batch_size_{0};
+	};
+}
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <string>
+#include <vector>
+
+#include <utils/cryptography.hpp>
+#include <utils/manifest.hpp>
 
 namespace updater
 {
@@ -8,6 +12,16 @@ namespace updater
 	{
 		std::string name;
 		size_t size;
-		std::string hash;
+		utils::cryptography::sha1::digest hash{};
+
+		// Optional per-chunk hashes, they allow verifying and repairing parts of large files
+		size_t chunk_size{0};
+		std::vector<utils::cryptography::sha1::digest> chunk_hashes{};
+
+		// Published patches from older versions of the file
+		std::vector<utils::manifest::patch> patches{};
+
+		// Size of the published gzip variant, 0 if there is none
+		size_t compressed_size{0};
 	};
 }
@@ -0,0 +1,664 @@
+#include "std_include.hpp"
+
+#include "file_table.hpp"
+
+#include <utils/logger.hpp>
+
+#include <rapidjson/reader.h>
+
+namespace updater
+{
+	namespace
+	{
+		// Names end up as paths below the data directory, they must not be able to leave it
+		bool is_valid_name(const std::string_view name)
+		{
+			if (name.empty() || name.front() == '/' || name.front() == '\\' || name.find(':') != std::string_view::npos)
+			{
+				return false;
+			}
+
+			size_t start = 0;
+			while (start <= name.size())
+			{
+				auto end = name.find_first_of("/\\", start);
+				if (end == std::string_view::npos)
+				{
+					end = name.size();
+				}
+
+				const auto component = name.substr(start, end - start);
+				if (component.empty() || component == "." || component == "..")
+				{
+					return false;
+				}
+
+				start = end + 1;
+			}
+
+			return true;
+		}
+
+		// Entries look like ["name", size, "hash", {"chunk_size": n, "chunks": ["hash", ...], "patches": [["hash", size], ...],
+		// "compressed_size": n}], the object is optional. Unknown object members and trailing array elements are skipped, so the format can grow.
+		class manifest_handler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, manifest_handler>
+		{
+		public:
+			explicit manifest_handler(file_table& table)
+				: table_(table)
+			{
+			}
+
+			bool is_done() const
+			{
+				return this->state_ == state::done;
+			}
+
+			const std::string& get_error() const
+			{
+				return this->error_;
+			}
+
+			bool Default()
+			{
+				return this->skip_scalar();
+			}
+
+			bool Int(const int value)
+			{
+				return value < 0 ? this->skip_scalar() : this->number(static_cast<uint64_t>(value));
+			}
+
+			bool Uint(const unsigned value)
+			{
+				return this->number(value);
+			}
+
+			bool Int64(const int64_t value)
+			{
+				return value < 0 ? this->skip_scalar() : this->number(static_cast<uint64_t>(value));
+			}
+
+			bool Uint64(const uint64_t value)
+			{
+				return this->number(value);
+			}
+
+			bool String(const char* str, const rapidjson::SizeType length, bool)
+			{
+				const std::string_view value{str, length};
+
+				if (this->is_skipping() || this->is_ignored_value())
+				{
+					return this->skip_scalar();
+				}
+
+				if (this->state_ == state::entry && this->field_ == 0)
+				{
+					if (!is_valid_name(value))
+					{
+						return this->fail("invalid name");
+					}
+
+					this->name_ = value;
+					return this->next_field();
+				}
+
+				if (this->state_ == state::entry && this->field_ == 2)
+				{
+					const auto hash = file_table::hash::from_hex(value);
+					if (!hash)
+					{
+						return this->fail("invalid hash");
+					}
+
+					this->hash_ = *hash;
+					return this->next_field();
+				}
+
+				if (this->state_ == state::chunk_hashes)
+				{
+					const auto hash = file_table::hash::from_hex(value);
+					if (!hash)
+					{
+						return this->fail("invalid chunk hash");
+					}
+
+					this->chunk_hashes_.emplace_back(*hash);
+					return true;
+				}
+
+				if (this->state_ == state::patch && this->patch_field_ == 0)
+				{
+					const auto hash = file_table::hash::from_hex(value);
+					if (!hash)
+					{
+						return this->fail("invalid patch hash");
+					}
+
+					this->patches_.back().source_hash = *hash;
+					++this->patch_field_;
+					return true;
+				}
+
+				return this->fail("unexpected string");
+			}
+
+			bool StartObject()
+			{
+				if (this->is_skipping() || this->is_ignored_value())
+				{
+					++this->skip_depth_;
+					return true;
+				}
+
+				if (this->state_ == state::entry && this->field_ == 3)
+				{
+					this->state_ = state::details;
+					return true;
+				}
+
+				return this->fail("unexpected object");
+			}
+
+			bool Key(const char* str, const rapidjson::SizeType length, bool)
+			{
+				if (this->is_skipping())
+				{
+					return true;
+				}
+
+				const std::string_view key{str, length};
+				if (key == "chunk_size")
+				{
+					this->key_ = key::chunk_size;
+				}
+				else if (key == "chunks")
+				{
+					this->key_ = key::chunks;
+				}
+				else if (key == "patches")
+				{
+					this->key_ = key::patches;
+				}
+				else if (key == "compressed_size")
+				{
+					this->key_ = key::compressed_size;
+				}
+				else
+				{
+					this->key_ = key::unknown;
+				}
+
+				return true;
+			}
+
+			bool EndObject(rapidjson::SizeType)
+			{
+				if (this->is_skipping())
+				{
+					return this->end_skipped_container();
+				}
+
+				this->state_ = state::entry;
+				return this->next_field();
+			}
+
+			bool StartArray()
+			{
+				if (this->is_skipping() || this->is_ignored_value())
+				{
+					++this->skip_depth_;
+					return true;
+				}
+
+				switch (this->state_)
+				{
+				case state::start:
+					this->state_ = state::entries;
+					return true;
+				case state::entries:
+					this->state_ = state::entry;
+					this->field_ = 0;
+					this->chunk_size_ = 0;
+					this->compressed_size_ = 0;
+					this->has_chunks_ = false;
+					this->chunk_hashes_.clear();
+					this->patches_.clear();
+					return true;
+				case state::details:
+					if (this->key_ == key::chunks)
+					{
+						this->state_ = state::chunk_hashes;
+						this->has_chunks_ = true;
+						this->chunk_hashes_.clear();
+						return true;
+					}
+					if (this->key_ == key::patches)
+					{
+						this->state_ = state::patches;
+						this->patches_.clear();
+						return true;
+					}
+					break;
+				case state::patches:
+					this->state_ = state::patch;
+					this->patch_field_ = 0;
+					this->patches_.emplace_back();
+					return true;
+				default:
+					break;
+				}
+
+				return this->fail("unexpected array");
+			}
+
+			bool EndArray(rapidjson::SizeType)
+			{
+				if (this->is_skipping())
+				{
+					return this->end_skipped_container();
+				}
+
+				switch (this->state_)
+				{
+				case state::chunk_hashes:
+				case state::patches:
+					this->state_ = state::details;
+					this->key_ = key::none;
+					return true;
+				case state::patch:
+					if (this->patch_field_ < 2)
+					{
+						return this->fail("incomplete patch");
+					}
+
+					this->state_ = state::patches;
+					return true;
+				case state::entry:
+					this->state_ = state::entries;
+					return this->add_entry();
+				case state::entries:
+					this->state_ = state::done;
+					return true;
+				default:
+					return this->fail("unexpected end of array");
+				}
+			}
+
+		private:
+			enum class state
+			{
+				start,
+				entries,
+				entry,
+				details,
+				chunk_hashes,
+				patches,
+				patch,
+				done,
+			};
+
+			enum class key
+			{
+				none,
+				chunk_size,
+				chunks,
+				patches,
+				compressed_size,
+				unknown,
+			};
+
+			file_table& table_;
+			std::string error_{};
+
+			state state_{state::start};
+			key key_{key::none};
+			size_t field_{0};
+			size_t patch_field_{0};
+			size_t skip_depth_{0};
+
+			std::string name_{};
+			uint64_t size_{0};
+			file_table::hash hash_{};
+			uint64_t chunk_size_{0};
+			uint64_t compressed_size_{0};
+			bool has_chunks_{false};
+			std::vector<file_table::hash> chunk_hashes_{};
+			std::vector<utils::manifest::patch> patches_{};
+
+			bool is_skipping() const
+			{
+				return this->skip_depth_ > 0;
+			}
+
+			bool is_ignored_value() const
+			{
+				return (this->state_ == state::entry && this->field_ > 3) ||
+					(this->state_ == state::details && this->key_ == key::unknown) ||
+					(this->state_ == state::patch && this->patch_field_ > 1);
+			}
+
+			bool fail(const std::string_view reason)
+			{
+				this->error_ = std::string(reason) + " in entry " + std::to_string(this->table_.size());
+				return false;
+			}
+
+			bool next_field()
+			{
+				++this->field_;
+				return true;
+			}
+
+			void end_ignored_value()
+			{
+				if (this->state_ == state::entry)
+				{
+					++this->field_;
+				}
+				else if (this->state_ == state::details)
+				{
+					this->key_ = key::none;
+				}
+				else if (this->state_ == state::patch)
+				{
+					++this->patch_field_;
+				}
+			}
+
+			bool skip_scalar()
+			{
+				if (this->is_skipping())
+				{
+					return true;
+				}
+
+				if (this->is_ignored_value())
+				{
+					this->end_ignored_value();
+					return true;
+				}
+
+				return this->fail("unexpected value");
+			}
+
+			bool end_skipped_container()
+			{
+				if (--this->skip_depth_ == 0)
+				{
+					this->end_ignored_value();
+				}
+
+				return true;
+			}
+
+			bool number(const uint64_t value)
+			{
+				if (this->is_skipping())
+				{
+					return true;
+				}
+
+				if (this->state_ == state::entry && this->field_ == 1)
+				{
+					this->size_ = value;
+					return this->next_field();
+				}
+
+				if (this->state_ == state::details && this->key_ == key::chunk_size)
+				{
+					this->chunk_size_ = value;
+					this->key_ = key::none;
+					return true;
+				}
+
+				if (this->state_ == state::details && this->key_ == key::compressed_size)
+				{
+					this->compressed_size_ = value;
+					this->key_ = key::none;
+					return true;
+				}
+
+				if (this->state_ == state::patch && this->patch_field_ == 1)
+				{
+					this->patches_.back().size = value;
+					++this->patch_field_;
+					return true;
+				}
+
+				return this->skip_scalar();
+			}
+
+			bool add_entry()
+			{
+				if (this->field_ < 3)
+				{
+					return this->fail("incomplete entry");
+				}
+
+				// Chunk hashes are optional, they are dropped if they do not cover the file
+				const auto chunk_count = this->chunk_size_ ? (this->size_ + this->chunk_size_ - 1) / this->chunk_size_ : 0;
+				if (!this->has_chunks_ || this->size_ == 0 || chunk_count != this->chunk_hashes_.size())
+				{
+					this->table_.add(this->name_, this->size_, this->hash_);
+				}
+				else
+				{
+					this->table_.add(this->name_, this->size_, this->hash_, this->chunk_size_, this->chunk_hashes_.data(),
+					                 this->chunk_hashes_.size());
+				}
+
+				for (const auto& patch : this->patches_)
+				{
+					this->table_.add_patch(patch);
+				}
+
+				this->table_.set_compressed_size(this->compressed_size_);
+				return true;
+			}
+		};
+	}
+
+	file_table::file_table()
+	{
+		this->name_offsets_.emplace_back(0);
+		this->chunk_offsets_.emplace_back(0);
+		this->patch_offsets_.emplace_back(0);
+	}
+
+	size_t file_table::size() const
+	{
+		return this->sizes_.size();
+	}
+
+	bool file_table::empty() const
+	{
+		return this->sizes_.empty();
+	}
+
+	void file_table::reserve(const size_t entries, const size_t name_bytes)
+	{
+		this->names_.reserve(name_bytes);
+		this->name_offsets_.reserve(entries + 1);
+		this->sizes_.reserve(entries);
+		this->hashes_.reserve(entries);
+		this->chunk_sizes_.reserve(entries);
+		this->chunk_offsets_.reserve(entries + 1);
+		this->patch_offsets_.reserve(entries + 1);
+		this->compressed_sizes_.reserve(entries);
+	}
+
+	void file_table::add(const std::string_view name, const uint64_t size, const hash& file_hash)
+	{
+		this->add(name, size, file_hash, 0, nullptr, 0);
+	}
+
+	void file_table::add(const std::string_view name, const uint64_t size, const hash& file_hash, const uint64_t chunk_size,
+	                     const hash* chunk_hashes, const size_t chunk_count)
+	{
+		this->names_.append(name);
+		this->name_offsets_.emplace_back(this->names_.size());
+		this->sizes_.emplace_back(size);
+		this->hashes_.emplace_back(file_hash);
+		this->chunk_sizes_.emplace_back(chunk_count ? chunk_size : 0);
+		this->chunk_hashes_.insert(this->chunk_hashes_.end(), chunk_hashes, chunk_hashes + chunk_count);
+		this->chunk_offsets_.emplace_back(this->chunk_hashes_.size());
+		this->patch_offsets_.emplace_back(this->patches_.size());
+		this->compressed_sizes_.emplace_back(0);
+	}
+
+	void file_table::add_patch(const utils::manifest::patch& patch)
+	{
+		this->patches_.emplace_back(patch);
+		++this->patch_offsets_.back();
+	}
+
+	void file_table::set_compressed_size(const uint64_t compressed_size)
+	{
+		this->compressed_sizes_.back() = compressed_size;
+	}
+
+	std::string_view file_table::get_name(const size_t index) const
+	{
+		const auto start = this->name_offsets_[index];
+		return std::string_view{this->names_}.substr(start, this->name_offsets_[index + 1] - start);
+	}
+
+	uint64_t file_table::get_size(const size_t index) const
+	{
+		return this->sizes_[index];
+	}
+
+	const file_table::hash& file_table::get_hash(const size_t index) const
+	{
+		return this->hashes_[index];
+	}
+
+	uint64_t file_table::get_chunk_size(const size_t index) const
+	{
+		return this->chunk_sizes_[index];
+	}
+
+	size_t file_table::get_chunk_count(const size_t index) const
+	{
+		return this->chunk_offsets_[index + 1] - this->chunk_offsets_[index];
+	}
+
+	size_t file_table::get_patch_count(const size_t index) const
+	{
+		return this->patch_offsets_[index + 1] - this->patch_offsets_[index];
+	}
+
+	uint64_t file_table::get_compressed_size(const size_t index) const
+	{
+		return this->compressed_sizes_[index];
+	}
+
+	file_info file_table::get_file_info(const size_t index) const
+	{
+		file_info info{};
+		info.name = this->get_name(index);
+		info.size = static_cast<size_t>(this->get_size(index));
+		info.hash = this->get_hash(index);
+
+		const auto chunk_count = this->get_chunk_count(index);
+		if (chunk_count > 0)
+		{
+			info.chunk_size = static_cast<size_t>(this->get_chunk_size(index));
+			const auto first = this->chunk_hashes_.begin() + static_cast<ptrdiff_t>(this->chunk_offsets_[index]);
+			info.chunk_hashes.assign(first, first + static_cast<ptrdiff_t>(chunk_count));
+		}
+
+		const auto first_patch = this->patches_.begin() + static_cast<ptrdiff_t>(this->patch_offsets_[index]);
+		info.patches.assign(first_patch, first_patch + static_cast<ptrdiff_t>(this->get_patch_count(index)));
+		info.compressed_size = static_cast<size_t>(this->get_compressed_size(index));
+
+		return info;
+	}
+
+	std::optional<file_table> parse_file_table(const std::string& json)
+	{
+		file_table table{};
+		manifest_handler handler{table};
+
+		rapidjson::Reader reader{};
+		rapidjson::StringStream stream{json.data()};
+
+		const auto result = reader.Parse(stream, handler);
+		if (result.IsError() || !handler.is_done())
+		{
+			const auto& error = handler.get_error();
+			utils::logger::write("Rejecting manifest: {}", error.empty() ? "malformed JSON" : error);
+			return {};
+		}
+
+		return {std::move(table)};
+	}
+
+	std::optional<file_table> load_file_table(const utils::manifest::binary_manifest& manifest)
+	{
+		file_table table{};
+		table.reserve(manifest.size());
+
+		for (size_t i = 0; i < manifest.size(); ++i)
+		{
+			const auto entry = manifest.get(i);
+
+			// The same rules as for JSON manifests, the image may come from the server as well
+			if (!is_valid_name(entry.name))
+			{
+				utils::logger::write("Rejecting manifest: invalid file name");
+				return {};
+			}
+
+			// Digests are plain byte arrays, so the chunk hashes can be taken straight from the image
+			static_assert(sizeof(file_table::hash) == utils::manifest::hash_size);
+			const auto* chunk_hashes = reinterpret_cast<const file_table::hash*>(entry.chunk_hashes);
+
+			// Chunk hashes are optional, they are dropped if they do not cover the file
+			const auto chunk_count = entry.chunk_size ? (entry.size + entry.chunk_size - 1) / entry.chunk_size : 0;
+			if (entry.chunk_count == 0 || entry.size == 0 || chunk_count != entry.chunk_count)
+			{
+				table.add(entry.name, entry.size, file_table::hash{entry.hash});
+			}
+			else
+			{
+				table.add(entry.name, entry.size, file_table::hash{entry.hash}, entry.chunk_size, chunk_hashes, entry.chunk_count);
+			}
+
+			for (size_t j = 0; j < entry.patch_count; ++j)
+			{
+				table.add_patch(entry.get_patch(j));
+			}
+
+			table.set_compressed_size(entry.compressed_size);
+		}
+
+		return {std::move(table)};
+	}
+
+	std::string write_binary_manifest(const file_table& table)
+	{
+		std::vector<utils::manifest::entry> entries{};
+		entries.reserve(table.size());
+
+		for (size_t i = 0; i < table.size(); ++i)
+		{
+			auto info = table.get_file_info(i);
+
+			utils::manifest::entry entry{};
+			entry.name = std::move(info.name);
+			entry.size = info.size;
+			entry.hash = info.hash;
+			entry.chunk_size = info.chunk_size;
+			entry.chunk_hashes = std::move(info.chunk_hashes);
+			entry.patches = std::move(info.patches);
+			entry.compressed_size = info.compressed_size;
+
+			entries.emplace_back(std::move(entry));
+		}
+
+		return utils::manifest::write_binary_manifest(std::move(entries));
+	}
+}
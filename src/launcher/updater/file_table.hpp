@@ -0,0 +1,59 @@
+#pragma once
+
+#include "file_info.hpp"
+
+#include <utils/manifest.hpp>
+
+namespace updater
+{
+	// Column store for the manifest, every entry is spread over arrays indexed by its position.
+	// Names are kept in one shared arena and digests as raw bytes, file_info is only built when needed.
+	class file_table
+	{
+	public:
+		using hash = utils::cryptography::sha1::digest;
+
+		file_table();
+
+		size_t size() const;
+		bool empty() const;
+
+		void reserve(size_t entries, size_t name_bytes = 0);
+
+		void add(std::string_view name, uint64_t size, const hash& file_hash);
+		void add(std::string_view name, uint64_t size, const hash& file_hash, uint64_t chunk_size, const hash* chunk_hashes,
+		         size_t chunk_count);
+
+		// Attaches a patch to the entry that was added last
+		void add_patch(const utils::manifest::patch& patch);
+		void set_compressed_size(uint64_t compressed_size);
+
+		std::string_view get_name(size_t index) const;
+		uint64_t get_size(size_t index) const;
+		const hash& get_hash(size_t index) const;
+		uint64_t get_chunk_size(size_t index) const;
+		size_t get_chunk_count(size_t index) const;
+		size_t get_patch_count(size_t index) const;
+		uint64_t get_compressed_size(size_t index) const;
+
+		file_info get_file_info(size_t index) const;
+
+	private:
+		std::string names_{};
+		std::vector<size_t> name_offsets_{};
+		std::vector<uint64_t> sizes_{};
+		std::vector<hash> hashes_{};
+		std::vector<uint64_t> chunk_sizes_{};
+		std::vector<size_t> chunk_offsets_{};
+		std::vector<hash> chunk_hashes_{};
+		std::vector<size_t> patch_offsets_{};
+		std::vector<utils::manifest::patch> patches_{};
+		std::vector<uint64_t> compressed_sizes_{};
+	};
+
+	// Streams the JSON manifest into the table, any malformed entry rejects the whole manifest
+	std::optional<file_table> parse_file_table(const std::string& json);
+	// Rejects images with names that would leave the data directory
+	std::optional<file_table> load_file_table(const utils::manifest::binary_manifest& manifest);
+	std::string write_binary_manifest(const file_table& table);
+}
@@ -3,16 +3,30 @@
 #include "updater.hpp"
 #include "updater_ui.hpp"
 #include "file_updater.hpp"
-
+#include "download_queue.hpp"
+#include "file_check.hpp"
+#include "manifest_diff.hpp"
+#include "pack_plan.hpp"
+#include "chunk_delta.hpp"
+#include "path_index.hpp"
+#include "segments.hpp"
+#include "trash.hpp"
+
+#include <utils/chunking.hpp>
 #include <utils/cryptography.hpp>
 #include <utils/http.hpp>
 #include <utils/io.hpp>
 #include <utils/logger.hpp>
+#include <utils/manifest.hpp>
+#include <utils/pack.hpp>
+#include <utils/patch.hpp>
 
 #include <rapidjson/document.h>
 #include <rapidjson/ostreamwrapper.h>
 #include <rapidjson/writer.h>
 #include <iostream>
+#include <future>
+#include <span>
 
 #include <unzip.h>
 
@@ -26,6 +40,19 @@
 
 #define UPDATE_HOST_BINARY "xlabs.exe"
 
+#define HASH_CACHE_FILE "user/hash_cache.bin"
+#define HTTP_CACHE_DIRECTORY "user/http_cache"
+#define OBJECT_STORE_DIRECTORY "user/objects"
+#define TRASH_DIRECTORY "user/.trash"
+#define APPLIED_MANIFEST_FILE "user/manifest.bin"
+
+#define PART_FILE_EXTENSION ".part"
+#define PART_INFO_FILE_EXTENSION ".part.info"
+
+#define SCHEDULING_POLICY_FLAG "--download-schedule="
+
+#define GITHUB_API_URL "https://api.github.com/"
+
 #define IW4X_VERSION_FILE ".version.json"
 #define IW4X_RAWFILES_UPDATE_FILE "release.zip"
 #define IW4X_RAWFILES_UPDATE_URL "https://github.com/XLabsProject/iw4x-rawfiles/releases/latest/download/" IW4X_RAWFILES_UPDATE_FILE
@@ -34,6 +61,15 @@ namespace updater
 {
 	namespace
 	{
+		// Only counts objects nothing in the install links to anymore
+		constexpr uint64_t max_object_store_size = 2ull * 1024 * 1024 * 1024;
+
+		// Release checks count against the unauthenticated GitHub rate limit, a recent answer is good enough
+		constexpr auto release_check_max_age = std::chrono::minutes(10);
+
+		// Ranges of one file or pack are spread over this many requests, see run_range_requests
+		constexpr size_t max_range_requests = 8;
+
 		std::string get_update_file()
 		{
 			return is_main_channel() ? UPDATE_FILE_MAIN : UPDATE_FILE_DEV;
@@ -44,52 +80,74 @@ namespace updater
 			return is_main_channel() ? UPDATE_FOLDER_MAIN : UPDATE_FOLDER_DEV;
 		}
 
-		std::vector<file_info> parse_file_infos(const std::string& json)
+		file_table get_file_table(const utils::http::cache& cache)
 		{
-			rapidjson::Document doc{};
-			doc.Parse(json.data(), json.size());
+			// Servers that know the binary manifest send it instead, anything else is treated as JSON
+			utils::http::headers headers{};
+			headers["Accept"] = std::string(utils::manifest::binary_content_type) + ", application/json;q=0.9";
 
-			if (!doc.IsArray())
+			// An unchanged manifest is confirmed with a 304 instead of being downloaded again
+			const auto data = cache.get_data(get_update_file(), headers);
+			if (!data)
 			{
 				return {};
 			}
 
-			std::vector<file_info> files{};
+			const auto manifest = utils::manifest::binary_manifest::parse(data->data(), data->size());
+			auto table = manifest ? load_file_table(*manifest) : parse_file_table(*data);
+			return table ? std::move(*table) : file_table{};
+		}
+
+		utils::cryptography::sha1::digest get_hash(const std::string& data)
+		{
+			return utils::cryptography::sha1::compute(data);
+		}
+
+		bool is_full_verify()
+		{
+			static const auto result = strstr(GetCommandLineA(), "--full-verify") != nullptr;
+			return result;
+		}
 
-			for (const auto& element : doc.GetArray())
+		scheduling_policy get_scheduling_policy()
+		{
+			static const auto result = []()
 			{
-				if (!element.IsArray())
+				const std::string command_line = GetCommandLineA();
+
+				const auto start = command_line.find(SCHEDULING_POLICY_FLAG);
+				if (start != std::string::npos)
 				{
-					continue;
-				}
+					const auto value_start = start + strlen(SCHEDULING_POLICY_FLAG);
+					const auto value_end = command_line.find_first_of(" \"", value_start);
+					const auto name = command_line.substr(value_start, value_end - value_start);
 
-				auto array = element.GetArray();
+					const auto policy = parse_scheduling_policy(name);
+					if (policy)
+					{
+						return *policy;
+					}
 
-				file_info info{};
-				info.name.assign(array[0].GetString(), array[0].GetStringLength());
-				info.size = array[1].GetInt64();
-				info.hash.assign(array[2].GetString(), array[2].GetStringLength());
+					utils::logger::write("Unknown download schedule {}", name);
+				}
 
-				files.emplace_back(std::move(info));
-			}
+				return scheduling_policy::longest_first;
+			}();
 
-			return files;
+			return result;
 		}
 
-		std::vector<file_info> get_file_infos()
+		std::optional<size_t> find_host_file(const file_table& files)
 		{
-			const auto json = utils::http::get_data(get_update_file());
-			if (!json)
+			for (size_t i = 0; i < files.size(); ++i)
 			{
-				return {};
+				if (files.get_name(i) == UPDATE_HOST_BINARY)
+				{
+					return i;
+				}
 			}
 
-			return parse_file_infos(*json);
-		}
-
-		std::string get_hash(const std::string& data)
-		{
-			return utils::cryptography::sha1::compute(data, true);
+			return {};
 		}
 
 		const file_info* find_host_file_info(const std::vector<file_info>& outdated_files)
@@ -105,101 +163,1610 @@ namespace updater
 			return nullptr;
 		}
 
-		size_t get_optimal_concurrent_download_count(const size_t file_count)
+		struct part_info
+		{
+			size_t size{};
+			utils::cryptography::sha1::digest hash{};
+			std::string etag{};
+			std::vector<size_t> segments{};
+		};
+
+		std::string get_part_info_file(const std::string& part_file)
 		{
-			size_t cores = std::thread::hardware_concurrency();
-			cores = (cores * 2) / 3;
-			return std::max(1ull, std::min(cores, file_count));
+			return part_file + ".info";
 		}
 
-		bool is_inside_folder(const std::filesystem::path& file, const std::filesystem::path& folder)
+		std::string get_part_patch_file(const std::string& part_file)
 		{
-			const auto relative = std::filesystem::relative(file, folder);
-			const auto start = relative.begin();
-			return start != relative.end() && start->string() != "..";
+			return part_file + ".patch";
 		}
-	}
 
-	file_updater::file_updater(progress_listener& listener, std::string base, std::string process_file)
-		: listener_(listener)
-		, base_(std::move(base))
-		, process_file_(std::move(process_file))
-	{
-		this->dead_process_file_ = this->process_file_ + ".old";
-		this->delete_old_process_file();
-	}
+		std::optional<part_info> load_part_info(const std::string& part_file)
+		{
+			std::string data{};
+			if (!utils::io::read_file(get_part_info_file(part_file), &data))
+			{
+				return {};
+			}
 
-	void file_updater::run() const
-	{
-		const auto files = get_file_infos();
-		if (!files.empty())
+			rapidjson::Document doc{};
+			const rapidjson::ParseResult result = doc.Parse(data);
+			if (!result || !doc.IsObject())
+			{
+				return {};
+			}
+
+			if (!doc.HasMember("size") || !doc["size"].IsUint64() ||
+				!doc.HasMember("hash") || !doc["hash"].IsString() ||
+				!doc.HasMember("etag") || !doc["etag"].IsString())
+			{
+				return {};
+			}
+
+			const auto hash = utils::cryptography::sha1::digest::from_hex({doc["hash"].GetString(), doc["hash"].GetStringLength()});
+			if (!hash)
+			{
+				return {};
+			}
+
+			part_info info{};
+			info.size = doc["size"].GetUint64();
+			info.hash = *hash;
+			info.etag.assign(doc["etag"].GetString(), doc["etag"].GetStringLength());
+
+			if (doc.HasMember("segments") && doc["segments"].IsArray())
+			{
+				for (const auto& segment : doc["segments"].GetArray())
+				{
+					if (!segment.IsUint64())
+					{
+						return {};
+					}
+
+					info.segments.emplace_back(segment.GetUint64());
+				}
+			}
+
+			return info;
+		}
+
+		void store_part_info(const std::string& part_file, const part_info& info)
 		{
-			this->cleanup_directories(files);
+			rapidjson::Document doc{};
+			doc.SetObject();
+
+			const auto hash = info.hash.to_hex();
+
+			doc.AddMember("size", static_cast<uint64_t>(info.size), doc.GetAllocator());
+			doc.AddMember("hash", hash, doc.GetAllocator());
+			doc.AddMember("etag", info.etag, doc.GetAllocator());
+
+			if (!info.segments.empty())
+			{
+				rapidjson::Value segments{};
+				segments.SetArray();
+
+				for (const auto segment : info.segments)
+				{
+					segments.PushBack(static_cast<uint64_t>(segment), doc.GetAllocator());
+				}
+
+				doc.AddMember("segments", segments, doc.GetAllocator());
+			}
+
+			rapidjson::StringBuffer buffer{};
+			rapidjson::Writer<rapidjson::StringBuffer, rapidjson::Document::EncodingType, rapidjson::ASCII<>>
+				writer(buffer);
+			doc.Accept(writer);
+
+			utils::io::write_file(get_part_info_file(part_file), std::string(buffer.GetString(), buffer.GetLength()));
 		}
 
-		const auto outdated_files = this->get_outdated_files(files);
-		if (outdated_files.empty())
+		void remove_part_file(const std::string& part_file)
 		{
-			return;
+			utils::io::remove_file(part_file);
+			utils::io::remove_file(get_part_info_file(part_file));
+			utils::io::remove_file(get_part_patch_file(part_file));
 		}
 
-		this->update_host_binary(outdated_files);
-		this->update_files(outdated_files);
-	}
+		bool read_file_into(const std::string& file, const size_t length, utils::http::sink& sink)
+		{
+			std::ifstream stream(file, std::ios::binary);
+			if (!stream.is_open())
+			{
+				return false;
+			}
 
-	void file_updater::update_file(const file_info& file, bool iw4x_file) const
-	{
-		auto url = get_update_folder() + file.name;
-		utils::logger::write("Updating file {}", url);
+			std::string buffer{};
+			buffer.resize(0x10000);
 
-		if (iw4x_file)
+			auto remaining = length;
+			while (remaining > 0)
+			{
+				const auto chunk = std::min(remaining, buffer.size());
+				if (!stream.read(buffer.data(), static_cast<std::streamsize>(chunk)))
+				{
+					return false;
+				}
+
+				sink.write(buffer.data(), chunk);
+				remaining -= chunk;
+			}
+
+			return true;
+		}
+
+		// Passes data on to the part file and its hash, and starts both over when the server
+		// answers a range request with the full body instead of the requested range
+		class resume_sink final : public utils::http::sink
 		{
-			url = file.name;
-			utils::logger::write("This is an iw4x file, the url has been changed to {} instead", url);
+		public:
+			resume_sink(utils::http::file_sink& file_sink, utils::http::hash_sink& hash_sink, std::string part_file,
+			            part_info info, const size_t offset, const bool resumable)
+				: file_sink_(file_sink)
+				, hash_sink_(hash_sink)
+				, part_file_(std::move(part_file))
+				, info_(std::move(info))
+				, offset_(offset)
+				, resumable_(resumable)
+			{
+			}
+
+			void begin(const utils::http::response& response) override
+			{
+				if (this->offset_ > 0 && response.code != 206)
+				{
+					utils::logger::write("Range request for {} was not honored, restarting download", this->part_file_);
+
+					this->file_sink_.truncate();
+					this->hash_sink_.reset();
+					this->offset_ = 0;
+				}
+
+				if (!this->resumable_)
+				{
+					return;
+				}
+
+				const auto etag = response.headers.find("etag");
+				this->info_.etag = etag != response.headers.end() ? etag->second : std::string{};
+
+				store_part_info(this->part_file_, this->info_);
+			}
+
+			void write(const void* data, const size_t length) override
+			{
+				this->file_sink_.write(data, length);
+				this->hash_sink_.write(data, length);
+			}
+
+			size_t get_offset() const
+			{
+				return this->offset_;
+			}
+
+		private:
+			utils::http::file_sink& file_sink_;
+			utils::http::hash_sink& hash_sink_;
+			std::string part_file_;
+			part_info info_;
+			size_t offset_;
+			bool resumable_;
+		};
+
+		bool preallocate_file(const std::string& file, const size_t size)
+		{
+			const auto pos = file.find_last_of("/\\");
+			if (pos != std::string::npos)
+			{
+				utils::io::create_directory(file.substr(0, pos));
+			}
+
+			std::ofstream stream(file, std::ios::binary | std::ios::out | std::ios::trunc);
+			if (!stream.is_open())
+			{
+				return false;
+			}
+
+			stream.close();
+
+			std::error_code code{};
+			std::filesystem::resize_file(file, size, code);
+			return !code;
 		}
 
-		const auto data = utils::http::get_data(url, {}, [&](const size_t progress)
+		// Servers may label .gz files with Content-Encoding: gzip, fetch decodes those by itself
+		class gzip_file_sink final : public utils::http::sink
 		{
-			this->listener_.file_progress(file, progress);
-		});
+		public:
+			explicit gzip_file_sink(utils::http::sink& output)
+				: output_(output)
+			{
+			}
+
+			void begin(const utils::http::response& response) override
+			{
+				if (!response.headers.contains("content-encoding"))
+				{
+					this->decoder_.emplace(this->output_);
+				}
+
+				this->output_.begin(response);
+			}
 
-		// IW4x files have invalid hash and size for now
-		if (!data || (!iw4x_file && (data->size() != file.size || get_hash(*data) != file.hash)))
+			void write(const void* data, const size_t length) override
+			{
+				if (this->decoder_)
+				{
+					this->decoder_->write(data, length);
+				}
+				else
+				{
+					this->output_.write(data, length);
+				}
+			}
+
+			bool is_complete() const
+			{
+				return !this->decoder_ || this->decoder_->is_complete();
+			}
+
+		private:
+			utils::http::sink& output_;
+			std::optional<utils::http::inflate_sink> decoder_{};
+		};
+
+		class range_not_supported : public std::runtime_error
 		{
-			throw std::runtime_error("Failed to download: " + url);
+		public:
+			range_not_supported()
+				: std::runtime_error("Range requests are not supported")
+			{
+			}
+		};
+
+		// Writes one byte range of a download at its offset into the preallocated part file
+		class segment_sink final : public utils::http::sink
+		{
+		public:
+			segment_sink(const std::string& file, segment& segment, std::atomic<size_t>& progress,
+			             utils::concurrency::container<std::string>& etag)
+				: segment_(segment)
+				, progress_(progress)
+				, etag_(etag)
+			{
+				this->stream_.open(file, std::ios::binary | std::ios::in | std::ios::out);
+				this->stream_.seekp(static_cast<std::streamoff>(segment.start + segment.written));
+			}
+
+			void begin(const utils::http::response& response) override
+			{
+				if (response.code != 206)
+				{
+					throw range_not_supported();
+				}
+
+				const auto etag = response.headers.find("etag");
+				if (etag != response.headers.end())
+				{
+					this->etag_.access([&](std::string& value)
+					{
+						value = etag->second;
+					});
+				}
+			}
+
+			void write(const void* data, const size_t length) override
+			{
+				if (this->segment_.written + length > this->segment_.length)
+				{
+					throw std::runtime_error("Server sent more data than requested");
+				}
+
+				this->stream_.write(static_cast<const char*>(data), static_cast<std::streamsize>(length));
+				if (this->stream_.fail())
+				{
+					throw std::runtime_error("Failed to write downloaded data to disk");
+				}
+
+				this->segment_.written += length;
+				this->progress_ += length;
+			}
+
+			bool is_open() const
+			{
+				return this->stream_.is_open();
+			}
+
+			bool close()
+			{
+				this->stream_.close();
+				return !this->stream_.fail();
+			}
+
+		private:
+			std::fstream stream_{};
+			segment& segment_;
+			std::atomic<size_t>& progress_;
+			utils::concurrency::container<std::string>& etag_;
+		};
+
+		using range_fetcher = std::function<utils::coroutine::task<void>(size_t index, const std::atomic_bool& failed)>;
+
+		// Spreads the ranges over a few requests, each of them fetches its share one after another. The first failure
+		// stops the remaining ranges and is rethrown once every request returned.
+		utils::coroutine::task<void> run_range_requests(const size_t range_count, const range_fetcher& fetch_range)
+		{
+			std::atomic_bool failed{false};
+			utils::concurrency::container<std::exception_ptr> exception{};
+
+			const auto request_count = std::min(max_range_requests, range_count);
+
+			const auto run_requests = [&](const size_t first) -> utils::coroutine::task<void>
+			{
+				try
+				{
+					for (auto i = first; i < range_count && !failed; i += request_count)
+					{
+						co_await fetch_range(i, failed);
+					}
+				}
+				catch (...)
+				{
+					exception.access([](std::exception_ptr& ptr)
+					{
+						if (!ptr)
+						{
+							ptr = std::current_exception();
+						}
+					});
+
+					failed = true;
+				}
+			};
+
+			std::vector<utils::coroutine::task<void>> tasks{};
+			for (size_t i = 0; i < request_count; ++i)
+			{
+				tasks.emplace_back(run_requests(i));
+			}
+
+			co_await utils::coroutine::when_all(std::move(tasks));
+
+			exception.access([](const std::exception_ptr& ptr)
+			{
+				if (ptr)
+				{
+					std::rethrow_exception(ptr);
+				}
+			});
 		}
 
-		auto out_file = this->get_drive_filename(file);
+		struct chunk_check
+		{
+			std::vector<size_t> damaged_chunks{};
+			utils::cryptography::sha1::digest hash{};
+		};
 
-		// IW4x hack to fetch release from github
-		if (iw4x_file)
+		// Hashes the chunks of a file on every core and returns the indices of the chunks that do not match.
+		// The whole file is hashed alongside from the same mapping, only that hash tells if the file is intact.
+		std::optional<chunk_check> check_chunks(const std::string& path, const file_info& file)
 		{
-			out_file = this->base_ + std::filesystem::path(file.name).filename().string();
+			const utils::io::mapped_file mapping{path};
+			if (!mapping.is_valid() || mapping.size() != file.size)
+			{
+				return {};
+			}
+
+			const auto chunk_count = file.chunk_hashes.size();
+			const auto thread_count = std::max(size_t(1), std::min(size_t(std::thread::hardware_concurrency()), chunk_count));
+
+			chunk_check result{};
+
+			// One byte per chunk, vector<bool> would have the threads share words. Every thread takes a contiguous
+			// block of chunks, so it reads the mapping front to back and writes its own part of the flags.
+			const auto chunks_per_thread = (chunk_count + thread_count - 1) / thread_count;
+			std::vector<uint8_t> damaged(chunk_count, 0);
+			std::vector<std::thread> threads{};
+
+			threads.emplace_back([&]()
+			{
+				result.hash = utils::cryptography::sha1::compute(mapping.data(), mapping.size());
+			});
+
+			for (size_t i = 0; i * chunks_per_thread < chunk_count; ++i)
+			{
+				threads.emplace_back([&, i]()
+				{
+					std::vector<size_t> indices{};
+					std::vector<std::string_view> chunks{};
+
+					const auto end = std::min(chunk_count, (i + 1) * chunks_per_thread);
+					for (auto index = i * chunks_per_thread; index < end; ++index)
+					{
+						const auto start = index * file.chunk_size;
+						const auto length = std::min(file.chunk_size, file.size - start);
+
+						indices.emplace_back(index);
+						chunks.emplace_back(reinterpret_cast<const char*>(mapping.data()) + start, length);
+					}
+
+					const auto hashes = utils::cryptography::sha1::compute_many(chunks);
+					for (size_t j = 0; j < indices.size(); ++j)
+					{
+						damaged[indices[j]] = hashes[j] != file.chunk_hashes[indices[j]] ? 1 : 0;
+					}
+				});
+			}
+
+			for (auto& thread : threads)
+			{
+				if (thread.joinable())
+				{
+					thread.join();
+				}
+			}
+
+			for (size_t i = 0; i < chunk_count; ++i)
+			{
+				if (damaged[i])
+				{
+					result.damaged_chunks.emplace_back(i);
+				}
+			}
+
+			return {std::move(result)};
 		}
 
-		utils::logger::write("Writing file to {} ", out_file);
+		bool write_reused_chunks(const std::string& part_file, const delta_plan& plan, const uint8_t* local)
+		{
+			std::fstream stream(part_file, std::ios::binary | std::ios::in | std::ios::out);
+			if (!stream.is_open())
+			{
+				return false;
+			}
+
+			for (const auto& chunk : plan.reused)
+			{
+				stream.seekp(static_cast<std::streamoff>(chunk.offset));
+				stream.write(reinterpret_cast<const char*>(local + chunk.local_offset), chunk.length);
+			}
+
+			stream.close();
+			return !stream.fail();
+		}
+
+		// Splits a pack, or a range of it, into the part files of its members while it streams. Received data is
+		// written and hashed right away, the pack itself is never held in memory or on disk.
+		class pack_sink final : public utils::http::sink
+		{
+		public:
+			using progress_callback = std::function<void(const file_info&, size_t)>;
+
+			pack_sink(const std::span<pack_member> members, const std::optional<uint64_t> range_start, progress_callback callback)
+				: members_(members)
+				, range_start_(range_start)
+				, callback_(std::move(callback))
+			{
+			}
+
+			void begin(const utils::http::response& response) override
+			{
+				if (this->range_start_ && response.code != 206)
+				{
+					throw range_not_supported();
+				}
+
+				this->file_.reset();
+				this->current_ = 0;
+				this->position_ = this->range_start_.value_or(0);
+			}
+
+			void write(const void* data, size_t length) override
+			{
+				const auto* bytes = static_cast<const uint8_t*>(data);
+
+				while (length > 0 && this->current_ < this->members_.size())
+				{
+					auto& member = this->members_[this->current_];
+					const auto end = member.offset + member.file.size;
+
+					// Overlapping members can not be split in one pass, they are downloaded on their own
+					if (!this->file_ && this->position_ > member.offset)
+					{
+						++this->current_;
+						continue;
+					}
+
+					const auto inside = this->position_ >= member.offset;
+					const auto count = static_cast<size_t>(std::min<uint64_t>(length, (inside ? end : member.offset) - this->position_));
+
+					if (inside)
+					{
+						if (!this->file_)
+						{
+							this->open(member);
+						}
+
+						this->file_->write(bytes, count);
+						this->hash_.write(bytes, count);
+						this->callback_(member.file, static_cast<size_t>(this->position_ + count - member.offset));
+					}
+
+					bytes += count;
+					length -= count;
+					this->position_ += count;
+
+					if (this->position_ == end)
+					{
+						member.verified = this->file_->close() && this->file_->get_size() == member.file.size
+							&& this->hash_.get_hash() == member.file.hash;
+
+						this->file_.reset();
+						++this->current_;
+					}
+				}
+			}
+
+		private:
+			std::span<pack_member> members_;
+			std::optional<uint64_t> range_start_;
+			progress_callback callback_;
+
+			size_t current_{0};
+			uint64_t position_{0};
+			std::optional<utils::http::file_sink> file_{};
+			utils::http::hash_sink hash_{};
+
+			void open(pack_member& member)
+			{
+				member.verified = false;
+
+				this->file_.emplace(member.part_file);
+				if (!this->file_->is_open())
+				{
+					throw std::runtime_error("Failed to write: " + member.file.name);
+				}
+
+				this->hash_.reset();
+			}
+		};
+
+		std::string get_part_target(const std::string& file)
+		{
+			for (const auto* extension : {PART_INFO_FILE_EXTENSION, PART_FILE_EXTENSION})
+			{
+				const std::string_view suffix{extension};
+				if (file.ends_with(suffix))
+				{
+					return file.substr(0, file.size() - suffix.size());
+				}
+			}
+
+			return {};
+		}
+	}
+
+	file_updater::file_updater(progress_listener& listener, std::string base, std::string process_file)
+		: listener_(listener)
+		, base_(std::move(base))
+		, process_file_(std::move(process_file))
+		, hash_cache_(base_ + HASH_CACHE_FILE)
+		, object_store_(base_ + OBJECT_STORE_DIRECTORY, max_object_store_size)
+		, http_cache_(base_ + HTTP_CACHE_DIRECTORY)
+	{
+		utils::http::cache_policy release_policy{};
+		release_policy.max_age = release_check_max_age;
+		release_policy.use_stale_on_error = true;
+		this->http_cache_.set_policy(GITHUB_API_URL, release_policy);
+
+		this->dead_process_file_ = this->process_file_ + ".old";
+		this->delete_old_process_file();
+	}
+
+	void file_updater::run() const
+	{
+		// The manifest is fetched while the install is being enumerated
+		auto pending_files = std::async(std::launch::async, get_file_table, std::cref(this->http_cache_));
+
+		const auto applied_files = is_full_verify() ? std::optional<file_table>{} : this->load_applied_manifest();
+
+		// The install is enumerated once, cleanup and the outdated checks are answered from it
+		filesystem_snapshot snapshot{this->base_, {"data"}};
+
+		const auto files = pending_files.get();
+
+		auto manifest_changed = true;
+		if (!files.empty() && applied_files)
+		{
+			const auto diff = diff_manifests(*applied_files, files);
+			utils::logger::write("Manifest changes since the last update: {} added, {} changed, {} removed, {} unchanged",
+			                     diff.added.size(), diff.changed.size(), diff.removed.size(), diff.unchanged);
+
+			// Removed files keep their previous version, the pass over the snapshot then catches files that
+			// were placed in data/ since the last run. It needs no disk access beyond the removals.
+			this->cleanup_removed_files(diff.removed, snapshot);
+			this->cleanup_directories(files, snapshot);
+
+			// Unchanged files are still checked below, they may have been modified or deleted since the last run.
+			// Their check is answered from the snapshot and the hash cache, so it reads nothing unless they were.
+			manifest_changed = !diff.empty();
+		}
+		else if (!files.empty())
+		{
+			this->cleanup_directories(files, snapshot);
+		}
+
+		// Also picks up whatever a previous run did not get to delete
+		trash::empty(this->base_ + TRASH_DIRECTORY);
+
+		// A new host binary relaunches the updater, so it has to be settled before any other download starts
+		const auto host_file = find_host_file(files);
+		if (host_file)
+		{
+			const auto file = files.get_file_info(*host_file);
+			if (this->is_outdated_file(file, snapshot))
+			{
+				this->update_host_binary({file});
+			}
+		}
+
+		this->update_outdated_files(files, snapshot);
+		this->hash_cache_.save();
+		this->object_store_.collect_garbage();
+
+		utils::logger::write("Scanned {} entries with {} system calls, saving about {} system calls", snapshot.get_entry_count(),
+		                     snapshot.get_system_calls(), snapshot.get_saved_system_calls());
+
+		// Only reached once every file matches, so the next run can start from this manifest
+		if (!files.empty() && manifest_changed)
+		{
+			this->store_applied_manifest(files);
+		}
+	}
+
+	std::optional<file_table> file_updater::load_applied_manifest() const
+	{
+		std::string data{};
+		if (!utils::io::read_file(this->base_ + APPLIED_MANIFEST_FILE, &data))
+		{
+			return {};
+		}
+
+		const auto manifest = utils::manifest::binary_manifest::parse(data.data(), data.size());
+		if (!manifest)
+		{
+			utils::logger::write("Discarding corrupted applied manifest");
+			return {};
+		}
+
+		auto table = load_file_table(*manifest);
+		if (!table)
+		{
+			utils::logger::write("Discarding invalid applied manifest");
+		}
+
+		return table;
+	}
+
+	void file_updater::store_applied_manifest(const file_table& files) const
+	{
+		try
+		{
+			const auto file = this->base_ + APPLIED_MANIFEST_FILE;
+			const auto temp_file = file + ".tmp";
+
+			if (!utils::io::write_file(temp_file, write_binary_manifest(files)) || !utils::io::move_file(temp_file, file, true))
+			{
+				utils::logger::write("Failed to store the applied manifest");
+			}
+		}
+		catch (const std::exception& e)
+		{
+			utils::logger::write("Failed to store the applied manifest: {}", e.what());
+		}
+	}
+
+	utils::coroutine::task<void> file_updater::update_file(const file_info& file, bool iw4x_file) const
+	{
+		auto url = get_update_folder() + file.name;
+		utils::logger::write("Updating file {}", url);
+
+		if (iw4x_file)
+		{
+			url = file.name;
+			utils::logger::write("This is an iw4x file, the url has been changed to {} instead", url);
+		}
+
+		auto out_file = this->get_drive_filename(file);
+
+		// IW4x hack to fetch release from github
+		if (iw4x_file)
+		{
+			out_file = this->base_ + std::filesystem::path(file.name).filename().string();
+		}
+
+		// Stream the body into a temporary file and only move it into place once it is verified
+		const auto part_file = out_file + PART_FILE_EXTENSION;
+		utils::logger::write("Writing file to {} ", part_file);
+
+		// Workers are resumed by the network thread, the object store and the local copy are disk work
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		// A version that was seen before is linked back from the object store instead of being repaired
+		const auto downloaded = !iw4x_file && (this->restore_file(file, part_file)
+			|| co_await this->repair_file(file, url, out_file, part_file)
+			|| co_await this->download_patch(file, out_file, part_file)
+			|| co_await this->download_file_delta(file, url, out_file, part_file)
+			|| co_await this->download_file_compressed(file, part_file));
+
+		// IW4x files have invalid hash and size for now, so they can not be split into segments
+		if (!downloaded && (iw4x_file || file.size < segmented_download_threshold
+			|| !co_await this->download_file_segmented(file, url, part_file)))
+		{
+			co_await this->download_file(file, url, part_file, iw4x_file);
+		}
+
+		// Moving the file and keeping the previous version must not stall the transfers still in flight
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		if (!iw4x_file)
+		{
+			this->keep_previous_version(out_file);
+		}
+
+		if (!utils::io::move_file(part_file, out_file, true))
+		{
+			remove_part_file(part_file);
+			throw std::runtime_error("Failed to write: " + file.name);
+		}
+
+		utils::io::remove_file(get_part_info_file(part_file));
+
+		if (!iw4x_file)
+		{
+			this->remember_file(file, out_file);
+		}
+
+		utils::logger::write("Done updating file {}", file.name);
+	}
+
+	// Takes outdated small files from the packs they were published in, a few requests replace one request per file.
+	// Files no pack covers or that failed to download are returned, they are updated on their own.
+	utils::coroutine::task<std::vector<file_info>> file_updater::update_packed_files(std::vector<file_info> files) const
+	{
+		const auto index_url = get_update_folder() + utils::pack::directory + utils::pack::index_name;
+		const auto index_data = co_await this->http_cache_.get(index_url);
+		const auto index = index_data ? utils::pack::parse_index(index_data->data(), index_data->size()) : std::nullopt;
+		if (!index)
+		{
+			utils::logger::write("No valid pack index at {}, downloading {} small files one by one", index_url, files.size());
+			co_return std::move(files);
+		}
+
+		std::vector<file_info> remaining{};
+		std::unordered_map<uint32_t, pack_plan> packs{};
+
+		for (auto& file : files)
+		{
+			const auto* member = index->find(file.hash);
+			if (!member || member->length != file.size)
+			{
+				remaining.emplace_back(std::move(file));
+				continue;
+			}
+
+			auto out_file = this->get_drive_filename(file);
+			auto part_file = out_file + PART_FILE_EXTENSION;
+			packs[member->pack].members.emplace_back(pack_member{std::move(file), std::move(out_file), std::move(part_file), member->offset, false});
+		}
+
+		for (auto pack = packs.begin(); pack != packs.end();)
+		{
+			auto& plan = pack->second;
+			plan_pack(plan, index->packs[pack->first].size);
+
+			if (is_pack_worthwhile(plan))
+			{
+				++pack;
+				continue;
+			}
+
+			for (auto& member : plan.members)
+			{
+				remaining.emplace_back(std::move(member.file));
+			}
+
+			pack = packs.erase(pack);
+		}
+
+		const auto progress = [this](const file_info& file, const size_t value)
+		{
+			this->report_progress(file, value);
+		};
+
+		const auto fetch_pack = [&](const std::string& url, pack_sink& sink, const utils::http::headers& headers) -> utils::coroutine::task<void>
+		{
+			try
+			{
+				if (!co_await utils::http::fetch(url, sink, headers))
+				{
+					utils::logger::write("Failed to download {}", url);
+				}
+			}
+			catch (const update_cancelled&)
+			{
+				throw;
+			}
+			catch (const range_not_supported&)
+			{
+				throw;
+			}
+			catch (const std::exception& e)
+			{
+				utils::logger::write("Failed to download {}: {}", url, e.what());
+			}
+		};
+
+		const auto download_pack = [&](const utils::pack::pack& pack, pack_plan& plan) -> utils::coroutine::task<void>
+		{
+			const auto url = get_update_folder() + utils::pack::directory + utils::pack::get_name(pack.hash);
+
+			for (const auto& member : plan.members)
+			{
+				this->listener_.begin_file(member.file);
+			}
+
+			auto whole_pack = plan.whole_pack;
+
+			if (!whole_pack)
+			{
+				utils::logger::write("Fetching {} small files from {} in {} ranges ({} bytes)", plan.members.size(), url,
+				                     plan.ranges.size(), plan.range_size);
+
+				// Members that fail are downloaded on their own later, only missing range support stops the pack
+				const auto fetch_range = [&](const size_t index, const std::atomic_bool&) -> utils::coroutine::task<void>
+				{
+					const auto& range = plan.ranges[index];
+					pack_sink sink{std::span(plan.members).subspan(range.first_member, range.member_count), range.start, progress};
+
+					utils::http::headers headers{};
+					headers["Range"] = "bytes=" + std::to_string(range.start) + "-" + std::to_string(range.end - 1);
+
+					co_await fetch_pack(url, sink, headers);
+				};
+
+				try
+				{
+					co_await run_range_requests(plan.ranges.size(), fetch_range);
+				}
+				catch (const range_not_supported&)
+				{
+					utils::logger::write("Server does not support range requests for {}, downloading the whole pack", url);
+					whole_pack = true;
+				}
+			}
+			else
+			{
+				utils::logger::write("Fetching {} small files from the whole pack {} ({} bytes)", plan.members.size(), url, pack.size);
+			}
+
+			if (whole_pack)
+			{
+				pack_sink sink{plan.members, std::nullopt, progress};
+				co_await fetch_pack(url, sink, {});
+			}
+		};
+
+		std::vector<utils::coroutine::task<void>> tasks{};
+		for (auto& [pack, plan] : packs)
+		{
+			tasks.emplace_back(download_pack(index->packs[pack], plan));
+		}
+
+		co_await utils::coroutine::when_all(std::move(tasks));
+
+		// Moving files into place blocks
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		size_t packed_count = 0;
+		for (auto& [pack, plan] : packs)
+		{
+			for (auto& member : plan.members)
+			{
+				if (!member.verified)
+				{
+					remove_part_file(member.part_file);
+					remaining.emplace_back(std::move(member.file));
+					continue;
+				}
+
+				this->keep_previous_version(member.out_file);
+
+				if (!utils::io::move_file(member.part_file, member.out_file, true))
+				{
+					remove_part_file(member.part_file);
+					throw std::runtime_error("Failed to write: " + member.file.name);
+				}
+
+				this->remember_file(member.file, member.out_file);
+				this->listener_.end_file(member.file);
+				++packed_count;
+			}
+		}
+
+		utils::logger::write("Updated {} small files from {} packs, {} are downloaded on their own", packed_count, packs.size(), remaining.size());
+		co_return std::move(remaining);
+	}
+
+	void file_updater::remember_file(const file_info& file, const std::string& out_file) const
+	{
+		const auto metadata = utils::io::get_file_metadata(out_file);
+		if (metadata)
+		{
+			this->hash_cache_.store(out_file, *metadata, file.hash);
+		}
+
+		this->object_store_.add(file.hash, out_file, false);
+	}
+
+	utils::coroutine::task<void> file_updater::download_file(const file_info& file, const std::string& url, const std::string& part_file, const bool iw4x_file) const
+	{
+		// IW4x files have invalid hash and size for now, so they can not be resumed
+		const auto resumable = !iw4x_file;
+
+		part_info info{};
+		info.size = file.size;
+		info.hash = file.hash;
+
+		size_t offset = 0;
+		utils::http::headers headers{};
+		utils::http::hash_sink hash_sink{};
+
+		// Offsets and the stored ETag have to refer to the file itself, not to an encoding the server picked
+		if (resumable)
+		{
+			headers["Accept-Encoding"] = "identity";
+		}
+
+		const auto existing_info = resumable ? load_part_info(part_file) : std::optional<part_info>{};
+		const auto existing_size = existing_info ? utils::io::file_size(part_file) : 0;
+
+		// Hashing the existing part would otherwise stall every other transfer
+		if (existing_info && existing_size > 0)
+		{
+			co_await utils::coroutine::switch_to_blocking_pool();
+		}
+
+		if (existing_info && existing_info->size == file.size && existing_info->hash == file.hash
+			&& !existing_info->etag.empty() && existing_info->segments.empty()
+			&& existing_size > 0 && existing_size < file.size
+			&& read_file_into(part_file, existing_size, hash_sink))
+		{
+			utils::logger::write("Resuming download of {} at {} bytes", file.name, existing_size);
+
+			offset = existing_size;
+			info.etag = existing_info->etag;
+
+			headers["Range"] = "bytes=" + std::to_string(offset) + "-";
+			headers["If-Range"] = existing_info->etag;
+		}
+		else
+		{
+			hash_sink.reset();
+		}
+
+		utils::http::file_sink file_sink{part_file, offset > 0};
+		if (!file_sink.is_open())
+		{
+			throw std::runtime_error("Failed to write: " + file.name);
+		}
+
+		resume_sink sink{file_sink, hash_sink, part_file, std::move(info), offset, resumable};
+
+		bool result = false;
+
+		try
+		{
+			result = co_await utils::http::fetch(url, sink, headers, [&](const size_t progress)
+			{
+				this->report_progress(file, sink.get_offset() + progress);
+			});
+		}
+		catch (...)
+		{
+			// Keep what we have for the next run, the update might have been cancelled
+			file_sink.close();
+			if (!resumable)
+			{
+				remove_part_file(part_file);
+			}
+
+			throw;
+		}
+
+		if (!file_sink.close() || !result)
+		{
+			if (!resumable)
+			{
+				remove_part_file(part_file);
+			}
+
+			throw std::runtime_error("Failed to download: " + url);
+		}
+
+		const auto size = sink.get_offset() + file_sink.get_size();
+		if (!iw4x_file && (size != file.size || hash_sink.get_hash() != file.hash))
+		{
+			remove_part_file(part_file);
+			throw std::runtime_error("Failed to download: " + url);
+		}
+	}
+
+	// Fetches the gzip variant of the file and decompresses it while it streams into the part file and the hash
+	utils::coroutine::task<bool> file_updater::download_file_compressed(const file_info& file, const std::string& part_file) const
+	{
+		// The variant can not be resumed, an interrupted plain download is continued instead
+		if (file.compressed_size == 0 || utils::io::file_exists(get_part_info_file(part_file)))
+		{
+			co_return false;
+		}
+
+		const auto url = get_update_folder() + utils::manifest::compressed_directory + file.name
+			+ utils::manifest::compressed_extension;
+
+		utils::http::file_sink file_sink{part_file, false};
+		if (!file_sink.is_open())
+		{
+			co_return false;
+		}
+
+		utils::http::hash_sink hash_sink{};
+		resume_sink output{file_sink, hash_sink, part_file, {}, 0, false};
+		gzip_file_sink sink{output};
+
+		bool result = false;
+
+		try
+		{
+			result = co_await utils::http::fetch(url, sink, {}, [&](const size_t)
+			{
+				this->report_progress(file, file_sink.get_size());
+			});
+		}
+		catch (const update_cancelled&)
+		{
+			file_sink.close();
+			remove_part_file(part_file);
+			throw;
+		}
+		catch (const std::exception& e)
+		{
+			utils::logger::write("Failed to decompress {}: {}", url, e.what());
+		}
+
+		if (!file_sink.close() || !result || !sink.is_complete() || file_sink.get_size() != file.size
+			|| hash_sink.get_hash() != file.hash)
+		{
+			utils::logger::write("Compressed download of {} failed, downloading the file instead", file.name);
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		utils::logger::write("Downloaded {} with {} bytes instead of {}", file.name, file.compressed_size, file.size);
+		co_return true;
+	}
+
+	// Fetches what is missing of every range into the preallocated part file. A known etag is sent along, so ranges
+	// of a file that changed in the meantime are refused, the etag of the responses is stored back.
+	utils::coroutine::task<void> file_updater::fetch_ranges(const file_info& file, const std::string& url, const std::string& part_file,
+	                                                        std::vector<segment>& ranges, utils::concurrency::container<std::string>& etag) const
+	{
+		std::atomic<size_t> progress{file.size};
+		for (const auto& range : ranges)
+		{
+			progress -= range.length - range.written;
+		}
+
+		const auto if_range = etag.get_raw();
+
+		const auto fetch_range = [&](const size_t index, const std::atomic_bool& failed) -> utils::coroutine::task<void>
+		{
+			auto& range = ranges[index];
+			if (range.written >= range.length)
+			{
+				co_return;
+			}
+
+			segment_sink sink{part_file, range, progress, etag};
+			if (!sink.is_open())
+			{
+				throw std::runtime_error("Failed to write: " + file.name);
+			}
+
+			const auto first_byte = range.start + range.written;
+			const auto last_byte = range.start + range.length - 1;
+
+			utils::http::headers headers{};
+			headers["Range"] = "bytes=" + std::to_string(first_byte) + "-" + std::to_string(last_byte);
+
+			if (!if_range.empty())
+			{
+				headers["If-Range"] = if_range;
+			}
+
+			const auto result = co_await utils::http::fetch(url, sink, headers, [&](const size_t)
+			{
+				if (failed)
+				{
+					throw std::runtime_error("Range download aborted");
+				}
+
+				this->report_progress(file, progress);
+			});
+
+			if (!sink.close() || !result || range.written != range.length)
+			{
+				throw std::runtime_error("Failed to download: " + url);
+			}
+		};
+
+		co_await run_range_requests(ranges.size(), fetch_range);
+	}
+
+	utils::coroutine::task<bool> file_updater::download_file_segmented(const file_info& file, const std::string& url, const std::string& part_file) const
+	{
+		auto segments = get_segments(file.size);
+
+		part_info info{};
+		info.size = file.size;
+		info.hash = file.hash;
+
+		const auto existing_info = load_part_info(part_file);
+		if (existing_info && existing_info->size == file.size && existing_info->hash == file.hash
+			&& !existing_info->etag.empty() && existing_info->segments.size() == segments.size()
+			&& utils::io::file_size(part_file) == file.size)
+		{
+			utils::logger::write("Resuming segmented download of {}", file.name);
+
+			info.etag = existing_info->etag;
+			for (size_t i = 0; i < segments.size(); ++i)
+			{
+				segments[i].written = std::min(existing_info->segments[i], segments[i].length);
+			}
+		}
+		else if (!preallocate_file(part_file, file.size))
+		{
+			throw std::runtime_error("Failed to write: " + file.name);
+		}
+
+		utils::logger::write("Downloading {} in {} segments", file.name, segments.size());
+
+		utils::concurrency::container<std::string> etag{};
+		etag.access([&](std::string& value)
+		{
+			value = info.etag;
+		});
+
+		std::exception_ptr exception{};
+
+		try
+		{
+			co_await this->fetch_ranges(file, url, part_file, segments, etag);
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+
+		info.etag = etag.get_raw();
+		for (const auto& segment : segments)
+		{
+			info.segments.emplace_back(segment.written);
+		}
+
+		store_part_info(part_file, info);
+
+		try
+		{
+			if (exception)
+			{
+				std::rethrow_exception(exception);
+			}
+		}
+		catch (const range_not_supported&)
+		{
+			utils::logger::write("Server does not support range requests for {}, falling back to a single stream", file.name);
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		utils::http::hash_sink hash_sink{};
+		if (!read_file_into(part_file, file.size, hash_sink) || hash_sink.get_hash() != file.hash)
+		{
+			remove_part_file(part_file);
+			throw std::runtime_error("Failed to download: " + url);
+		}
+
+		co_return true;
+	}
+
+	// Applies a published patch if the local copy is one of the versions it was made for
+	utils::coroutine::task<bool> file_updater::download_patch(const file_info& file, const std::string& out_file,
+	                                                          const std::string& part_file) const
+	{
+		if (file.patches.empty())
+		{
+			co_return false;
+		}
+
+		// The local hash is known from the scan, the file does not have to be read again to pick a patch
+		const auto metadata = utils::io::get_file_metadata(out_file);
+		const auto local_hash = metadata ? this->hash_cache_.find(out_file, *metadata) : std::nullopt;
+		if (!local_hash)
+		{
+			co_return false;
+		}
+
+		const auto patch = std::find_if(file.patches.begin(), file.patches.end(), [&](const utils::manifest::patch& entry)
+		{
+			return entry.source_hash == *local_hash;
+		});
+
+		// A patch that is not smaller than the file is not worth it
+		if (patch == file.patches.end() || patch->size == 0 || patch->size >= file.size)
+		{
+			co_return false;
+		}
+
+		const auto url = get_update_folder() + utils::patch::directory + utils::patch::get_name(patch->source_hash, file.hash);
+
+		// Game archives and their patches can be hundreds of megabytes, the patch goes to disk instead of memory
+		const auto patch_file = get_part_patch_file(part_file);
+		auto downloaded = false;
+
+		{
+			utils::http::file_sink sink{patch_file};
+			if (!sink.is_open())
+			{
+				co_return false;
+			}
+
+			const auto result = co_await utils::http::fetch(url, sink, {}, [&](const size_t progress)
+			{
+				// Reported relative to the patch, so the progress still ends at the size of the file
+				this->report_progress(file, static_cast<size_t>(std::min<uint64_t>(progress, patch->size) * file.size / patch->size));
+			});
+
+			const auto size = sink.get_size();
+			downloaded = sink.close() && result && size == patch->size;
+		}
+
+		if (!downloaded)
+		{
+			utils::logger::write("Failed to download the patch for {}, downloading the file instead", file.name);
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		// Reading the local file and applying the patch blocks
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		auto applied = false;
+
+		// Both inputs are mapped and the new file streams into the part file, none of them is held in memory.
+		// The mappings are closed again before the files are removed.
+		{
+			const utils::io::mapped_file old_file{out_file};
+			const utils::io::mapped_file patch_data{patch_file};
+
+			utils::http::file_sink file_sink{part_file};
+			utils::http::hash_sink hash_sink{};
+
+			if (old_file.is_valid() && patch_data.is_valid() && file_sink.is_open())
+			{
+				try
+				{
+					const std::string_view old_data{reinterpret_cast<const char*>(old_file.data()), old_file.size()};
+					const std::string_view patch_view{reinterpret_cast<const char*>(patch_data.data()), patch_data.size()};
+
+					applied = utils::patch::apply(old_data, patch_view, file.size, [&](const void* data, const size_t length)
+					{
+						file_sink.write(data, length);
+						hash_sink.write(data, length);
+					});
+				}
+				catch (const std::exception& e)
+				{
+					utils::logger::write("Failed to write the patched {}: {}", file.name, e.what());
+				}
+			}
+
+			applied = file_sink.close() && applied && hash_sink.get_hash() == file.hash;
+		}
+
+		if (!applied)
+		{
+			utils::logger::write("Patch for {} did not produce the expected file, downloading the file instead", file.name);
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		utils::io::remove_file(patch_file);
+
+		utils::logger::write("Patched {} with {} bytes instead of {}", file.name, patch->size, file.size);
+		co_return true;
+	}
+
+	// Rebuilds the file from the chunks the local copy already has, only the rest is fetched with range requests
+	utils::coroutine::task<bool> file_updater::download_file_delta(const file_info& file, const std::string& url,
+	                                                               const std::string& out_file, const std::string& part_file) const
+	{
+		// An interrupted download is resumed instead
+		if (file.size < utils::chunking::min_indexed_file_size || utils::io::file_size(out_file) == 0
+			|| utils::io::file_exists(get_part_info_file(part_file)))
+		{
+			co_return false;
+		}
+
+		utils::http::memory_sink index_sink{};
+		if (!co_await utils::http::fetch(url + utils::chunking::index_extension, index_sink))
+		{
+			co_return false;
+		}
+
+		const auto& index_data = index_sink.get_data();
+		const auto chunks = utils::chunking::parse_index(index_data.data(), index_data.size());
+		if (!chunks || chunks->empty() || chunks->back().offset + chunks->back().length != file.size)
+		{
+			utils::logger::write("Ignoring invalid chunk index of {}", file.name);
+			co_return false;
+		}
+
+		// Chunking and copying the local file blocks
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		delta_plan plan{};
+
+		{
+			const utils::io::mapped_file local{out_file};
+			if (!local.is_valid())
+			{
+				co_return false;
+			}
+
+			plan = plan_delta(*chunks, local.data(), local.size());
+
+			// Nothing worth reusing, a plain download is simpler
+			if (plan.missing_size == file.size)
+			{
+				co_return false;
+			}
+
+			if (!preallocate_file(part_file, file.size) || !write_reused_chunks(part_file, plan, local.data()))
+			{
+				remove_part_file(part_file);
+				co_return false;
+			}
+		}
+
+		utils::logger::write("Patching {}: reusing {} bytes, fetching {} bytes in {} ranges", file.name,
+		                     file.size - plan.missing_size, plan.missing_size, plan.missing.size());
+
+		utils::concurrency::container<std::string> etag{};
+
+		try
+		{
+			co_await this->fetch_ranges(file, url, part_file, plan.missing, etag);
+		}
+		catch (const range_not_supported&)
+		{
+			utils::logger::write("Server does not support range requests for {}, downloading the whole file", file.name);
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		// The index may belong to another version of the file than the manifest, only the file hash is trusted
+		utils::http::hash_sink hash_sink{};
+		if (!read_file_into(part_file, file.size, hash_sink) || hash_sink.get_hash() != file.hash)
+		{
+			utils::logger::write("Patched {} does not match its hash, downloading the whole file", file.name);
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		co_return true;
+	}
+
+	// Fetches only the damaged chunks found while checking the file and writes them into a copy of it
+	utils::coroutine::task<bool> file_updater::repair_file(const file_info& file, const std::string& url, const std::string& out_file,
+	                                                       const std::string& part_file) const
+	{
+		const auto damaged_chunks = this->damaged_chunks_.access<std::optional<std::vector<size_t>>>(
+			[&](std::unordered_map<std::string, std::vector<size_t>>& chunks) -> std::optional<std::vector<size_t>>
+			{
+				const auto entry = chunks.find(file.name);
+				if (entry == chunks.end())
+				{
+					return {};
+				}
+
+				auto result = std::move(entry->second);
+				chunks.erase(entry);
+				return {std::move(result)};
+			});
+
+		// An interrupted download is resumed instead
+		if (!damaged_chunks || damaged_chunks->empty() || utils::io::file_size(out_file) != file.size
+			|| utils::io::file_exists(get_part_info_file(part_file)))
+		{
+			co_return false;
+		}
+
+		// Copying blocks
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		// The chunks are written into a copy, the installed file stays intact until the result is verified
+		std::error_code code{};
+		if (!std::filesystem::copy_file(out_file, part_file, std::filesystem::copy_options::overwrite_existing, code) || code)
+		{
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		auto segments = get_damaged_segments(file, *damaged_chunks);
+
+		size_t damaged_size = 0;
+		for (const auto& segment : segments)
+		{
+			damaged_size += segment.length;
+		}
+
+		utils::logger::write("Repairing {} damaged chunks ({} bytes) of {}", damaged_chunks->size(), damaged_size, file.name);
+
+		utils::concurrency::container<std::string> etag{};
+
+		try
+		{
+			co_await this->fetch_ranges(file, url, part_file, segments, etag);
+		}
+		catch (const update_cancelled&)
+		{
+			remove_part_file(part_file);
+			throw;
+		}
+		catch (const range_not_supported&)
+		{
+			utils::logger::write("Server does not support range requests for {}, downloading the whole file", file.name);
+			remove_part_file(part_file);
+			co_return false;
+		}
+		catch (const std::exception& e)
+		{
+			utils::logger::write("Failed to repair {}: {}, downloading the whole file", file.name, e.what());
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		co_await utils::coroutine::switch_to_blocking_pool();
+
+		// Chunk hashes only cover what was damaged, the result has to match the whole file
+		utils::http::hash_sink hash_sink{};
+		if (!read_file_into(part_file, file.size, hash_sink) || hash_sink.get_hash() != file.hash)
+		{
+			utils::logger::write("Repaired {} does not match its hash, downloading the whole file", file.name);
+			remove_part_file(part_file);
+			co_return false;
+		}
+
+		co_return true;
+	}
+
+	bool file_updater::restore_file(const file_info& file, const std::string& part_file) const
+	{
+		if (!this->object_store_.materialize(file.hash, part_file))
+		{
+			return false;
+		}
+
+		utils::logger::write("Restored {} from the object store", file.name);
+		this->report_progress(file, file.size);
+
+		return true;
+	}
+
+	// Keeps the file in the object store before it is replaced or removed, if its hash is known from the scan
+	void file_updater::keep_previous_version(const std::string& path) const
+	{
+		const auto metadata = utils::io::get_file_metadata(path);
+		const auto hash = metadata ? this->hash_cache_.find(path, *metadata) : std::nullopt;
+		if (hash)
+		{
+			this->object_store_.add(*hash, path, true);
+		}
+	}
+
+	std::vector<file_info> file_updater::get_outdated_files(const file_table& files, const filesystem_snapshot& snapshot) const
+	{
+		std::vector<size_t> indices{};
+		this->find_outdated_files(files, snapshot, [&](const size_t index)
+		{
+			indices.emplace_back(index);
+			return true;
+		});
+
+		std::sort(indices.begin(), indices.end());
 
-		if (!utils::io::write_file(out_file, *data, false))
+		std::vector<file_info> outdated_files{};
+		outdated_files.reserve(indices.size());
+
+		for (const auto index : indices)
 		{
-			throw std::runtime_error("Failed to write: " + file.name);
+			outdated_files.emplace_back(files.get_file_info(index));
 		}
 
-		utils::logger::write("Done updating file {}", file.name);
+		return outdated_files;
 	}
 
-	std::vector<file_info> file_updater::get_outdated_files(const std::vector<file_info>& files) const
+	// Reports outdated files as soon as they are known, batched files only once their batch is hashed.
+	// Stops early once the callback returns false.
+	void file_updater::find_outdated_files(const file_table& files, const filesystem_snapshot& snapshot,
+	                                       const std::function<bool(size_t)>& callback) const
 	{
-		std::vector<file_info> outdated_files{};
+		auto stopped = false;
+		const auto report = [&](const size_t index)
+		{
+			stopped = stopped || !callback(index);
+		};
+
+		batch_hasher hasher{this->hash_cache_, [&](const size_t index, const utils::cryptography::sha1::digest& hash)
+		{
+			if (hash != files.get_hash(index))
+			{
+				report(index);
+			}
+		}};
 
-		for (const auto& info : files)
+		for (size_t i = 0; i < files.size() && !stopped; ++i)
 		{
-			if (this->is_outdated_file(info))
+			const auto file = files.get_file_info(i);
+
+			utils::io::file_metadata metadata{};
+			const auto cached_result = this->is_outdated_file_cached(file, snapshot, metadata);
+			if (cached_result)
+			{
+				if (*cached_result)
+				{
+					report(i);
+				}
+
+				continue;
+			}
+
+			if (file.size > max_batch_hash_file_size || !file.chunk_hashes.empty())
+			{
+				if (this->is_outdated_file(file, snapshot))
+				{
+					report(i);
+				}
+
+				continue;
+			}
+
+			if (!hasher.add(i, this->get_drive_filename(file), metadata, file.size))
 			{
-				outdated_files.emplace_back(info);
+				report(i);
 			}
 		}
 
-		return outdated_files;
+		if (!stopped)
+		{
+			hasher.flush();
+		}
 	}
 
 	void file_updater::update_host_binary(const std::vector<file_info>& outdated_files) const
@@ -253,7 +1820,7 @@ namespace updater
 		if (every_update_required || doc.HasMember("rawfile_version"))
 		{
 			utils::logger::write("Fetching iw4x-rawfiles tag from github...");
-			std::optional<std::string> rawfiles_tag = get_release_tag("https://api.github.com/repos/XLabsProject/iw4x-rawfiles/releases/latest");
+			std::optional<std::string> rawfiles_tag = utils::coroutine::sync_wait(this->get_release_tag(GITHUB_API_URL "repos/XLabsProject/iw4x-rawfiles/releases/latest"));
 			if (rawfiles_tag.has_value())
 			{
 				update_state.rawfile_requires_update = every_update_required || doc["rawfile_version"].GetString() != rawfiles_tag.value();
@@ -267,23 +1834,23 @@ namespace updater
 		return every_update_required || update_state.rawfile_requires_update;
 	}
 
-	std::optional<std::string> file_updater::get_release_tag(const std::string& release_url) const
+	utils::coroutine::task<std::optional<std::string>> file_updater::get_release_tag(std::string release_url) const
 	{
-		std::optional<std::string> iw4x_release_info = utils::http::get_data(release_url);
-		if (iw4x_release_info.has_value())
+		const auto release = co_await this->http_cache_.get(std::move(release_url));
+		if (release)
 		{
 			rapidjson::Document release_json{};
 			release_json.SetObject();
-			release_json.Parse(iw4x_release_info.value());
+			release_json.Parse(*release);
 
 			if (release_json.HasMember("tag_name"))
 			{
-				auto tag_name = release_json["tag_name"].GetString();
-				return tag_name;
+				std::string tag_name = release_json["tag_name"].GetString();
+				co_return tag_name;
 			}
 		}
 
-		return {};
+		co_return std::optional<std::string>{};
 	}
 
 	void file_updater::create_iw4x_version_file(std::string rawfile_version) const
@@ -477,92 +2044,418 @@ namespace updater
 	{
 		this->listener_.update_files(outdated_files);
 
-		const auto thread_count = get_optimal_concurrent_download_count(outdated_files.size());
+		const auto worker_count = this->restart_transfers();
+		const auto policy = get_scheduling_policy();
+		const auto actual_worker_count = std::min(worker_count, outdated_files.size());
 
-		std::vector<std::thread> threads{};
-		std::atomic<size_t> current_index{0};
+		utils::concurrency::container<std::unique_ptr<download_scheduler>> scheduler{};
+		scheduler.get_raw() = create_download_scheduler(policy, outdated_files, actual_worker_count);
 
-		utils::concurrency::container<std::exception_ptr> exception{};
+		std::atomic_bool failed{false};
+		const auto start_time = std::chrono::steady_clock::now();
 
-		for (size_t i = 0; i < thread_count; ++i)
+		// Workers only hold a slot while their transfer is in flight, no thread is blocked per download
+		const auto run_worker = [&](const size_t worker) -> utils::coroutine::task<void>
 		{
-			threads.emplace_back([&]()
+			while (!failed)
 			{
-				while (!exception.access<bool>([](const std::exception_ptr& ptr)
+				const auto index = scheduler.access<std::optional<size_t>>([worker](const std::unique_ptr<download_scheduler>& value)
+				{
+					return value->next(worker);
+				});
+
+				if (!index)
 				{
-					return static_cast<bool>(ptr);
-				}))
+					break;
+				}
+
+				try
+				{
+					const auto& file = outdated_files[*index];
+					this->listener_.begin_file(file);
+					co_await this->update_file(file, iw4x_files);
+					this->listener_.end_file(file);
+				}
+				catch (...)
+				{
+					failed = true;
+					throw;
+				}
+			}
+		};
+
+		std::vector<utils::coroutine::task<void>> workers{};
+		for (size_t i = 0; i < actual_worker_count; ++i)
+		{
+			workers.emplace_back(run_worker(i));
+		}
+
+		utils::coroutine::sync_wait(utils::coroutine::when_all(std::move(workers)));
+
+		const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+		utils::logger::write("Updated {} files in {} ms using the {} schedule", outdated_files.size(), duration.count(),
+		                     get_scheduling_policy_name(policy));
+
+		this->listener_.done_update();
+	}
+
+	// Downloads start while the scan is still running, every outdated file is queued as soon as it is found
+	void file_updater::update_outdated_files(const file_table& files, const filesystem_snapshot& snapshot) const
+	{
+		const auto policy = get_scheduling_policy();
+		const auto worker_count = this->restart_transfers();
+
+		download_queue queue{policy, worker_count};
+		std::atomic_bool failed{false};
+
+		// Small files go to the packer instead of the workers, it takes them from packs whenever a batch is full
+		download_queue pack_queue{policy, 1};
+		std::atomic<size_t> packed_count{0};
+
+		// Files with the same content as one that is already queued wait until that one is done,
+		// they are then linked from the object store instead of being downloaded again
+		struct content_state
+		{
+			bool done{};
+			std::vector<file_info> duplicates{};
+		};
+
+		utils::concurrency::container<std::unordered_map<utils::cryptography::sha1::digest, content_state>> contents{};
+		auto found_files = false;
+
+		const auto start_time = std::chrono::steady_clock::now();
+
+		const auto fail = [&]()
+		{
+			failed = true;
+			queue.close();
+			pack_queue.close();
+		};
+
+		// Returns the files that waited for the content, they can be taken from the object store from now on
+		const auto complete_content = [&](const utils::cryptography::sha1::digest& hash)
+		{
+			return contents.access<std::vector<file_info>>([&](auto& states)
+			{
+				auto& state = states[hash];
+				state.done = true;
+
+				return std::exchange(state.duplicates, {});
+			});
+		};
+
+		const auto scan = [&]() -> utils::coroutine::task<void>
+		{
+			// Hashing blocks, the workers must not wait for it
+			co_await utils::coroutine::switch_to_blocking_pool();
+
+			try
+			{
+				this->find_outdated_files(files, snapshot, [&](const size_t index)
 				{
-					const auto index = current_index++;
-					if (index >= outdated_files.size())
+					if (failed)
 					{
-						break;
+						return false;
 					}
 
-					try
+					auto file = files.get_file_info(index);
+
+					// The listener has to know about the file before a worker can begin it
+					if (!found_files)
 					{
-						const auto& file = outdated_files[index];
-						this->listener_.begin_file(file);
-						this->update_file(file, iw4x_files);
-						this->listener_.end_file(file);
+						found_files = true;
+
+						const auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+							std::chrono::steady_clock::now() - start_time);
+						utils::logger::write("First outdated file found after {} ms", delay.count());
+
+						this->listener_.update_files({});
 					}
-					catch (...)
+
+					this->listener_.add_file(file);
+
+					// Duplicates of content that is already done are queued like any other file
+					const auto is_waiting = contents.access<bool>([&](auto& states)
 					{
-						exception.access([](std::exception_ptr& ptr)
+						const auto [state, inserted] = states.try_emplace(file.hash);
+						if (inserted || state->second.done)
 						{
-							ptr = std::current_exception();
-						});
+							return false;
+						}
+
+						state->second.duplicates.emplace_back(file);
+						return true;
+					});
+
+					if (is_waiting)
+					{
+						return true;
+					}
 
-						return;
+					if (file.size > 0 && file.size <= utils::pack::max_member_size && !this->object_store_.contains(file.hash))
+					{
+						return pack_queue.push(std::move(file));
 					}
+
+					return queue.push(std::move(file));
+				});
+
+				if (found_files)
+				{
+					this->listener_.done_adding_files();
 				}
-			});
-		}
+			}
+			catch (...)
+			{
+				fail();
+				throw;
+			}
+
+			pack_queue.close();
+		};
 
-		for (auto& thread : threads)
+		// Workers only hold a slot while their transfer is in flight, no thread is blocked per download
+		const auto update = [&](const file_info& file) -> utils::coroutine::task<void>
 		{
-			if (thread.joinable())
+			try
 			{
-				thread.join();
+				this->listener_.begin_file(file);
+				co_await this->update_file(file);
+				this->listener_.end_file(file);
 			}
-		}
+			catch (...)
+			{
+				fail();
+				throw;
+			}
+		};
 
-		exception.access([](const std::exception_ptr& ptr)
+		const auto run_worker = [&](const size_t worker) -> utils::coroutine::task<void>
 		{
-			if (ptr)
+			while (!failed)
 			{
-				std::rethrow_exception(ptr);
+				const auto* file = co_await queue.next(worker);
+				if (!file)
+				{
+					break;
+				}
+
+				co_await update(*file);
+
+				for (const auto& duplicate : complete_content(file->hash))
+				{
+					co_await update(duplicate);
+				}
 			}
-		});
+		};
+
+		// Takes a batch from the packs as soon as it has enough members, the scan goes on meanwhile.
+		// The workers get whatever no pack covers, their queue stays open until the last batch is done.
+		const auto run_packer = [&]() -> utils::coroutine::task<void>
+		{
+			std::vector<file_info> batch{};
+
+			try
+			{
+				while (!failed)
+				{
+					const auto* file = co_await pack_queue.next(0);
+					if (file)
+					{
+						batch.emplace_back(*file);
+						if (batch.size() < min_pack_members)
+						{
+							continue;
+						}
+					}
+
+					auto remaining = std::exchange(batch, {});
+					if (remaining.size() >= min_pack_members)
+					{
+						std::vector<utils::cryptography::sha1::digest> hashes{};
+						hashes.reserve(remaining.size());
+
+						for (const auto& member : remaining)
+						{
+							hashes.emplace_back(member.hash);
+						}
+
+						remaining = co_await this->update_packed_files(std::move(remaining));
+						packed_count += hashes.size() - remaining.size();
+
+						std::unordered_set<utils::cryptography::sha1::digest> unpacked{};
+						for (const auto& member : remaining)
+						{
+							unpacked.emplace(member.hash);
+						}
+
+						for (const auto& hash : hashes)
+						{
+							if (unpacked.contains(hash))
+							{
+								continue;
+							}
+
+							for (auto& duplicate : complete_content(hash))
+							{
+								remaining.emplace_back(std::move(duplicate));
+							}
+						}
+					}
+
+					for (auto& member : remaining)
+					{
+						if (!queue.push(std::move(member)))
+						{
+							break;
+						}
+					}
+
+					if (!file)
+					{
+						break;
+					}
+				}
+			}
+			catch (...)
+			{
+				fail();
+				throw;
+			}
+
+			queue.close();
+		};
+
+		std::vector<utils::coroutine::task<void>> tasks{};
+		for (size_t i = 0; i < worker_count; ++i)
+		{
+			tasks.emplace_back(run_worker(i));
+		}
+
+		tasks.emplace_back(run_packer());
+		tasks.emplace_back(scan());
+
+		utils::coroutine::sync_wait(utils::coroutine::when_all(std::move(tasks)));
+
+		if (!found_files)
+		{
+			return;
+		}
+
+		const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+		utils::logger::write("Scanned and updated {} files ({} bytes) and {} small files from packs in {} ms using the {} schedule",
+		                     queue.size(), queue.get_total_size(), packed_count.load(), duration.count(), get_scheduling_policy_name(policy));
 
 		this->listener_.done_update();
 	}
 
-	bool file_updater::is_outdated_file(const file_info& file) const
+	// Transfers are throttled by the controller, there just have to be enough workers to fill every slot
+	size_t file_updater::restart_transfers() const
 	{
-#ifndef CI_BUILD
-		if (file.name == UPDATE_HOST_BINARY)
+		return this->concurrency_controller_.access<size_t>([](concurrency_controller& controller)
 		{
-			return false;
+			controller.restart();
+			utils::http::set_max_concurrent_transfers(controller.get_limit());
+
+			return controller.get_maximum_limit();
+		});
+	}
+
+	void file_updater::report_progress(const file_info& file, const size_t progress) const
+	{
+		this->listener_.file_progress(file, progress);
+
+		const auto decision = this->concurrency_controller_.access<std::optional<concurrency_decision>>(
+			[](concurrency_controller& controller)
+			{
+				const auto result = controller.sample(utils::http::get_transfer_stats());
+				if (result)
+				{
+					utils::http::set_max_concurrent_transfers(result->limit);
+				}
+
+				return result;
+			});
+
+		if (decision)
+		{
+			this->listener_.concurrency_changed(*decision);
+		}
+	}
+
+	bool file_updater::is_outdated_file(const file_info& file, const filesystem_snapshot& snapshot) const
+	{
+		utils::io::file_metadata metadata{};
+		const auto cached_result = this->is_outdated_file_cached(file, snapshot, metadata);
+		if (cached_result)
+		{
+			return *cached_result;
 		}
-#endif
 
-		std::string data{};
 		const auto drive_name = this->get_drive_filename(file);
-		if (!utils::io::read_file(drive_name, &data))
+
+		if (!file.chunk_hashes.empty())
 		{
-			return true;
+			const auto check = check_chunks(drive_name, file);
+			if (check)
+			{
+				this->hash_cache_.store(drive_name, metadata, check->hash);
+
+				if (check->hash == file.hash)
+				{
+					return false;
+				}
+
+				// A stale chunk table can not point at the damage, the whole file is downloaded then
+				if (check->damaged_chunks.empty())
+				{
+					utils::logger::write("{} does not match its hash, but all of its chunks do", file.name);
+					return true;
+				}
+
+				utils::logger::write("{} has {} damaged chunks", file.name, check->damaged_chunks.size());
+
+				this->damaged_chunks_.access([&](std::unordered_map<std::string, std::vector<size_t>>& chunks)
+				{
+					chunks[file.name] = check->damaged_chunks;
+				});
+
+				return true;
+			}
 		}
 
-		if (data.size() != file.size)
+		std::string data{};
+		if (!utils::io::read_file(drive_name, &data) || data.size() != file.size)
 		{
 			return true;
 		}
 
 		const auto hash = get_hash(data);
+		this->hash_cache_.store(drive_name, metadata, hash);
+
 		return hash != file.hash;
 	}
 
+	// Decides without reading the file if possible, otherwise returns nothing and the file has to be hashed
+	std::optional<bool> file_updater::is_outdated_file_cached(const file_info& file, const filesystem_snapshot& snapshot,
+	                                                          utils::io::file_metadata& metadata) const
+	{
+#ifndef CI_BUILD
+		if (file.name == UPDATE_HOST_BINARY)
+		{
+			return false;
+		}
+#endif
+
+		const auto drive_name = this->get_drive_filename(file);
+
+		// The host binary lives outside of the snapshot
+		const auto current = file.name == UPDATE_HOST_BINARY ? utils::io::get_file_metadata(drive_name)
+		                                                     : find_file_metadata(snapshot, "data/" + file.name);
+
+		return check_cached_file(this->hash_cache_, drive_name, current, file.size, file.hash, !is_full_verify(), metadata);
+	}
+
 	std::string file_updater::get_drive_filename(const file_info& file) const
 	{
 		if (file.name == UPDATE_HOST_BINARY)
@@ -598,79 +2491,158 @@ namespace updater
 		}
 	}
 
-	void file_updater::cleanup_directories(const std::vector<file_info>& files) const
+	void file_updater::cleanup_directories(const file_table& files, filesystem_snapshot& snapshot) const
 	{
-		if (!utils::io::directory_exists(this->base_))
+		if (snapshot.get_entry_count() == 0)
 		{
 			return;
 		}
 
-		this->cleanup_root_directory();
-		this->cleanup_data_directory(files);
+		this->cleanup_root_directory(snapshot);
+		this->cleanup_data_directory(files, snapshot);
 	}
 
-	void file_updater::cleanup_root_directory() const
+	void file_updater::cleanup_root_directory(filesystem_snapshot& snapshot) const
 	{
-		const auto existing_files = utils::io::list_files(this->base_);
-		for (const auto& file : existing_files)
+		for (const auto& [path, entry] : snapshot.list({}))
 		{
-			const auto entry = std::filesystem::relative(file, this->base_);
-			if ((entry.string() == "user" || entry.string() == "data") && utils::io::directory_exists(file))
+			const auto name = path_index::normalize(path);
+			if ((name == "user" || name == "data") && entry.is_directory)
 			{
 				continue;
 			}
 
-			std::error_code code{};
-			std::filesystem::remove_all(file, code);
+			this->remove_stale_entry(snapshot.get_root() + path);
+			snapshot.remove(path);
 		}
 	}
 
-	void file_updater::cleanup_data_directory(const std::vector<file_info>& files) const
+	void file_updater::cleanup_removed_files(const std::vector<std::string>& names, filesystem_snapshot& snapshot) const
 	{
-		const auto base = std::filesystem::path(this->base_) / "data";
-		if (!utils::io::directory_exists(base.string()))
+		std::set<std::string> folders{};
+
+		for (const auto& name : names)
 		{
-			return;
+			if (name == UPDATE_HOST_BINARY)
+			{
+				continue;
+			}
+
+			const auto path = "data/" + name;
+
+			// Interrupted downloads of removed files are useless as well
+			for (const auto& candidate : {path, path + PART_FILE_EXTENSION, path + PART_INFO_FILE_EXTENSION})
+			{
+				const auto* entry = snapshot.find(candidate);
+				if (entry && !entry->is_directory)
+				{
+					const auto full_path = snapshot.get_root() + entry->path;
+					if (candidate == path)
+					{
+						this->keep_previous_version(full_path);
+					}
+
+					this->remove_stale_entry(full_path);
+					snapshot.remove(candidate);
+				}
+			}
+
+			for (auto separator = path.find('/', 5); separator != std::string::npos; separator = path.find('/', separator + 1))
+			{
+				folders.emplace(path.substr(0, separator));
+			}
 		}
 
-		std::vector<std::filesystem::path> legal_files{};
-		legal_files.reserve(files.size());
-		for (const auto& file : files)
+		// Deepest folders first, so parents that only contained empty folders go away too
+		for (auto folder = folders.rbegin(); folder != folders.rend(); ++folder)
 		{
-			if (file.name != UPDATE_HOST_BINARY)
+			const auto* entry = snapshot.find(*folder);
+			if (entry && entry->is_directory && snapshot.list(*folder).empty())
 			{
-				legal_files.emplace_back(std::filesystem::absolute(base / file.name));
+				this->remove_stale_entry(snapshot.get_root() + entry->path);
+				snapshot.remove(*folder);
 			}
 		}
+	}
+
+	void file_updater::remove_stale_entry(const std::string& path) const
+	{
+		// Moving the entry out of the way is cheap, the actual deletion happens in the background
+		if (!trash::move(this->base_ + TRASH_DIRECTORY, path))
+		{
+			std::error_code code{};
+			std::filesystem::remove_all(path, code);
+		}
+	}
 
-		const auto existing_files = utils::io::list_files(base.string(), true);
-		for (auto& file : existing_files)
+	void file_updater::cleanup_data_directory(const file_table& files, filesystem_snapshot& snapshot) const
+	{
+		const auto* data = snapshot.find("data");
+		if (!data || !data->is_directory)
 		{
-			const auto is_file = std::filesystem::is_regular_file(file);
-			const auto is_folder = std::filesystem::is_directory(file);
+			return;
+		}
 
-			if (is_file || is_folder)
+		// Legality is decided on the relative paths alone, nothing has to be resolved on disk
+		path_index legal_files{};
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			const auto name = files.get_name(i);
+			if (name != UPDATE_HOST_BINARY)
 			{
-				bool is_legal = false;
+				legal_files.add_file(name);
+			}
+		}
 
-				for (const auto& legal_file : legal_files)
+		std::unordered_set<std::string> removed_folders{};
+		const auto is_removed = [&](const std::string& path)
+		{
+			for (auto separator = path.find('/'); separator != std::string::npos; separator = path.find('/', separator + 1))
+			{
+				if (removed_folders.contains(path.substr(0, separator)))
 				{
-					if ((is_folder && is_inside_folder(legal_file, file)) ||
-						(is_file && legal_file == file))
-					{
-						is_legal = true;
-						break;
-					}
+					return true;
 				}
+			}
+
+			return false;
+		};
 
-				if (is_legal)
+		constexpr std::string_view data_prefix = "data/";
+
+		for (const auto& [path, entry] : snapshot.list("data", true))
+		{
+			// Parents are listed first, so anything below a removed folder is already gone
+			if (is_removed(path))
+			{
+				continue;
+			}
+
+			const auto name = std::string_view{path}.substr(data_prefix.size());
+			if (entry.is_directory && legal_files.contains_directory(name))
+			{
+				continue;
+			}
+
+			if (!entry.is_directory)
+			{
+				// Interrupted downloads are kept so they can be resumed
+				const auto part_target = get_part_target(std::string(name));
+				if (legal_files.contains_file(name) || (!part_target.empty() && legal_files.contains_file(part_target)))
 				{
 					continue;
 				}
+
+				this->keep_previous_version(snapshot.get_root() + path);
 			}
 
-			std::error_code code{};
-			std::filesystem::remove_all(file, code);
+			this->remove_stale_entry(snapshot.get_root() + path);
+			snapshot.remove(path);
+
+			if (entry.is_directory)
+			{
+				removed_folders.emplace(path);
+			}
 		}
 	}
 }
@@ -1,6 +1,15 @@
 #pragma once
 
 #include "progress_listener.hpp"
+#include "concurrency_controller.hpp"
+#include "hash_cache.hpp"
+#include "object_store.hpp"
+#include "file_table.hpp"
+#include "filesystem_snapshot.hpp"
+#include "segments.hpp"
+
+#include <utils/coroutine.hpp>
+#include <utils/http_cache.hpp>
 
 namespace updater
 {
@@ -11,12 +20,13 @@ namespace updater
 
 		void run() const;
 
-		std::vector<file_info> get_outdated_files(const std::vector<file_info>& files) const;
+		std::vector<file_info> get_outdated_files(const file_table& files, const filesystem_snapshot& snapshot) const;
 
 		void update_host_binary(const std::vector<file_info>& outdated_files) const;
 
 		void update_iw4x_if_necessary() const;
 		void update_files(const std::vector<file_info>& outdated_files, bool iw4x_files = false) const;
+		void update_outdated_files(const file_table& files, const filesystem_snapshot& snapshot) const;
 
 	private:
 
@@ -32,9 +42,37 @@ namespace updater
 		std::string process_file_;
 		std::string dead_process_file_;
 
-		void update_file(const file_info& file, bool iw4x_files = false) const;
+		mutable hash_cache hash_cache_;
+		object_store object_store_;
+		utils::http::cache http_cache_;
+		mutable utils::concurrency::container<concurrency_controller> concurrency_controller_;
+		mutable utils::concurrency::container<std::unordered_map<std::string, std::vector<size_t>>> damaged_chunks_;
+
+		utils::coroutine::task<void> update_file(const file_info& file, bool iw4x_files = false) const;
+		utils::coroutine::task<std::vector<file_info>> update_packed_files(std::vector<file_info> files) const;
+		utils::coroutine::task<void> download_file(const file_info& file, const std::string& url, const std::string& part_file, bool iw4x_file) const;
+		utils::coroutine::task<void> fetch_ranges(const file_info& file, const std::string& url, const std::string& part_file,
+		                                          std::vector<segment>& ranges, utils::concurrency::container<std::string>& etag) const;
+		utils::coroutine::task<bool> download_file_segmented(const file_info& file, const std::string& url, const std::string& part_file) const;
+		utils::coroutine::task<bool> download_file_compressed(const file_info& file, const std::string& part_file) const;
+		utils::coroutine::task<bool> download_patch(const file_info& file, const std::string& out_file, const std::string& part_file) const;
+		utils::coroutine::task<bool> download_file_delta(const file_info& file, const std::string& url, const std::string& out_file,
+		                                                 const std::string& part_file) const;
+		utils::coroutine::task<bool> repair_file(const file_info& file, const std::string& url, const std::string& out_file,
+		                                         const std::string& part_file) const;
+		bool restore_file(const file_info& file, const std::string& part_file) const;
+		void keep_previous_version(const std::string& path) const;
+		void remember_file(const file_info& file, const std::string& out_file) const;
+
+		void report_progress(const file_info& file, size_t progress) const;
+		size_t restart_transfers() const;
 
-		bool is_outdated_file(const file_info& file) const;
+		void find_outdated_files(const file_table& files, const filesystem_snapshot& snapshot,
+		                         const std::function<bool(size_t)>& callback) const;
+
+		bool is_outdated_file(const file_info& file, const filesystem_snapshot& snapshot) const;
+		std::optional<bool> is_outdated_file_cached(const file_info& file, const filesystem_snapshot& snapshot,
+		                                            utils::io::file_metadata& metadata) const;
 		std::string get_drive_filename(const file_info& file) const;
 
 		void move_current_process_file() const;
@@ -43,12 +81,17 @@ namespace updater
 
 		// IW4X-specific
 		void create_iw4x_version_file(std::string rawfile_version) const;
-		std::optional<std::string> get_release_tag(const std::string& release_url) const;
+		utils::coroutine::task<std::optional<std::string>> get_release_tag(std::string release_url) const;
 		bool does_iw4x_require_update(iw4x_update_state& update_state) const;
 		void deploy_iw4x_rawfiles() const;
 
-		void cleanup_directories(const std::vector<file_info>& files) const;
-		void cleanup_root_directory() const;
-		void cleanup_data_directory(const std::vector<file_info>& files) const;
+		void cleanup_directories(const file_table& files, filesystem_snapshot& snapshot) const;
+		void cleanup_root_directory(filesystem_snapshot& snapshot) const;
+		void cleanup_data_directory(const file_table& files, filesystem_snapshot& snapshot) const;
+		void cleanup_removed_files(const std::vector<std::string>& names, filesystem_snapshot& snapshot) const;
+		void remove_stale_entry(const std::string& path) const;
+
+		std::optional<file_table> load_applied_manifest() const;
+		void store_applied_manifest(const file_table& files) const;
 	};
 }
@@ -0,0 +1,121 @@
+#include "std_include.hpp"
+
+#include "filesystem_snapshot.hpp"
+#include "path_index.hpp"
+
+namespace updater
+{
+	namespace
+	{
+		// Every lookup served from the snapshot replaces opening the file, querying it and closing it again
+		constexpr size_t system_calls_per_lookup = 3;
+
+		std::string join_path(const std::string& directory, const std::string& name)
+		{
+			return directory.empty() ? name : directory + "/" + name;
+		}
+	}
+
+	filesystem_snapshot::filesystem_snapshot(std::string root, const std::vector<std::string>& recursive_directories)
+		: root_(std::move(root))
+	{
+		if (!this->root_.empty() && !this->root_.ends_with('/') && !this->root_.ends_with('\\'))
+		{
+			this->root_.push_back('/');
+		}
+
+		this->read_directory({}, false);
+
+		for (const auto& directory : recursive_directories)
+		{
+			const auto entry = this->entries_.find(path_index::normalize(directory));
+			if (entry != this->entries_.end() && entry->second.is_directory)
+			{
+				this->read_directory(entry->second.path, true);
+			}
+		}
+	}
+
+	const std::string& filesystem_snapshot::get_root() const
+	{
+		return this->root_;
+	}
+
+	const filesystem_snapshot::entry* filesystem_snapshot::find(const std::string& path) const
+	{
+		++this->lookups_;
+
+		const auto entry = this->entries_.find(path_index::normalize(path));
+		return entry == this->entries_.end() ? nullptr : &entry->second;
+	}
+
+	std::vector<std::pair<std::string, filesystem_snapshot::entry>> filesystem_snapshot::list(const std::string& directory, const bool recursive) const
+	{
+		const auto normalized = path_index::normalize(directory);
+		const auto prefix = normalized.empty() ? std::string{} : normalized + "/";
+
+		std::vector<std::pair<std::string, entry>> paths{};
+		for (auto entry = this->entries_.lower_bound(prefix); entry != this->entries_.end() && entry->first.starts_with(prefix); ++entry)
+		{
+			if (recursive || entry->first.find('/', prefix.size()) == std::string::npos)
+			{
+				paths.emplace_back(entry->second.path, entry->second);
+			}
+		}
+
+		this->lookups_ += paths.size();
+		return paths;
+	}
+
+	void filesystem_snapshot::remove(const std::string& path)
+	{
+		const auto normalized = path_index::normalize(path);
+		this->entries_.erase(normalized);
+
+		const auto prefix = normalized + "/";
+		auto entry = this->entries_.lower_bound(prefix);
+		while (entry != this->entries_.end() && entry->first.starts_with(prefix))
+		{
+			entry = this->entries_.erase(entry);
+		}
+	}
+
+	size_t filesystem_snapshot::get_entry_count() const
+	{
+		return this->entries_.size();
+	}
+
+	size_t filesystem_snapshot::get_system_calls() const
+	{
+		return this->system_calls_;
+	}
+
+	size_t filesystem_snapshot::get_saved_system_calls() const
+	{
+		const auto replaced = this->lookups_ * system_calls_per_lookup;
+		return replaced > this->system_calls_ ? replaced - this->system_calls_ : 0;
+	}
+
+	void filesystem_snapshot::read_directory(const std::string& directory, const bool recursive)
+	{
+		const auto listing = utils::io::read_directory(this->root_ + directory);
+		if (!listing)
+		{
+			return;
+		}
+
+		this->system_calls_ += listing->system_calls;
+
+		for (const auto& file : listing->entries)
+		{
+			const auto path = join_path(directory, file.name);
+			this->entries_[path_index::normalize(path)] = entry{path, file.metadata, file.is_directory};
+
+			// Links are not followed, just like the directory iterators used before
+			if (recursive && file.is_directory && !file.is_reparse_point)
+			{
+				this->read_directory(path, true);
+			}
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <utils/io.hpp>
+
+#include <map>
+
+namespace updater
+{
+	// Directory tree captured with one enumeration per directory, so cleanup and outdated file
+	// detection can be answered without touching the disk again. Paths are relative to the root
+	// and use forward slashes. Lookups fold case and separators like path_index, the way Windows
+	// resolves paths, while listings keep the spelling found on disk.
+	class filesystem_snapshot
+	{
+	public:
+		struct entry
+		{
+			std::string path;
+			utils::io::file_metadata metadata;
+			bool is_directory;
+		};
+
+		// Only the given top-level directories are walked recursively
+		filesystem_snapshot(std::string root, const std::vector<std::string>& recursive_directories);
+
+		const std::string& get_root() const;
+
+		const entry* find(const std::string& path) const;
+
+		// Entries below the directory in lexical order, so parents come before their children
+		std::vector<std::pair<std::string, entry>> list(const std::string& directory, bool recursive = false) const;
+
+		// Forgets the entry and everything below it, after it was deleted from disk
+		void remove(const std::string& path);
+
+		size_t get_entry_count() const;
+		size_t get_system_calls() const;
+		size_t get_saved_system_calls() const;
+
+	private:
+		std::string root_;
+		std::map<std::string, entry> entries_{}; // Keyed by the normalized path
+
+		size_t system_calls_{0};
+		mutable std::atomic<size_t> lookups_{0};
+
+		void read_directory(const std::string& directory, bool recursive);
+	};
+}
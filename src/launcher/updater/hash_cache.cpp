@@ -0,0 +1,276 @@
+#include "std_include.hpp"
+#include "hash_cache.hpp"
+
+#include <utils/logger.hpp>
+
+namespace updater
+{
+	namespace
+	{
+		constexpr uint32_t cache_magic = 0x31434858; // XHC1
+		constexpr uint32_t cache_version = 3;
+
+		// The cache file is a flat image of this header and the records, followed by a string table holding
+		// the paths. Every record has a fixed size and the records are sorted by path, so the file is mapped
+		// and searched in place instead of being copied into a map.
+		struct cache_header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t entry_count;
+			uint32_t string_table_size;
+		};
+
+		static_assert(sizeof(cache_header) == 16);
+	}
+
+	struct hash_cache::record
+	{
+		uint64_t size;
+		uint64_t last_write_time;
+		uint64_t file_id;
+		uint32_t name_offset;
+		uint32_t name_length;
+		uint8_t hash[utils::cryptography::sha1::digest_size];
+		uint32_t reserved;
+
+		std::string_view get_name(const char* string_table) const
+		{
+			return {string_table + this->name_offset, this->name_length};
+		}
+
+		utils::io::file_metadata get_metadata() const
+		{
+			utils::io::file_metadata metadata{};
+			metadata.size = this->size;
+			metadata.last_write_time = this->last_write_time;
+			metadata.file_id = this->file_id;
+			return metadata;
+		}
+	};
+
+	hash_cache::hash_cache(std::string file)
+		: file_(std::move(file))
+	{
+	}
+
+	std::optional<utils::cryptography::sha1::digest> hash_cache::find(const std::string& path, const utils::io::file_metadata& metadata) const
+	{
+		using result = std::optional<utils::cryptography::sha1::digest>;
+		return this->state_.access<result>([&](state& state) -> result
+		{
+			this->load(state);
+
+			const auto entry = state.entries.find(path);
+			if (entry != state.entries.end())
+			{
+				return entry->second.metadata == metadata ? result{entry->second.hash} : result{};
+			}
+
+			const auto index = find_record(state, path);
+			if (!index)
+			{
+				return {};
+			}
+
+			// A mismatch is kept as well, the file is hashed and stored again right after
+			state.seen[*index] = 1;
+
+			const auto& current = state.records[*index];
+			if (current.get_metadata() != metadata)
+			{
+				return {};
+			}
+
+			return {utils::cryptography::sha1::digest{current.hash}};
+		});
+	}
+
+	void hash_cache::store(const std::string& path, const utils::io::file_metadata& metadata, const utils::cryptography::sha1::digest& hash)
+	{
+		this->state_.access([&](state& state)
+		{
+			this->load(state);
+
+			if (!state.entries.contains(path))
+			{
+				const auto index = find_record(state, path);
+				if (index)
+				{
+					state.seen[*index] = 1;
+
+					const auto& current = state.records[*index];
+					if (current.get_metadata() == metadata && utils::cryptography::sha1::digest{current.hash} == hash)
+					{
+						return;
+					}
+				}
+			}
+
+			auto& entry = state.entries[path];
+			if (entry.metadata != metadata || entry.hash != hash)
+			{
+				entry.metadata = metadata;
+				entry.hash = hash;
+				state.dirty = true;
+			}
+		});
+	}
+
+	void hash_cache::save() const
+	{
+		this->state_.access([&](state& state)
+		{
+			struct pending_entry
+			{
+				std::string_view path;
+				utils::io::file_metadata metadata;
+				const uint8_t* hash;
+			};
+
+			std::vector<pending_entry> pending{};
+			pending.reserve(state.record_count + state.entries.size());
+
+			// Entries of files that were not looked at in this run are dropped, so removed files do not pile up
+			auto pruned = false;
+			for (size_t i = 0; i < state.record_count; ++i)
+			{
+				const auto& current = state.records[i];
+				const auto name = current.get_name(state.string_table);
+
+				if (!state.seen[i])
+				{
+					pruned = true;
+				}
+				else if (!state.entries.contains(std::string{name}))
+				{
+					pending.push_back({name, current.get_metadata(), current.hash});
+				}
+			}
+
+			if (!state.dirty && !pruned)
+			{
+				return;
+			}
+
+			for (const auto& [path, value] : state.entries)
+			{
+				pending.push_back({path, value.metadata, value.hash.data()});
+			}
+
+			std::sort(pending.begin(), pending.end(), [](const pending_entry& a, const pending_entry& b)
+			{
+				return a.path < b.path;
+			});
+
+			std::string string_table{};
+			std::vector<record> records{};
+			records.reserve(pending.size());
+
+			for (const auto& value : pending)
+			{
+				record entry{};
+				entry.size = value.metadata.size;
+				entry.last_write_time = value.metadata.last_write_time;
+				entry.file_id = value.metadata.file_id;
+				entry.name_offset = static_cast<uint32_t>(string_table.size());
+				entry.name_length = static_cast<uint32_t>(value.path.size());
+				std::memcpy(entry.hash, value.hash, sizeof(entry.hash));
+
+				string_table.append(value.path);
+				records.emplace_back(entry);
+			}
+
+			cache_header header{};
+			header.magic = cache_magic;
+			header.version = cache_version;
+			header.entry_count = static_cast<uint32_t>(records.size());
+			header.string_table_size = static_cast<uint32_t>(string_table.size());
+
+			std::string data{};
+			data.reserve(sizeof(header) + records.size() * sizeof(record) + string_table.size());
+			data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+			data.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(record));
+			data.append(string_table);
+
+			// The mapping keeps the file open, the saved image is mapped again on the next access
+			state = {};
+
+			if (!utils::io::write_file(this->file_, data))
+			{
+				utils::logger::write("Failed to write hash cache {}", this->file_);
+			}
+		});
+	}
+
+	void hash_cache::load(state& state) const
+	{
+		static_assert(sizeof(record) == 56);
+
+		if (state.loaded)
+		{
+			return;
+		}
+
+		state.loaded = true;
+
+		auto image = std::make_unique<utils::io::mapped_file>(this->file_);
+		if (!image->is_valid() || image->size() < sizeof(cache_header))
+		{
+			return;
+		}
+
+		cache_header header{};
+		std::memcpy(&header, image->data(), sizeof(header));
+
+		if (header.magic != cache_magic || header.version != cache_version)
+		{
+			utils::logger::write("Discarding incompatible hash cache {}", this->file_);
+			return;
+		}
+
+		const auto records_size = static_cast<size_t>(header.entry_count) * sizeof(record);
+		if (image->size() != sizeof(cache_header) + records_size + header.string_table_size)
+		{
+			utils::logger::write("Discarding corrupted hash cache {}", this->file_);
+			return;
+		}
+
+		const auto* records = reinterpret_cast<const record*>(image->data() + sizeof(cache_header));
+		const auto* string_table = reinterpret_cast<const char*>(image->data() + sizeof(cache_header) + records_size);
+
+		// Lookups are a binary search, so the names have to be in bounds and strictly ascending
+		for (uint32_t i = 0; i < header.entry_count; ++i)
+		{
+			const auto& current = records[i];
+			if (static_cast<uint64_t>(current.name_offset) + current.name_length > header.string_table_size
+				|| (i > 0 && !(records[i - 1].get_name(string_table) < current.get_name(string_table))))
+			{
+				utils::logger::write("Discarding corrupted hash cache {}", this->file_);
+				return;
+			}
+		}
+
+		state.records = records;
+		state.string_table = string_table;
+		state.record_count = header.entry_count;
+		state.seen.assign(header.entry_count, 0);
+		state.image = std::move(image);
+	}
+
+	std::optional<size_t> hash_cache::find_record(const state& state, const std::string_view path)
+	{
+		const auto* end = state.records + state.record_count;
+		const auto* entry = std::lower_bound(state.records, end, path, [&](const record& current, const std::string_view name)
+		{
+			return current.get_name(state.string_table) < name;
+		});
+
+		if (entry == end || entry->get_name(state.string_table) != path)
+		{
+			return {};
+		}
+
+		return static_cast<size_t>(entry - state.records);
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <utils/io.hpp>
+#include <utils/concurrency.hpp>
+#include <utils/cryptography.hpp>
+
+namespace updater
+{
+	class hash_cache
+	{
+	public:
+		hash_cache(std::string file);
+
+		std::optional<utils::cryptography::sha1::digest> find(const std::string& path, const utils::io::file_metadata& metadata) const;
+		void store(const std::string& path, const utils::io::file_metadata& metadata, const utils::cryptography::sha1::digest& hash);
+
+		// Only keeps the entries that were looked up or stored since the cache was loaded
+		void save() const;
+
+	private:
+		struct record;
+
+		struct entry
+		{
+			utils::io::file_metadata metadata;
+			utils::cryptography::sha1::digest hash;
+		};
+
+		struct state
+		{
+			bool loaded = false;
+			bool dirty = false;
+
+			// Records of the cache file are looked up in place, they are sorted by path
+			std::unique_ptr<utils::io::mapped_file> image{};
+			const record* records{};
+			const char* string_table{};
+			size_t record_count{0};
+			std::vector<uint8_t> seen{};
+
+			// Entries stored in this run
+			std::unordered_map<std::string, entry> entries{};
+		};
+
+		std::string file_;
+		mutable utils::concurrency::container<state> state_{};
+
+		void load(state& state) const;
+		static std::optional<size_t> find_record(const state& state, std::string_view path);
+	};
+}
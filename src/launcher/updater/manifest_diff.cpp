@@ -0,0 +1,57 @@
+#include "std_include.hpp"
+
+#include "manifest_diff.hpp"
+
+namespace updater
+{
+	bool manifest_diff::empty() const
+	{
+		return this->added.empty() && this->changed.empty() && this->removed.empty();
+	}
+
+	manifest_diff diff_manifests(const file_table& previous, const file_table& current)
+	{
+		std::unordered_map<std::string_view, size_t> previous_entries{};
+		previous_entries.reserve(previous.size());
+
+		for (size_t i = 0; i < previous.size(); ++i)
+		{
+			previous_entries.emplace(previous.get_name(i), i);
+		}
+
+		manifest_diff diff{};
+		std::vector<bool> kept(previous.size(), false);
+
+		for (size_t i = 0; i < current.size(); ++i)
+		{
+			const auto entry = previous_entries.find(current.get_name(i));
+			if (entry == previous_entries.end())
+			{
+				diff.added.emplace_back(i);
+				continue;
+			}
+
+			const auto index = entry->second;
+			kept[index] = true;
+
+			if (previous.get_size(index) != current.get_size(i) || previous.get_hash(index) != current.get_hash(i))
+			{
+				diff.changed.emplace_back(i);
+			}
+			else
+			{
+				++diff.unchanged;
+			}
+		}
+
+		for (size_t i = 0; i < previous.size(); ++i)
+		{
+			if (!kept[i])
+			{
+				diff.removed.emplace_back(previous.get_name(i));
+			}
+		}
+
+		return diff;
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "file_table.hpp"
+
+namespace updater
+{
+	// Structural difference between the last applied manifest and the current one
+	struct manifest_diff
+	{
+		// Indices into the current table
+		std::vector<size_t> added{};
+		std::vector<size_t> changed{};
+		size_t unchanged{0};
+
+		// Names that are only part of the previous manifest
+		std::vector<std::string> removed{};
+
+		bool empty() const;
+	};
+
+	manifest_diff diff_manifests(const file_table& previous, const file_table& current);
+}
@@ -0,0 +1,354 @@
+#include "std_include.hpp"
+#include "object_store.hpp"
+
+#include <utils/logger.hpp>
+
+namespace updater
+{
+	namespace
+	{
+		constexpr uint32_t index_magic = 0x31534F58; // XOS1
+		constexpr uint32_t index_version = 1;
+
+		// The index is this header followed by one record per object, objects themselves are stored
+		// as <directory>/<first two hex digits>/<hex digest>
+		struct index_header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t entry_count;
+			uint32_t reserved;
+		};
+
+		struct index_entry
+		{
+			uint8_t hash[utils::cryptography::sha1::digest_size];
+			uint32_t reserved;
+			uint64_t size;
+			uint64_t last_write_time;
+			uint64_t file_id;
+			int64_t last_used;
+		};
+
+		static_assert(sizeof(index_header) == 16);
+		static_assert(sizeof(index_entry) == 56);
+
+		int64_t get_current_time()
+		{
+			return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		bool create_link(const std::string& source, const std::string& target)
+		{
+			std::error_code code{};
+			std::filesystem::remove(target, code);
+
+			code.clear();
+			std::filesystem::create_hard_link(source, target, code);
+			return !code;
+		}
+
+		bool link_or_copy(const std::string& source, const std::string& target)
+		{
+			if (create_link(source, target))
+			{
+				return true;
+			}
+
+			// Copies also work across volumes and on file systems without hard links
+			std::error_code code{};
+			return std::filesystem::copy_file(source, target, std::filesystem::copy_options::overwrite_existing, code) && !code;
+		}
+	}
+
+	object_store::object_store(std::string directory, const uint64_t max_size)
+		: directory_(std::move(directory))
+		, max_size_(max_size)
+	{
+	}
+
+	bool object_store::contains(const hash& hash) const
+	{
+		return this->state_.access<bool>([&](state& state)
+		{
+			this->load(state);
+			return this->is_valid(state, hash);
+		});
+	}
+
+	bool object_store::materialize(const hash& hash, const std::string& target) const
+	{
+		const auto known = this->state_.access<bool>([&](state& state)
+		{
+			this->load(state);
+			return this->is_valid(state, hash);
+		});
+
+		// Linking or copying happens outside of the lock, so parallel workers do not queue behind each other
+		if (!known || !link_or_copy(this->get_object_file(hash), target))
+		{
+			return false;
+		}
+
+		this->state_.access([&](state& state)
+		{
+			const auto entry = state.entries.find(hash);
+			if (entry != state.entries.end())
+			{
+				entry->second.last_used = get_current_time();
+				state.dirty = true;
+			}
+		});
+
+		return true;
+	}
+
+	void object_store::add(const hash& hash, const std::string& file, const bool is_removed) const
+	{
+		const auto known = this->state_.access<bool>([&](state& state)
+		{
+			this->load(state);
+
+			if (!this->is_valid(state, hash))
+			{
+				return false;
+			}
+
+			state.entries[hash].last_used = get_current_time();
+			state.dirty = true;
+			return true;
+		});
+
+		if (known)
+		{
+			return;
+		}
+
+		const auto object_file = this->get_object_file(hash);
+		utils::io::create_directory(std::filesystem::path(object_file).parent_path().generic_string());
+
+		// Copying a file the install keeps would double its write I/O and disk usage, those are only kept as links
+		if (!(is_removed ? link_or_copy(file, object_file) : create_link(file, object_file)))
+		{
+			if (is_removed)
+			{
+				utils::logger::write("Failed to keep {} in the object store", file);
+			}
+
+			return;
+		}
+
+		const auto metadata = utils::io::get_file_metadata(object_file);
+		if (!metadata)
+		{
+			return;
+		}
+
+		this->state_.access([&](state& state)
+		{
+			auto& entry = state.entries[hash];
+			entry.metadata = *metadata;
+			entry.last_used = get_current_time();
+			state.dirty = true;
+		});
+	}
+
+	void object_store::collect_garbage() const
+	{
+		this->state_.access([&](state& state)
+		{
+			this->load(state);
+
+			// Objects of a run that did not get to save the index are picked up as the oldest ones
+			if (utils::io::directory_exists(this->directory_))
+			{
+				for (const auto& file : utils::io::list_files(this->directory_, true))
+				{
+					const auto object = hash::from_hex(std::filesystem::path(file).filename().string());
+					const auto metadata = object ? utils::io::get_file_metadata(file) : std::nullopt;
+					if (metadata && !state.entries.contains(*object))
+					{
+						state.entries[*object] = entry{*metadata, 0};
+						state.dirty = true;
+					}
+				}
+			}
+
+			struct candidate
+			{
+				hash object;
+				int64_t last_used;
+				uint64_t size;
+			};
+
+			uint64_t exclusive_size = 0;
+			std::vector<candidate> candidates{};
+			std::vector<hash> invalid{};
+
+			for (const auto& [object, entry] : state.entries)
+			{
+				std::error_code code{};
+				const auto links = std::filesystem::hard_link_count(this->get_object_file(object), code);
+				const auto metadata = code ? std::nullopt : utils::io::get_file_metadata(this->get_object_file(object));
+
+				if (!metadata || *metadata != entry.metadata)
+				{
+					invalid.emplace_back(object);
+					continue;
+				}
+
+				// Objects still linked from the install take no space of their own
+				if (links <= 1)
+				{
+					exclusive_size += entry.metadata.size;
+					candidates.emplace_back(candidate{object, entry.last_used, entry.metadata.size});
+				}
+			}
+
+			for (const auto& object : invalid)
+			{
+				this->remove(state, object);
+			}
+
+			std::sort(candidates.begin(), candidates.end(), [](const candidate& a, const candidate& b)
+			{
+				return a.last_used < b.last_used;
+			});
+
+			size_t evicted = 0;
+			for (const auto& current : candidates)
+			{
+				if (exclusive_size <= this->max_size_)
+				{
+					break;
+				}
+
+				this->remove(state, current.object);
+				exclusive_size -= current.size;
+				++evicted;
+			}
+
+			if (evicted > 0 || !invalid.empty())
+			{
+				utils::logger::write("Evicted {} objects and dropped {} changed ones, the store keeps {} bytes of its own",
+				                     evicted, invalid.size(), exclusive_size);
+			}
+
+			this->save(state);
+		});
+	}
+
+	std::string object_store::get_object_file(const hash& hash) const
+	{
+		const auto hex = hash.to_hex();
+		return this->directory_ + "/" + hex.substr(0, 2) + "/" + hex;
+	}
+
+	std::string object_store::get_index_file() const
+	{
+		return this->directory_ + "/index.bin";
+	}
+
+	bool object_store::is_valid(state& state, const hash& hash) const
+	{
+		const auto entry = state.entries.find(hash);
+		if (entry == state.entries.end())
+		{
+			return false;
+		}
+
+		// Changed objects can not be trusted anymore, they are dropped instead of hashed again
+		const auto metadata = utils::io::get_file_metadata(this->get_object_file(hash));
+		if (!metadata || *metadata != entry->second.metadata)
+		{
+			this->remove(state, hash);
+			return false;
+		}
+
+		return true;
+	}
+
+	void object_store::remove(state& state, const hash& hash) const
+	{
+		utils::io::remove_file(this->get_object_file(hash));
+		state.entries.erase(hash);
+		state.dirty = true;
+	}
+
+	void object_store::load(state& state) const
+	{
+		if (state.loaded)
+		{
+			return;
+		}
+
+		state.loaded = true;
+
+		std::string data{};
+		if (!utils::io::read_file(this->get_index_file(), &data) || data.size() < sizeof(index_header))
+		{
+			return;
+		}
+
+		index_header header{};
+		std::memcpy(&header, data.data(), sizeof(header));
+
+		if (header.magic != index_magic || header.version != index_version
+			|| data.size() != sizeof(header) + static_cast<size_t>(header.entry_count) * sizeof(index_entry))
+		{
+			utils::logger::write("Discarding invalid object store index {}", this->get_index_file());
+			return;
+		}
+
+		state.entries.reserve(header.entry_count);
+
+		for (uint32_t i = 0; i < header.entry_count; ++i)
+		{
+			index_entry record{};
+			std::memcpy(&record, data.data() + sizeof(header) + i * sizeof(index_entry), sizeof(record));
+
+			auto& value = state.entries[hash{record.hash}];
+			value.metadata.size = record.size;
+			value.metadata.last_write_time = record.last_write_time;
+			value.metadata.file_id = record.file_id;
+			value.last_used = record.last_used;
+		}
+	}
+
+	void object_store::save(state& state) const
+	{
+		if (!state.dirty)
+		{
+			return;
+		}
+
+		index_header header{};
+		header.magic = index_magic;
+		header.version = index_version;
+		header.entry_count = static_cast<uint32_t>(state.entries.size());
+
+		std::string data{};
+		data.reserve(sizeof(header) + state.entries.size() * sizeof(index_entry));
+		data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (const auto& [object, value] : state.entries)
+		{
+			index_entry record{};
+			std::memcpy(record.hash, object.data(), sizeof(record.hash));
+			record.size = value.metadata.size;
+			record.last_write_time = value.metadata.last_write_time;
+			record.file_id = value.metadata.file_id;
+			record.last_used = value.last_used;
+
+			data.append(reinterpret_cast<const char*>(&record), sizeof(record));
+		}
+
+		if (!utils::io::write_file(this->get_index_file(), data))
+		{
+			utils::logger::write("Failed to write object store index {}", this->get_index_file());
+			return;
+		}
+
+		state.dirty = false;
+	}
+}
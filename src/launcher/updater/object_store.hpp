@@ -0,0 +1,58 @@
+#pragma once
+
+#include <utils/io.hpp>
+#include <utils/concurrency.hpp>
+#include <utils/cryptography.hpp>
+
+namespace updater
+{
+	// Content-addressed copies of files the updater replaced or removed, keyed by their hash. Objects are hard
+	// links wherever possible, so keeping a file that is still in use costs no space. Objects only the store
+	// holds on to are evicted least recently used first once they exceed the size limit.
+	class object_store
+	{
+	public:
+		using hash = utils::cryptography::sha1::digest;
+
+		object_store(std::string directory, uint64_t max_size);
+
+		bool contains(const hash& hash) const;
+
+		// Links or copies the object to the target, false if it is unknown or was changed since it was stored
+		bool materialize(const hash& hash, const std::string& target) const;
+
+		// Keeps the file as the object for the hash. Files that stay in the install are only kept if they can be
+		// hard linked, files that are about to be removed or replaced are copied if linking fails.
+		void add(const hash& hash, const std::string& file, bool is_removed) const;
+
+		// Evicts objects until the ones nothing else links to fit into the size limit and saves the index
+		void collect_garbage() const;
+
+	private:
+		struct entry
+		{
+			utils::io::file_metadata metadata;
+			int64_t last_used;
+		};
+
+		struct state
+		{
+			bool loaded = false;
+			bool dirty = false;
+			std::unordered_map<hash, entry> entries{};
+		};
+
+		std::string directory_;
+		uint64_t max_size_;
+		mutable utils::concurrency::container<state> state_{};
+
+		std::string get_object_file(const hash& hash) const;
+		std::string get_index_file() const;
+
+		bool is_valid(state& state, const hash& hash) const;
+		void remove(state& state, const hash& hash) const;
+
+		void load(state& state) const;
+		void save(state& state) const;
+	};
+}
@@ -0,0 +1,46 @@
+#include "std_include.hpp"
+
+#include "pack_plan.hpp"
+
+namespace updater
+{
+	void plan_pack(pack_plan& plan, const uint64_t pack_size)
+	{
+		std::sort(plan.members.begin(), plan.members.end(), [](const pack_member& a, const pack_member& b)
+		{
+			return a.offset < b.offset;
+		});
+
+		plan.ranges.clear();
+
+		for (size_t i = 0; i < plan.members.size(); ++i)
+		{
+			const auto& member = plan.members[i];
+			const auto end = member.offset + member.file.size;
+
+			if (!plan.ranges.empty() && member.offset <= plan.ranges.back().end + max_pack_gap)
+			{
+				plan.ranges.back().end = std::max(plan.ranges.back().end, end);
+				++plan.ranges.back().member_count;
+			}
+			else
+			{
+				plan.ranges.emplace_back(pack_range{member.offset, end, i, 1});
+			}
+		}
+
+		plan.range_size = 0;
+		for (const auto& range : plan.ranges)
+		{
+			plan.range_size += range.end - range.start;
+		}
+
+		// Most of the pack is needed anyway, skipping the rest is not worth the extra requests
+		plan.whole_pack = plan.range_size >= pack_size / 4 * 3;
+	}
+
+	bool is_pack_worthwhile(const pack_plan& plan)
+	{
+		return plan.members.size() >= min_pack_members && (plan.whole_pack || plan.ranges.size() * 2 <= plan.members.size());
+	}
+}
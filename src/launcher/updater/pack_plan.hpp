@@ -0,0 +1,46 @@
+#pragma once
+
+#include "file_info.hpp"
+
+namespace updater
+{
+	// Outdated small files are taken from packs once there are enough of them, see utils::pack
+	constexpr size_t min_pack_members = 8;
+
+	// Members closer than this are fetched in one range, skipping the bytes in between is cheaper than
+	// another request
+	constexpr size_t max_pack_gap = 64 * 1024;
+
+	struct pack_member
+	{
+		file_info file;
+		std::string out_file;
+		std::string part_file;
+		uint64_t offset;
+		bool verified;
+	};
+
+	// A byte range of a pack and the members it covers
+	struct pack_range
+	{
+		uint64_t start;
+		uint64_t end;
+		size_t first_member;
+		size_t member_count;
+	};
+
+	struct pack_plan
+	{
+		std::vector<pack_member> members{};
+		std::vector<pack_range> ranges{};
+		uint64_t range_size{0};
+		bool whole_pack{false};
+	};
+
+	// Sorts the members by their offset and coalesces them into ranges
+	void plan_pack(pack_plan& plan, uint64_t pack_size);
+
+	// A pack only pays off when its members coalesce into clearly fewer requests, a few files or files spread
+	// over the whole pack download just as fast on their own and can use their compressed variants
+	bool is_pack_worthwhile(const pack_plan& plan);
+}
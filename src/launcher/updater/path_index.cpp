@@ -0,0 +1,112 @@
+#include "std_include.hpp"
+
+#include "path_index.hpp"
+
+namespace updater
+{
+	size_t path_index::node_key_hash::operator()(const node_key& key) const
+	{
+		return std::hash<std::string>{}(key.name) ^ (static_cast<size_t>(key.parent) * 0x9E3779B97F4A7C15ull);
+	}
+
+	void path_index::add_file(const std::string_view path)
+	{
+		auto normalized = normalize(path);
+		if (normalized.empty())
+		{
+			return;
+		}
+
+		uint32_t parent = 0;
+		size_t start = 0;
+
+		for (auto separator = normalized.find('/'); separator != std::string::npos; separator = normalized.find('/', start))
+		{
+			node_key key{parent, normalized.substr(start, separator - start)};
+			const auto id = static_cast<uint32_t>(this->directories_.size() + 1);
+
+			parent = this->directories_.try_emplace(std::move(key), id).first->second;
+			start = separator + 1;
+		}
+
+		this->files_.emplace(std::move(normalized));
+	}
+
+	bool path_index::contains_file(const std::string_view path) const
+	{
+		return this->files_.contains(normalize(path));
+	}
+
+	bool path_index::contains_directory(const std::string_view path) const
+	{
+		return this->find_directory(normalize(path)).has_value();
+	}
+
+	size_t path_index::size() const
+	{
+		return this->files_.size();
+	}
+
+	std::string path_index::normalize(const std::string_view path)
+	{
+		std::string result{};
+		result.reserve(path.size());
+
+		for (auto c : path)
+		{
+			if (c == '\\')
+			{
+				c = '/';
+			}
+			else if (c >= 'A' && c <= 'Z')
+			{
+				c = static_cast<char>(c - 'A' + 'a');
+			}
+
+			if (c == '/' && (result.empty() || result.back() == '/'))
+			{
+				continue;
+			}
+
+			result.push_back(c);
+		}
+
+		if (!result.empty() && result.back() == '/')
+		{
+			result.pop_back();
+		}
+
+		return result;
+	}
+
+	std::optional<uint32_t> path_index::find_directory(const std::string_view normalized_path) const
+	{
+		if (normalized_path.empty())
+		{
+			return this->files_.empty() ? std::optional<uint32_t>{} : 0;
+		}
+
+		uint32_t parent = 0;
+		size_t start = 0;
+
+		while (start <= normalized_path.size())
+		{
+			auto separator = normalized_path.find('/', start);
+			if (separator == std::string_view::npos)
+			{
+				separator = normalized_path.size();
+			}
+
+			const auto node = this->directories_.find(node_key{parent, std::string(normalized_path.substr(start, separator - start))});
+			if (node == this->directories_.end())
+			{
+				return {};
+			}
+
+			parent = node->second;
+			start = separator + 1;
+		}
+
+		return parent;
+	}
+}
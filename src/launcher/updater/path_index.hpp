@@ -0,0 +1,42 @@
+#pragma once
+
+namespace updater
+{
+	// Set of relative file paths that also knows every directory leading to them. Paths are normalised
+	// once when they are added, separators become '/' and ASCII letters are folded like Windows does,
+	// so every lookup is a single pass over the queried path.
+	class path_index
+	{
+	public:
+		void add_file(std::string_view path);
+
+		bool contains_file(std::string_view path) const;
+
+		// True if the directory holds an indexed file somewhere below it
+		bool contains_directory(std::string_view path) const;
+
+		size_t size() const;
+
+		static std::string normalize(std::string_view path);
+
+	private:
+		struct node_key
+		{
+			uint32_t parent;
+			std::string name;
+
+			bool operator==(const node_key&) const = default;
+		};
+
+		struct node_key_hash
+		{
+			size_t operator()(const node_key& key) const;
+		};
+
+		// Directory trie, the children of all nodes share one table keyed by their parent
+		std::unordered_map<node_key, uint32_t, node_key_hash> directories_{};
+		std::unordered_set<std::string> files_{};
+
+		std::optional<uint32_t> find_directory(std::string_view normalized_path) const;
+	};
+}
@@ -4,6 +4,15 @@
 
 namespace updater
 {
+	// Reported whenever the concurrency controller changes the number of transfers
+	struct concurrency_decision
+	{
+		size_t limit{};
+		size_t throughput{}; // Bytes per second
+		size_t stalled_transfers{};
+		const char* reason{};
+	};
+
 	class progress_listener
 	{
 	public:
@@ -12,9 +21,16 @@ namespace updater
 		virtual void update_files(const std::vector<file_info>& files) = 0;
 		virtual void done_update() = 0;
 
+		// Files can also be announced one by one while the scan is still running, the total is
+		// only final once done_adding_files is called
+		virtual void add_file(const file_info& file) = 0;
+		virtual void done_adding_files() = 0;
+
 		virtual void begin_file(const file_info& file) = 0;
 		virtual void end_file(const file_info& file) = 0;
 
 		virtual void file_progress(const file_info& file, size_t progress) = 0;
+
+		virtual void concurrency_changed(const concurrency_decision& decision) = 0;
 	};
 }
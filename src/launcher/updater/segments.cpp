@@ -0,0 +1,49 @@
+#include "std_include.hpp"
+
+#include "segments.hpp"
+
+namespace updater
+{
+	std::vector<segment> get_segments(const size_t size)
+	{
+		const auto count = std::max(1ull, std::min(max_segment_count, size / min_segment_size));
+		const auto length = (size + count - 1) / count;
+
+		std::vector<segment> segments{};
+		segments.reserve(count);
+
+		for (size_t start = 0; start < size; start += length)
+		{
+			segment segment{};
+			segment.start = start;
+			segment.length = std::min(length, size - start);
+			segments.emplace_back(segment);
+		}
+
+		return segments;
+	}
+
+	std::vector<segment> get_damaged_segments(const file_info& file, const std::vector<size_t>& chunks)
+	{
+		std::vector<segment> segments{};
+
+		for (const auto chunk : chunks)
+		{
+			const auto start = chunk * file.chunk_size;
+			const auto length = std::min(file.chunk_size, file.size - start);
+
+			if (!segments.empty() && segments.back().start + segments.back().length == start)
+			{
+				segments.back().length += length;
+				continue;
+			}
+
+			segment segment{};
+			segment.start = start;
+			segment.length = length;
+			segments.emplace_back(segment);
+		}
+
+		return segments;
+	}
+}
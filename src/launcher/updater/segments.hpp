@@ -0,0 +1,24 @@
+#pragma once
+
+#include "file_info.hpp"
+
+namespace updater
+{
+	constexpr size_t min_segment_size = 8 * 1024 * 1024;
+	constexpr size_t max_segment_count = 8;
+	constexpr size_t segmented_download_threshold = 2 * min_segment_size;
+
+	// Byte range of a file that is fetched with its own range request
+	struct segment
+	{
+		size_t start{};
+		size_t length{};
+		size_t written{};
+	};
+
+	// Splits a file into up to max_segment_count ranges of at least min_segment_size bytes
+	std::vector<segment> get_segments(size_t size);
+
+	// Merges adjacent damaged chunks, so each run can be fetched with a single range request
+	std::vector<segment> get_damaged_segments(const file_info& file, const std::vector<size_t>& chunks);
+}
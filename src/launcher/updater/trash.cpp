@@ -0,0 +1,189 @@
+#include "std_include.hpp"
+
+#include "trash.hpp"
+
+#include <utils/concurrency.hpp>
+#include <utils/exit_callback.hpp>
+#include <utils/io.hpp>
+
+#include <deque>
+
+namespace updater::trash
+{
+	namespace
+	{
+		constexpr size_t max_delete_threads = 4;
+
+		struct worker_state
+		{
+			std::deque<std::string> directories{};
+			std::thread thread{};
+			bool running{false};
+		};
+
+		std::atomic<bool> stopping{false};
+		std::atomic<uint64_t> entry_counter{0};
+
+		utils::concurrency::container<worker_state>& get_worker_state()
+		{
+			// Never destroyed, the exit callback still needs it after static destruction has begun
+			static auto* state = []()
+			{
+				auto* result = new utils::concurrency::container<worker_state>();
+
+				utils::at_exit([result]()
+				{
+					stopping = true;
+
+					auto thread = result->access<std::thread>([](worker_state& state)
+					{
+						return std::move(state.thread);
+					});
+
+					if (thread.joinable())
+					{
+						thread.join();
+					}
+				});
+
+				return result;
+			}();
+
+			return *state;
+		}
+
+		void enter_background_mode()
+		{
+			// Lowers the I/O priority as well, so deleting does not slow down downloads or the game
+			SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+		}
+
+		// Deletes entry by entry instead of using remove_all, so a large tree does not delay exiting
+		void remove_tree(const std::filesystem::path& path)
+		{
+			std::error_code code{};
+			if (std::filesystem::is_directory(std::filesystem::symlink_status(path, code)))
+			{
+				for (std::filesystem::directory_iterator iterator{path, code}, end{}; !code && iterator != end; iterator.increment(code))
+				{
+					if (stopping)
+					{
+						return;
+					}
+
+					remove_tree(iterator->path());
+				}
+			}
+
+			std::filesystem::remove(path, code);
+		}
+
+		void empty_directory(const std::string& directory)
+		{
+			if (!utils::io::directory_exists(directory))
+			{
+				return;
+			}
+
+			const auto entries = utils::io::list_files(directory);
+			std::atomic<size_t> next_entry{0};
+
+			const auto delete_entries = [&]()
+			{
+				enter_background_mode();
+
+				for (auto index = next_entry++; index < entries.size() && !stopping; index = next_entry++)
+				{
+					remove_tree(entries[index]);
+				}
+			};
+
+			std::vector<std::thread> threads{};
+			const auto thread_count = std::min(max_delete_threads, entries.size());
+
+			for (size_t i = 1; i < thread_count; ++i)
+			{
+				threads.emplace_back(delete_entries);
+			}
+
+			delete_entries();
+
+			for (auto& thread : threads)
+			{
+				if (thread.joinable())
+				{
+					thread.join();
+				}
+			}
+
+			std::error_code code{};
+			std::filesystem::remove(directory, code);
+		}
+
+		void run_worker()
+		{
+			enter_background_mode();
+
+			while (true)
+			{
+				const auto directory = get_worker_state().access<std::optional<std::string>>([](worker_state& state)
+					-> std::optional<std::string>
+					{
+						if (stopping || state.directories.empty())
+						{
+							state.running = false;
+							return {};
+						}
+
+						auto result = std::move(state.directories.front());
+						state.directories.pop_front();
+						return {std::move(result)};
+					});
+
+				if (!directory)
+				{
+					return;
+				}
+
+				empty_directory(*directory);
+			}
+		}
+	}
+
+	bool move(const std::string& trash_directory, const std::string& path)
+	{
+		std::error_code code{};
+		std::filesystem::create_directories(trash_directory, code);
+
+		// Unique across processes and runs, earlier leftovers may still be inside
+		const auto name = std::to_string(GetCurrentProcessId()) + "-" + std::to_string(GetTickCount64()) + "-" +
+			std::to_string(entry_counter++);
+
+		return MoveFileExA(path.data(), (trash_directory + "/" + name).data(), 0) != FALSE;
+	}
+
+	void empty(const std::string& trash_directory)
+	{
+		get_worker_state().access([&](worker_state& state)
+		{
+			if (std::find(state.directories.begin(), state.directories.end(), trash_directory) == state.directories.end())
+			{
+				state.directories.emplace_back(trash_directory);
+			}
+
+			if (state.running || stopping)
+			{
+				return;
+			}
+
+			// The previous worker has already finished, it only needs to be joined
+			if (state.thread.joinable())
+			{
+				state.thread.join();
+			}
+
+			state.running = true;
+			state.thread = std::thread(run_worker);
+		});
+	}
+}
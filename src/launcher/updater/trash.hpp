@@ -0,0 +1,12 @@
+#pragma once
+
+namespace updater::trash
+{
+	// Renames the entry into the trash directory, which is instant compared to deleting it.
+	// Fails if the entry can not be moved, the caller has to delete it in place then.
+	bool move(const std::string& trash_directory, const std::string& path);
+
+	// Deletes everything inside the trash directory on a low priority background thread, including
+	// leftovers of earlier runs. Deletion stops when the process exits, the next start picks it up again.
+	void empty(const std::string& trash_directory);
+}
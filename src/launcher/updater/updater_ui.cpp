@@ -3,6 +3,7 @@
 #include "update_cancelled.hpp"
 
 #include <utils/string.hpp>
+#include <utils/logger.hpp>
 
 namespace updater
 {
@@ -17,6 +18,7 @@ namespace updater
 		this->total_files_ = files;
 		this->downloaded_files_.clear();
 		this->downloading_files_.clear();
+		this->adding_files_ = false;
 
 		this->progress_ui_ = {};
 		this->progress_ui_.set_title("X Labs Updater");
@@ -35,6 +37,27 @@ namespace updater
 		this->downloading_files_.clear();
 	}
 
+	void updater_ui::add_file(const file_info& file)
+	{
+		this->handle_cancellation();
+
+		std::lock_guard<std::recursive_mutex> _{this->mutex_};
+
+		this->total_files_.emplace_back(file);
+		this->adding_files_ = true;
+
+		this->update_progress();
+		this->update_file_name();
+	}
+
+	void updater_ui::done_adding_files()
+	{
+		std::lock_guard<std::recursive_mutex> _{this->mutex_};
+
+		this->adding_files_ = false;
+		this->update_file_name();
+	}
+
 	void updater_ui::begin_file(const file_info& file)
 	{
 		this->handle_cancellation();
@@ -74,6 +97,22 @@ namespace updater
 		this->update_progress();
 	}
 
+	void updater_ui::concurrency_changed(const concurrency_decision& decision)
+	{
+		std::lock_guard<std::recursive_mutex> _{this->mutex_};
+
+		if (decision.limit == this->concurrency_limit_)
+		{
+			return;
+		}
+
+		utils::logger::write("Concurrent transfers {} -> {} ({}), throughput {} KiB/s, {} stalled",
+		                     this->concurrency_limit_, decision.limit, decision.reason, decision.throughput / 1024,
+		                     decision.stalled_transfers);
+
+		this->concurrency_limit_ = decision.limit;
+	}
+
 	void updater_ui::handle_cancellation() const
 	{
 		if (this->progress_ui_.is_cancelled())
@@ -95,7 +134,12 @@ namespace updater
 		const auto downloaded_file_count = this->get_downloaded_files();
 		const auto total_file_count = this->get_total_files();
 
-		if (downloaded_file_count == total_file_count)
+		if (this->adding_files_)
+		{
+			this->progress_ui_.set_line(1, utils::string::va("Updating files... (%zu/%zu, still checking)",
+			                                                 downloaded_file_count, total_file_count));
+		}
+		else if (downloaded_file_count == total_file_count)
 		{
 			this->progress_ui_.set_line(1, "Update successful.");
 		}
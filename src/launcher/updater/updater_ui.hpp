@@ -21,14 +21,22 @@ namespace updater
 
 		progress_ui progress_ui_{};
 
+		size_t concurrency_limit_{0};
+		bool adding_files_{false};
+
 		void update_files(const std::vector<file_info>& files) override;
 		void done_update() override;
 
+		void add_file(const file_info& file) override;
+		void done_adding_files() override;
+
 		void begin_file(const file_info& file) override;
 		void end_file(const file_info& file) override;
 
 		void file_progress(const file_info& file, size_t progress) override;
 
+		void concurrency_changed(const concurrency_decision& decision) override;
+
 		void handle_cancellation() const;
 		void update_progress() const;
 		void update_file_name() const;
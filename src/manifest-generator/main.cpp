@@ -0,0 +1,488 @@
+#include <utils/chunking.hpp>
+#include <utils/cryptography.hpp>
+#include <utils/io.hpp>
+#include <utils/manifest.hpp>
+#include <utils/pack.hpp>
+#include <utils/patch.hpp>
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <unordered_set>
+
+namespace
+{
+	constexpr size_t chunk_size = 4 * 1024 * 1024;
+
+	// Smaller files are cheap to download again, chunk hashes would only bloat the manifest
+	constexpr size_t default_chunk_threshold = 64 * 1024 * 1024;
+
+	// Suffix sorting the old file takes 8 bytes per byte, larger files rely on chunk deltas instead
+	constexpr size_t max_patch_file_size = 256 * 1024 * 1024;
+
+	// zlib counts bytes in 32 bits, larger files are compressed in pieces
+	constexpr size_t max_deflate_input = 1024 * 1024 * 1024;
+
+	constexpr auto patch_from_flag = "--patch-from=";
+
+	struct options
+	{
+		std::filesystem::path directory{};
+		std::string output{};
+		size_t chunk_threshold{default_chunk_threshold};
+		std::vector<std::filesystem::path> patch_sources{};
+	};
+
+	std::optional<options> parse_options(const int argc, char** argv)
+	{
+		options result{};
+		std::vector<std::string> arguments{};
+
+		for (auto i = 1; i < argc; ++i)
+		{
+			const std::string_view argument{argv[i]};
+			if (argument.starts_with(patch_from_flag))
+			{
+				result.patch_sources.emplace_back(argument.substr(strlen(patch_from_flag)));
+			}
+			else
+			{
+				arguments.emplace_back(argument);
+			}
+		}
+
+		if (arguments.size() < 2)
+		{
+			return {};
+		}
+
+		result.directory = arguments[0];
+		result.output = arguments[1];
+
+		if (arguments.size() > 2)
+		{
+			result.chunk_threshold = static_cast<size_t>(std::stoull(arguments[2]));
+		}
+
+		return {std::move(result)};
+	}
+
+	bool is_published_file(const std::filesystem::path& relative_path)
+	{
+		const auto name = relative_path.generic_string();
+		return !name.starts_with(utils::patch::directory) && !name.starts_with(utils::manifest::compressed_directory)
+			&& !name.starts_with(utils::pack::directory) && relative_path.extension() != utils::chunking::index_extension;
+	}
+
+	// Patches every older version of the file that differs, as long as the patch is clearly smaller than the file
+	void create_patches(utils::manifest::entry& entry, const std::string& data, const options& options)
+	{
+		if (data.size() > max_patch_file_size)
+		{
+			return;
+		}
+
+		for (const auto& source : options.patch_sources)
+		{
+			const auto old_file = (source / entry.name).generic_string();
+
+			std::string old_data{};
+			if (!utils::io::read_file(old_file, &old_data) || old_data.size() > max_patch_file_size)
+			{
+				continue;
+			}
+
+			const auto old_hash = utils::cryptography::sha1::compute(old_data);
+			const auto known = std::any_of(entry.patches.begin(), entry.patches.end(), [&](const utils::manifest::patch& patch)
+			{
+				return patch.source_hash == old_hash;
+			});
+
+			if (old_hash == entry.hash || known)
+			{
+				continue;
+			}
+
+			const auto patch = utils::patch::create(old_data, data);
+			if (patch.size() >= data.size() / 2)
+			{
+				std::cout << "Skipping patch for " << entry.name << " from " << source.generic_string() << ", it saves too little" << std::endl;
+				continue;
+			}
+
+			const auto patch_file = (options.directory / utils::patch::directory / utils::patch::get_name(old_hash, entry.hash)).generic_string();
+			if (!utils::io::write_file(patch_file, patch))
+			{
+				throw std::runtime_error("Failed to write " + patch_file);
+			}
+
+			std::cout << "Patched " << entry.name << " from " << source.generic_string() << " in " << patch.size() << " bytes" << std::endl;
+
+			utils::manifest::patch info{};
+			info.source_hash = old_hash;
+			info.size = patch.size();
+			entry.patches.emplace_back(info);
+		}
+	}
+
+	std::string gzip(const std::string& data)
+	{
+		z_stream stream{};
+		if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			throw std::runtime_error("Failed to initialize compression");
+		}
+
+		std::string result{};
+		std::string buffer(1024 * 1024, '\0');
+		size_t offset = 0;
+		auto status = Z_OK;
+
+		while (status != Z_STREAM_END)
+		{
+			if (stream.avail_in == 0 && offset < data.size())
+			{
+				const auto piece = std::min(data.size() - offset, max_deflate_input);
+				stream.next_in = reinterpret_cast<const Bytef*>(data.data() + offset);
+				stream.avail_in = static_cast<uInt>(piece);
+				offset += piece;
+			}
+
+			stream.next_out = reinterpret_cast<Bytef*>(buffer.data());
+			stream.avail_out = static_cast<uInt>(buffer.size());
+
+			status = deflate(&stream, offset == data.size() ? Z_FINISH : Z_NO_FLUSH);
+			if (status == Z_STREAM_ERROR)
+			{
+				deflateEnd(&stream);
+				throw std::runtime_error("Failed to compress data");
+			}
+
+			result.append(buffer.data(), buffer.size() - stream.avail_out);
+		}
+
+		deflateEnd(&stream);
+		return result;
+	}
+
+	// A gzip variant is only published if it saves at least a quarter of the transfer
+	void compress_file(utils::manifest::entry& entry, const std::string& data, const options& options)
+	{
+		if (data.empty())
+		{
+			return;
+		}
+
+		const auto compressed = gzip(data);
+		if (compressed.size() > data.size() / 4 * 3)
+		{
+			return;
+		}
+
+		const auto compressed_file = (options.directory / utils::manifest::compressed_directory
+			/ (entry.name + utils::manifest::compressed_extension)).generic_string();
+		if (!utils::io::write_file(compressed_file, compressed))
+		{
+			throw std::runtime_error("Failed to write " + compressed_file);
+		}
+
+		entry.compressed_size = compressed.size();
+	}
+
+	utils::manifest::entry hash_file(const std::filesystem::path& file, std::string name, const options& options)
+	{
+		utils::manifest::entry entry{};
+		entry.name = std::move(name);
+
+		std::string data{};
+		if (!utils::io::read_file(file.generic_string(), &data))
+		{
+			throw std::runtime_error("Failed to read " + file.generic_string());
+		}
+
+		entry.size = data.size();
+		entry.hash = utils::cryptography::sha1::compute(data);
+
+		if (data.size() >= options.chunk_threshold)
+		{
+			std::vector<std::string_view> chunks{};
+			for (size_t start = 0; start < data.size(); start += chunk_size)
+			{
+				chunks.emplace_back(data.data() + start, std::min(chunk_size, data.size() - start));
+			}
+
+			entry.chunk_size = chunk_size;
+			entry.chunk_hashes = utils::cryptography::sha1::compute_many(chunks);
+		}
+
+		// Published next to the file, clients use it to download only the parts that changed
+		if (data.size() >= utils::chunking::min_indexed_file_size)
+		{
+			const auto chunks = utils::chunking::split(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+			const auto index_file = file.generic_string() + utils::chunking::index_extension;
+
+			if (!utils::io::write_file(index_file, utils::chunking::write_index(chunks)))
+			{
+				throw std::runtime_error("Failed to write " + index_file);
+			}
+		}
+
+		create_patches(entry, data, options);
+		compress_file(entry, data, options);
+
+		return entry;
+	}
+
+	std::vector<utils::manifest::entry> hash_directory(const options& options)
+	{
+		std::vector<utils::manifest::entry> entries{};
+
+		for (const auto& file : std::filesystem::recursive_directory_iterator(options.directory))
+		{
+			// Chunk indices, patches, compressed variants and packs from a previous run are not part of the manifest
+			const auto relative_path = std::filesystem::relative(file.path(), options.directory);
+			if (!file.is_regular_file() || !is_published_file(relative_path))
+			{
+				continue;
+			}
+
+			auto name = relative_path.generic_string();
+			std::cout << "Hashing " << name << std::endl;
+
+			entries.emplace_back(hash_file(file.path(), std::move(name), options));
+		}
+
+		return entries;
+	}
+
+	// Concatenates the small files into packs, clients fetch many of them at once with a few range requests
+	void write_packs(const std::vector<utils::manifest::entry>& entries, const options& options)
+	{
+		std::unordered_set<utils::cryptography::sha1::digest> known{};
+		std::vector<const utils::manifest::entry*> members{};
+
+		for (const auto& entry : entries)
+		{
+			if (entry.size > 0 && entry.size <= utils::pack::max_member_size && known.emplace(entry.hash).second)
+			{
+				members.emplace_back(&entry);
+			}
+		}
+
+		// Files of one folder tend to change together, keeping them next to each other coalesces their ranges
+		std::sort(members.begin(), members.end(), [](const utils::manifest::entry* a, const utils::manifest::entry* b)
+		{
+			return a->name < b->name;
+		});
+
+		const auto directory = options.directory / utils::pack::directory;
+
+		utils::pack::index index{};
+		std::unordered_set<std::string> pack_names{};
+		std::string pack{};
+
+		const auto write_pack = [&]
+		{
+			if (pack.empty())
+			{
+				return;
+			}
+
+			const auto pack_hash = utils::cryptography::sha1::compute(pack);
+			const auto pack_file = (directory / utils::pack::get_name(pack_hash)).generic_string();
+
+			if (!utils::io::write_file(pack_file, pack))
+			{
+				throw std::runtime_error("Failed to write " + pack_file);
+			}
+
+			index.packs.emplace_back(utils::pack::pack{pack_hash, pack.size()});
+			pack_names.emplace(utils::pack::get_name(pack_hash));
+			pack.clear();
+		};
+
+		for (const auto* entry : members)
+		{
+			const auto file = (options.directory / entry->name).generic_string();
+
+			std::string data{};
+			if (!utils::io::read_file(file, &data) || data.size() != entry->size)
+			{
+				throw std::runtime_error("Failed to read " + file);
+			}
+
+			if (pack.size() + data.size() > utils::pack::max_pack_size)
+			{
+				write_pack();
+			}
+
+			utils::pack::member member{};
+			member.hash = entry->hash;
+			member.pack = static_cast<uint32_t>(index.packs.size());
+			member.length = static_cast<uint32_t>(data.size());
+			member.offset = pack.size();
+
+			index.members.emplace_back(member);
+			pack.append(data);
+		}
+
+		write_pack();
+
+		const auto index_file = (directory / utils::pack::index_name).generic_string();
+		if (!utils::io::write_file(index_file, utils::pack::write_index(index)))
+		{
+			throw std::runtime_error("Failed to write " + index_file);
+		}
+
+		// Packs of earlier runs are not referenced anymore, clients still holding an old index fall back to single files
+		for (const auto& file : utils::io::list_files(directory.generic_string()))
+		{
+			const auto path = std::filesystem::path(file);
+			if (path.extension() == utils::pack::extension && !pack_names.contains(path.filename().generic_string()))
+			{
+				utils::io::remove_file(file);
+			}
+		}
+
+		std::cout << "Packed " << index.members.size() << " small files into " << index.packs.size() << " packs" << std::endl;
+	}
+
+	void write_string(rapidjson::Writer<rapidjson::StringBuffer>& writer, const std::string& value)
+	{
+		writer.String(value.data(), static_cast<rapidjson::SizeType>(value.size()));
+	}
+
+	std::string write_json_manifest(const std::vector<utils::manifest::entry>& entries)
+	{
+		rapidjson::StringBuffer buffer{};
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+		writer.StartArray();
+
+		for (const auto& entry : entries)
+		{
+			writer.StartArray();
+			write_string(writer, entry.name);
+			writer.Uint64(entry.size);
+			write_string(writer, entry.hash.to_hex());
+
+			if (!entry.chunk_hashes.empty() || !entry.patches.empty() || entry.compressed_size)
+			{
+				writer.StartObject();
+
+				if (!entry.chunk_hashes.empty())
+				{
+					writer.Key("chunk_size");
+					writer.Uint64(entry.chunk_size);
+					writer.Key("chunks");
+					writer.StartArray();
+
+					for (const auto& chunk_hash : entry.chunk_hashes)
+					{
+						write_string(writer, chunk_hash.to_hex());
+					}
+
+					writer.EndArray();
+				}
+
+				if (!entry.patches.empty())
+				{
+					writer.Key("patches");
+					writer.StartArray();
+
+					for (const auto& patch : entry.patches)
+					{
+						writer.StartArray();
+						write_string(writer, patch.source_hash.to_hex());
+						writer.Uint64(patch.size);
+						writer.EndArray();
+					}
+
+					writer.EndArray();
+				}
+
+				if (entry.compressed_size)
+				{
+					writer.Key("compressed_size");
+					writer.Uint64(entry.compressed_size);
+				}
+
+				writer.EndObject();
+			}
+
+			writer.EndArray();
+		}
+
+		writer.EndArray();
+
+		return {buffer.GetString(), buffer.GetLength()};
+	}
+
+	// Reads the binary manifest back and compares every entry, so a broken image is never published
+	void verify_binary_manifest(const std::string& data, const std::vector<utils::manifest::entry>& entries)
+	{
+		const auto manifest = utils::manifest::binary_manifest::parse(data.data(), data.size());
+		if (!manifest || manifest->size() != entries.size())
+		{
+			throw std::runtime_error("Generated binary manifest is invalid");
+		}
+
+		for (const auto& entry : entries)
+		{
+			const auto view = manifest->find(entry.name);
+			if (!view || view->size != entry.size || view->chunk_count != entry.chunk_hashes.size()
+				|| view->patch_count != entry.patches.size() || view->compressed_size != entry.compressed_size
+				|| utils::cryptography::sha1::digest(view->hash) != entry.hash)
+			{
+				throw std::runtime_error("Generated binary manifest does not match entry " + entry.name);
+			}
+		}
+	}
+}
+
+int main(const int argc, char** argv)
+{
+	try
+	{
+		const auto options = parse_options(argc, argv);
+		if (!options)
+		{
+			std::cout << "Usage: manifest-generator <directory> <output name> [chunk threshold in bytes] "
+				"[--patch-from=<previous release directory>...]" << std::endl;
+			std::cout << "The directory can be served as the data folder of a local update server, "
+				"patches are written to its " << utils::patch::directory << " folder, compressed files to its "
+				<< utils::manifest::compressed_directory << " folder and packs of small files to its "
+				<< utils::pack::directory << " folder" << std::endl;
+			return 1;
+		}
+
+		const auto& output = options->output;
+		const auto entries = hash_directory(*options);
+		write_packs(entries, *options);
+
+		const auto binary_manifest = utils::manifest::write_binary_manifest(entries);
+		verify_binary_manifest(binary_manifest, entries);
+
+		if (!utils::io::write_file(output + ".json", write_json_manifest(entries))
+			|| !utils::io::write_file(output + ".bin", binary_manifest))
+		{
+			throw std::runtime_error("Failed to write " + output);
+		}
+
+		std::cout << "Wrote " << entries.size() << " entries to " << output << ".json and " << output << ".bin" << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
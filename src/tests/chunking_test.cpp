@@ -0,0 +1,254 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include "updater/chunk_delta.hpp"
+
+#include <utils/chunking.hpp>
+
+namespace tests
+{
+	namespace
+	{
+		namespace chunking = utils::chunking;
+
+		constexpr size_t benchmark_file_size = 64 * 1024 * 1024;
+		constexpr size_t benchmark_edit_length = 32 * 1024;
+		constexpr size_t benchmark_edit_percentages[] = {1, 10, 50};
+
+		std::vector<uint8_t> make_data(const size_t size, const uint32_t seed)
+		{
+			auto state = seed * 2654435761u + 1;
+
+			std::vector<uint8_t> data(size);
+			for (auto& byte : data)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				byte = static_cast<uint8_t>(state);
+			}
+
+			return data;
+		}
+
+		bool has_valid_boundaries(const std::vector<size_t>& boundaries, const size_t size)
+		{
+			size_t offset = 0;
+			for (size_t i = 0; i < boundaries.size(); ++i)
+			{
+				const auto length = boundaries[i] - offset;
+				const auto is_last = i + 1 == boundaries.size();
+
+				if (boundaries[i] <= offset || length > chunking::max_chunk_size || (!is_last && length < chunking::min_chunk_size))
+				{
+					return false;
+				}
+
+				offset = boundaries[i];
+			}
+
+			return offset == size;
+		}
+
+		// Fills the new file from the reused local chunks and the fetched ranges, like the updater does
+		std::vector<uint8_t> apply_plan(const updater::delta_plan& plan, const std::vector<uint8_t>& local, const std::vector<uint8_t>& remote)
+		{
+			std::vector<uint8_t> result(remote.size(), 0);
+			std::vector<uint8_t> covered(remote.size(), 0);
+
+			for (const auto& chunk : plan.reused)
+			{
+				std::memcpy(result.data() + chunk.offset, local.data() + chunk.local_offset, chunk.length);
+				std::fill_n(covered.begin() + static_cast<ptrdiff_t>(chunk.offset), chunk.length, uint8_t(1));
+			}
+
+			for (const auto& segment : plan.missing)
+			{
+				std::memcpy(result.data() + segment.start, remote.data() + segment.start, segment.length);
+				std::fill_n(covered.begin() + static_cast<ptrdiff_t>(segment.start), segment.length, uint8_t(1));
+			}
+
+			if (std::find(covered.begin(), covered.end(), uint8_t(0)) != covered.end())
+			{
+				return {};
+			}
+
+			return result;
+		}
+
+		// Overwrites the share of the file in runs spread evenly over it, and inserts a few bytes near the start
+		// so everything behind them is shifted
+		std::vector<uint8_t> make_edited_copy(const std::vector<uint8_t>& data, const size_t percentage)
+		{
+			auto result = data;
+
+			const auto edit_count = data.size() * percentage / 100 / benchmark_edit_length;
+			const auto stride = data.size() / edit_count;
+			const auto replacement = make_data(benchmark_edit_length, static_cast<uint32_t>(percentage));
+
+			for (size_t i = 0; i < edit_count; ++i)
+			{
+				std::memcpy(result.data() + i * stride + stride / 2, replacement.data(), replacement.size());
+			}
+
+			const auto insertion = make_data(100, 5);
+			result.insert(result.begin() + 1024 * 1024, insertion.begin(), insertion.end());
+
+			return result;
+		}
+
+		void test_boundaries()
+		{
+			const auto data = make_data(4 * 1024 * 1024, 1);
+			const auto boundaries = chunking::find_boundaries(data.data(), data.size());
+
+			expect(has_valid_boundaries(boundaries, data.size()), "chunks are within the size limits and cover the data");
+			expect(boundaries == chunking::find_boundaries(data.data(), data.size()), "boundaries are deterministic");
+
+			const auto count = boundaries.size();
+			const auto expected = data.size() / chunking::average_chunk_size;
+			expect(count > expected / 2 && count < expected * 2, "chunks are close to the average size");
+
+			expect(chunking::find_boundaries(data.data(), 0).empty(), "empty data has no chunks");
+			expect(chunking::find_boundaries(data.data(), 100) == std::vector<size_t>{100}, "small data is a single chunk");
+
+			// Constant data never hits the mask, every chunk is cut at the maximum size
+			const std::vector<uint8_t> zeros(5 * chunking::max_chunk_size / 2, 0);
+			const auto zero_boundaries = chunking::find_boundaries(zeros.data(), zeros.size());
+			expect(has_valid_boundaries(zero_boundaries, zeros.size()) && zero_boundaries.size() == 3
+			       && zero_boundaries[0] == chunking::max_chunk_size, "constant data is cut at the maximum size");
+
+			const auto chunks = chunking::split(data.data(), data.size());
+			auto matches = chunks.size() == boundaries.size();
+
+			for (size_t i = 0; matches && i < chunks.size(); ++i)
+			{
+				const auto& chunk = chunks[i];
+				matches = chunk.offset + chunk.length == boundaries[i]
+					&& chunk.hash == utils::cryptography::sha1::compute(data.data() + chunk.offset, chunk.length);
+			}
+
+			expect(matches, "split hashes every chunk at its boundary");
+		}
+
+		void test_delta()
+		{
+			const auto local = make_data(4 * 1024 * 1024, 2);
+
+			const auto unchanged = updater::plan_delta(chunking::split(local.data(), local.size()), local.data(), local.size());
+			expect(unchanged.missing.empty() && unchanged.missing_size == 0, "unchanged file needs no download");
+
+			// An insertion and a deletion only touch the chunks around them, everything else is found shifted
+			auto remote = local;
+			const auto insertion = make_data(1000, 3);
+			remote.insert(remote.begin() + 1'000'000, insertion.begin(), insertion.end());
+			remote.erase(remote.begin() + 3'000'000, remote.begin() + 3'000'500);
+
+			const auto remote_chunks = chunking::split(remote.data(), remote.size());
+			const auto plan = updater::plan_delta(remote_chunks, local.data(), local.size());
+
+			expect(plan.missing.size() == 2, "each edit is fetched with one range");
+			expect(plan.missing_size > 0 && plan.missing_size <= 2 * (2 * chunking::max_chunk_size + updater::max_delta_gap),
+			       "only the chunks around the edits are fetched");
+			expect(apply_plan(plan, local, remote) == remote, "reused and fetched ranges rebuild the file");
+
+			auto reused_valid = true;
+			for (const auto& chunk : plan.reused)
+			{
+				reused_valid = reused_valid && chunk.local_offset + chunk.length <= local.size()
+					&& std::memcmp(local.data() + chunk.local_offset, remote.data() + chunk.offset, chunk.length) == 0;
+			}
+
+			expect(reused_valid, "reused chunks match the remote bytes");
+
+			// Nothing can be reused from an empty local copy, the whole file is one range
+			const auto empty = updater::plan_delta(remote_chunks, nullptr, 0);
+			expect(empty.reused.empty() && empty.missing.size() == 1 && empty.missing_size == remote.size(),
+			       "empty local copy downloads everything in one range");
+		}
+
+		void test_index()
+		{
+			const auto data = make_data(1024 * 1024, 4);
+			const auto chunks = chunking::split(data.data(), data.size());
+			const auto index = chunking::write_index(chunks);
+
+			const auto parsed = chunking::parse_index(index.data(), index.size());
+			auto matches = parsed && parsed->size() == chunks.size();
+
+			for (size_t i = 0; matches && i < chunks.size(); ++i)
+			{
+				const auto& a = chunks[i];
+				const auto& b = (*parsed)[i];
+				matches = a.offset == b.offset && a.length == b.length && a.hash == b.hash;
+			}
+
+			expect(matches, "chunk index round trip");
+
+			const auto empty = chunking::write_index({});
+			const auto parsed_empty = chunking::parse_index(empty.data(), empty.size());
+			expect(parsed_empty && parsed_empty->empty(), "empty chunk index round trip");
+
+			const auto rejects = [](const std::string& corrupted)
+			{
+				return !chunking::parse_index(corrupted.data(), corrupted.size());
+			};
+
+			const auto with_value = [&](const size_t offset, const uint32_t value)
+			{
+				auto corrupted = index;
+				std::memcpy(corrupted.data() + offset, &value, sizeof(value));
+				return corrupted;
+			};
+
+			// Header: magic, version, 64 bit chunk count, then one record per chunk: length, hash
+			constexpr size_t header_size = 16;
+			constexpr size_t record_size = 24;
+
+			expect(rejects(index.substr(0, 8)), "truncated header is rejected");
+			expect(rejects(index.substr(0, index.size() - 1)), "truncated record is rejected");
+			expect(rejects(index.substr(0, index.size() - record_size)), "missing record is rejected");
+			expect(rejects(index + std::string(record_size, '\0')), "extra record is rejected");
+			expect(rejects(with_value(0, 0)), "bad magic is rejected");
+			expect(rejects(with_value(4, 2)), "unknown version is rejected");
+			expect(rejects(with_value(8, static_cast<uint32_t>(chunks.size() + 1))), "wrong chunk count is rejected");
+			expect(rejects(with_value(header_size, 0)), "empty chunk is rejected");
+			expect(rejects(with_value(header_size, static_cast<uint32_t>(chunking::max_chunk_size + 1))), "oversized chunk is rejected");
+		}
+	}
+
+	void run_chunking_tests()
+	{
+		test_boundaries();
+		test_delta();
+		test_index();
+	}
+	void run_chunking_benchmark()
+	{
+		const auto local = make_data(benchmark_file_size, 6);
+
+		for (const auto percentage : benchmark_edit_percentages)
+		{
+			const auto remote = make_edited_copy(local, percentage);
+
+			// Done once by the server when it publishes the file
+			const auto remote_chunks = chunking::split(remote.data(), remote.size());
+			const auto index_size = chunking::write_index(remote_chunks).size();
+
+			updater::delta_plan plan{};
+			const auto plan_time = measure_milliseconds([&]()
+			{
+				plan = updater::plan_delta(remote_chunks, local.data(), local.size());
+			});
+
+			const auto transferred = index_size + plan.missing_size;
+
+			std::cout << "  " << percentage << "% edited: " << transferred / 1024 << " KiB of " << remote.size() / 1024 << " KiB ("
+				<< 100.0 * static_cast<double>(transferred) / static_cast<double>(remote.size()) << "%) in " << plan.missing.size()
+				<< " ranges plus the " << index_size / 1024 << " KiB index, planned in " << plan_time << " ms" << std::endl;
+
+			expect(apply_plan(plan, local, remote) == remote, std::to_string(percentage) + "% edited file is rebuilt");
+			expect(transferred < remote.size(), std::to_string(percentage) + "% edited file needs less than a full download");
+		}
+	}
+}
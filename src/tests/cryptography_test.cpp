@@ -0,0 +1,355 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include "updater/file_check.hpp"
+
+#include <utils/cryptography.hpp>
+#include <utils/cryptography_lanes.hpp>
+#include <utils/cpu.hpp>
+#include <utils/io.hpp>
+
+namespace tests
+{
+	namespace
+	{
+		namespace sha1 = utils::cryptography::sha1;
+
+		constexpr size_t benchmark_message_count = 10'000;
+		constexpr size_t benchmark_min_message_size = 1024;
+		constexpr size_t benchmark_max_message_size = 64 * 1024;
+
+		struct known_vector
+		{
+			std::string message;
+			std::string_view hash;
+		};
+
+		// FIPS 180 examples, with messages on both sides of the padding boundary
+		std::vector<known_vector> get_known_vectors()
+		{
+			return {
+				{"", "DA39A3EE5E6B4B0D3255BFEF95601890AFD80709"},
+				{"abc", "A9993E364706816ABA3E25717850C26C9CD0D89D"},
+				{"The quick brown fox jumps over the lazy dog", "2FD4E1C67A2D28FCED849EE1BB76E7391B93EB12"},
+				{"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "84983E441C3BD26EBAAE4AA1F95129E5E54670F1"},
+				{
+					"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+					"A49B2446A02C645BF419F995B67091253A04A259"
+				},
+				{std::string(1'000'000, 'a'), "34AA973CD4C4DAA4F61EEB2BDBAD27316534016F"},
+			};
+		}
+
+		std::string make_message(const size_t length, const uint32_t seed)
+		{
+			auto state = seed * 2654435761u + 1;
+
+			std::string message(length, '\0');
+			for (auto& value : message)
+			{
+				state = state * 1664525u + 1013904223u;
+				value = static_cast<char>(state >> 24);
+			}
+
+			return message;
+		}
+
+		sha1::digest compute(const sha1::detail::compress_function compress, const std::string_view message, const size_t piece_size)
+		{
+			sha1::context context{compress};
+			for (size_t offset = 0; offset < message.size(); offset += piece_size)
+			{
+				context.update(message.data() + offset, std::min(piece_size, message.size() - offset));
+			}
+
+			return context.final();
+		}
+
+		void test_block_functions()
+		{
+			const auto functions = sha1::detail::get_compress_functions();
+			std::cout << "  " << functions.size() << " block functions" << std::endl;
+
+			for (size_t i = 0; i < functions.size(); ++i)
+			{
+				const auto prefix = "block function " + std::to_string(i) + ": ";
+
+				for (const auto& vector : get_known_vectors())
+				{
+					const auto description = prefix + "message of " + std::to_string(vector.message.size()) + " bytes";
+
+					// Odd piece sizes make the context buffer partial blocks
+					for (const auto piece_size : {vector.message.size() + 1, size_t{1}, size_t{63}, size_t{65}})
+					{
+						if (piece_size == 1 && vector.message.size() > 1000)
+						{
+							continue;
+						}
+
+						expect(compute(functions[i], vector.message, piece_size).to_hex() == vector.hash, description);
+					}
+				}
+
+				// Every length around the padding boundaries has to match the portable function
+				for (size_t length = 0; length <= 3 * sha1::block_size; ++length)
+				{
+					const auto message = make_message(length, static_cast<uint32_t>(length));
+					expect(compute(functions[i], message, message.size() + 1) == compute(functions[0], message, 7),
+					       prefix + "random message of " + std::to_string(length) + " bytes");
+				}
+			}
+
+			const auto abc = sha1::compute("abc"s);
+			expect(abc.to_hex() == "A9993E364706816ABA3E25717850C26C9CD0D89D", "default context picks a working function");
+		}
+
+		struct lane_kernel
+		{
+			const char* name;
+			sha1::detail::compute_many_function function;
+			bool supported;
+		};
+
+		void test_lanes()
+		{
+			const lane_kernel kernels[] =
+			{
+				{"SSE2", sha1::detail::compute_many_sse2, true},
+				{"AVX2", sha1::detail::compute_many_avx2, utils::cpu::has_avx2()},
+				{"AVX-512", sha1::detail::compute_many_avx512, utils::cpu::has_avx512f()},
+			};
+
+			// Lanes pick up the next message when theirs is done, so batches mix lengths and exceed the lane count
+			const auto vectors = get_known_vectors();
+
+			std::vector<std::string> messages{};
+			for (const auto& vector : vectors)
+			{
+				messages.emplace_back(vector.message);
+			}
+
+			for (size_t i = 0; i < 150; ++i)
+			{
+				const auto length = i < 130 ? i : 1000 + i * 997;
+				messages.emplace_back(make_message(length, static_cast<uint32_t>(i + 1000)));
+			}
+
+			std::vector<sha1::digest> expected{};
+			for (const auto& message : messages)
+			{
+				expected.emplace_back(sha1::compute(message));
+			}
+
+			for (const auto& kernel : kernels)
+			{
+				if (!kernel.supported)
+				{
+					std::cout << "  Skipping " << kernel.name << " lanes, not supported by this CPU" << std::endl;
+					continue;
+				}
+
+				const size_t batch_sizes[] = {0, 1, 3, 4, 5, 8, 9, 16, 17, messages.size()};
+				for (const auto count : batch_sizes)
+				{
+					std::vector<std::string_view> batch{};
+					for (size_t i = 0; i < count; ++i)
+					{
+						batch.emplace_back(messages[messages.size() - count + i]);
+					}
+
+					std::vector<sha1::digest> digests(count);
+					kernel.function(batch.data(), batch.size(), reinterpret_cast<uint8_t*>(digests.data()));
+
+					auto matches = 0u;
+					for (size_t i = 0; i < count; ++i)
+					{
+						matches += digests[i] == expected[messages.size() - count + i];
+					}
+
+					expect(matches == count, std::string{kernel.name} + " lanes hash a batch of " + std::to_string(count));
+				}
+
+				std::vector<std::string_view> known{messages.begin(), messages.begin() + vectors.size()};
+				std::vector<sha1::digest> digests(known.size());
+				kernel.function(known.data(), known.size(), reinterpret_cast<uint8_t*>(digests.data()));
+
+				for (size_t i = 0; i < vectors.size(); ++i)
+				{
+					expect(digests[i].to_hex() == vectors[i].hash, std::string{kernel.name} + " lanes match known vector " + std::to_string(i));
+				}
+			}
+
+			std::vector<std::string_view> all{messages.begin(), messages.end()};
+			expect(sha1::compute_many(all) == expected, "compute_many matches single hashing");
+		}
+
+		void test_hex()
+		{
+			using digest = sha1::digest;
+
+			uint8_t bytes[sha1::digest_size]{};
+			for (size_t i = 0; i < sizeof(bytes); ++i)
+			{
+				bytes[i] = static_cast<uint8_t>(i * 13 + 0xF0);
+			}
+
+			const digest value{bytes};
+			const auto hex = value.to_hex();
+			expect(hex == "F0FD0A1724313E4B5865727F8C99A6B3C0CDDAE7", "encoding uses uppercase digits");
+			expect(digest::from_hex(hex) == value, "uppercase hex round-trips");
+
+			auto lowercase = hex;
+			std::transform(lowercase.begin(), lowercase.end(), lowercase.begin(), [](const char c)
+			{
+				return c >= 'A' && c <= 'F' ? static_cast<char>(c - 'A' + 'a') : c;
+			});
+
+			expect(digest::from_hex(lowercase) == value, "lowercase hex is accepted");
+
+			for (size_t value_index = 0; value_index < 256; ++value_index)
+			{
+				uint8_t repeated[sha1::digest_size]{};
+				std::memset(repeated, static_cast<int>(value_index), sizeof(repeated));
+
+				const digest current{repeated};
+				if (digest::from_hex(current.to_hex()) != current)
+				{
+					expect(false, "byte " + std::to_string(value_index) + " round-trips");
+				}
+			}
+
+			expect(!digest::from_hex(hex.substr(1)), "short hex is rejected");
+			expect(!digest::from_hex(hex + "0"), "long hex is rejected");
+
+			// Both the vectorised first half and the scalar tail have to reject every non-digit
+			for (size_t position = 0; position < hex.size(); ++position)
+			{
+				for (const auto invalid : {'/', ':', '@', 'G', '`', 'g', ' ', '\0'})
+				{
+					auto text = hex;
+					text[position] = invalid;
+
+					if (digest::from_hex(text))
+					{
+						expect(false, "invalid character at " + std::to_string(position) + " is rejected");
+					}
+				}
+			}
+		}
+	}
+
+	void run_cryptography_tests()
+	{
+		test_block_functions();
+		test_lanes();
+		test_hex();
+	}
+	void run_cryptography_benchmark()
+	{
+		std::vector<std::string> messages{};
+		messages.reserve(benchmark_message_count);
+
+		size_t total_size = 0;
+		for (size_t i = 0; i < benchmark_message_count; ++i)
+		{
+			const auto length = benchmark_min_message_size + (i * 2654435761u) % (benchmark_max_message_size - benchmark_min_message_size + 1);
+			messages.emplace_back(make_message(length, static_cast<uint32_t>(i)));
+			total_size += length;
+		}
+
+		const std::vector<std::string_view> views{messages.begin(), messages.end()};
+
+		const auto print = [&](const std::string_view name, const double milliseconds)
+		{
+			std::cout << "  " << name << ": " << milliseconds << " ms, " << static_cast<double>(total_size) / 1024 / 1024 / (milliseconds / 1000)
+				<< " MiB/s" << std::endl;
+		};
+
+		std::cout << "  " << messages.size() << " messages of 1 to 64 KiB, " << total_size / 1024 << " KiB" << std::endl;
+
+		std::vector<sha1::digest> expected{};
+		expected.reserve(messages.size());
+
+		print("one at a time", measure_milliseconds([&]()
+		{
+			for (const auto& message : messages)
+			{
+				expected.emplace_back(sha1::compute(message));
+			}
+		}));
+
+		const lane_kernel kernels[] =
+		{
+			{"SSE2 lanes", sha1::detail::compute_many_sse2, true},
+			{"AVX2 lanes", sha1::detail::compute_many_avx2, utils::cpu::has_avx2()},
+			{"AVX-512 lanes", sha1::detail::compute_many_avx512, utils::cpu::has_avx512f()},
+		};
+
+		for (const auto& kernel : kernels)
+		{
+			if (!kernel.supported)
+			{
+				continue;
+			}
+
+			std::vector<sha1::digest> digests(views.size());
+			print(kernel.name, measure_milliseconds([&]()
+			{
+				kernel.function(views.data(), views.size(), reinterpret_cast<uint8_t*>(digests.data()));
+			}));
+
+			expect(digests == expected, std::string{kernel.name} + " match single hashing");
+		}
+
+		// The kernel the updater ends up with on this CPU
+		std::vector<sha1::digest> dispatched{};
+		print("compute_many", measure_milliseconds([&]()
+		{
+			dispatched = sha1::compute_many(views);
+		}));
+
+		expect(dispatched == expected, "compute_many matches single hashing");
+
+		// The same messages as a tree of files, hashed the way the outdated file scan does
+		const auto directory = std::filesystem::temp_directory_path() / "xlabs-tests" / "sha1-benchmark";
+		std::filesystem::remove_all(directory);
+
+		for (size_t i = 0; i < messages.size(); ++i)
+		{
+			utils::io::write_file((directory / std::to_string(i)).string(), messages[i]);
+		}
+
+		size_t tree_matches = 0;
+		print("tree, one file at a time", measure_milliseconds([&]()
+		{
+			for (size_t i = 0; i < messages.size(); ++i)
+			{
+				std::string data{};
+				tree_matches += utils::io::read_file((directory / std::to_string(i)).string(), &data) && sha1::compute(data) == expected[i];
+			}
+		}));
+
+		expect(tree_matches == messages.size(), "every file of the tree is hashed");
+
+		size_t batch_matches = 0;
+		updater::hash_cache cache{(directory / "hash_cache.bin").string()};
+		updater::batch_hasher hasher{cache, [&](const size_t index, const sha1::digest& hash)
+		{
+			batch_matches += hash == expected[index];
+		}};
+
+		print("tree, batch_hasher", measure_milliseconds([&]()
+		{
+			for (size_t i = 0; i < messages.size(); ++i)
+			{
+				hasher.add(i, (directory / std::to_string(i)).string(), {messages[i].size(), 0, i}, messages[i].size());
+			}
+
+			hasher.flush();
+		}));
+
+		expect(batch_matches == messages.size(), "every file of the tree is batch hashed");
+
+		std::filesystem::remove_all(directory);
+	}
+}
@@ -0,0 +1,140 @@
+#include "std_include.hpp"
+#include "test.hpp"
+#include "transfer_model.hpp"
+
+#include "updater/download_scheduler.hpp"
+
+#include <numeric>
+
+namespace tests
+{
+	namespace
+	{
+		constexpr updater::scheduling_policy policies[] =
+		{
+			updater::scheduling_policy::manifest_order,
+			updater::scheduling_policy::longest_first,
+			updater::scheduling_policy::byte_balanced,
+			updater::scheduling_policy::interleaved,
+		};
+
+		constexpr size_t benchmark_worker_count = 8;
+
+		// A link that is faster than any single connection, the tail is left to one connection if a big file starts late
+		constexpr link_model benchmark_link{50.0 * 1024 * 1024, 10.0 * 1024 * 1024};
+
+		// Mostly small files, some medium ones and one big file that the manifest lists last
+		std::vector<size_t> make_update_sizes()
+		{
+			uint32_t state = 0x2545F491;
+			const auto next = [&]()
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				return state;
+			};
+
+			std::vector<size_t> sizes{};
+			for (size_t i = 0; i < 2'000; ++i)
+			{
+				sizes.emplace_back(4 * 1024 + next() % (1024 * 1024));
+			}
+
+			for (size_t i = 0; i < 30; ++i)
+			{
+				sizes.emplace_back(8 * 1024 * 1024 + next() % (56 * 1024 * 1024));
+			}
+
+			sizes.emplace_back(300 * 1024 * 1024);
+			return sizes;
+		}
+	}
+
+	void run_download_scheduler_tests()
+	{
+		const std::vector<size_t> sizes{30, 0, 500, 20, 500, 1'000, 10, 0, 70};
+
+		for (const auto policy : policies)
+		{
+			const auto name = std::string(updater::get_scheduling_policy_name(policy));
+			expect(updater::parse_scheduling_policy(name) == policy, name + " is parsed back");
+
+			const auto scheduler = updater::create_download_scheduler(policy, 3);
+			for (size_t i = 0; i < sizes.size(); ++i)
+			{
+				scheduler->add(i, sizes[i]);
+			}
+
+			std::vector<size_t> handed_out(sizes.size(), 0);
+			for (size_t i = 0; i < sizes.size() * 2; ++i)
+			{
+				const auto index = scheduler->next(i % 3);
+				if (index && *index < sizes.size())
+				{
+					++handed_out[*index];
+				}
+			}
+
+			expect(std::ranges::all_of(handed_out, [](const size_t count) { return count == 1; }),
+			       name + " hands out every file exactly once");
+			expect(!scheduler->next(0), name + " runs dry");
+		}
+
+		const auto longest_first = updater::create_download_scheduler(updater::scheduling_policy::longest_first, 1);
+		for (size_t i = 0; i < sizes.size(); ++i)
+		{
+			longest_first->add(i, sizes[i]);
+		}
+
+		expect(longest_first->next(0) == 5, "longest first starts with the largest file");
+		expect(longest_first->next(0) == 2, "equal sizes keep their order");
+	}
+
+	void run_download_scheduler_benchmark()
+	{
+		const auto sizes = make_update_sizes();
+		const auto total_size = std::accumulate(sizes.begin(), sizes.end(), 0.0);
+		const auto largest = static_cast<double>(*std::ranges::max_element(sizes));
+
+		// No schedule can beat moving every byte over the link or the largest file over one connection
+		const auto lower_bound = std::max(total_size / benchmark_link.link_rate, largest / benchmark_link.connection_rate);
+
+		std::cout << "  " << sizes.size() << " files, " << static_cast<size_t>(total_size) / (1024 * 1024) << " MiB, "
+			<< benchmark_worker_count << " workers, lower bound " << lower_bound << " s" << std::endl;
+
+		std::unordered_map<updater::scheduling_policy, double> durations{};
+
+		for (const auto policy : policies)
+		{
+			const auto scheduler = updater::create_download_scheduler(policy, benchmark_worker_count);
+			for (size_t i = 0; i < sizes.size(); ++i)
+			{
+				scheduler->add(i, sizes[i]);
+			}
+
+			const auto duration = simulate_transfers(benchmark_link, benchmark_worker_count, [&](const size_t worker) -> std::optional<uint64_t>
+			{
+				const auto index = scheduler->next(worker);
+				if (!index)
+				{
+					return {};
+				}
+
+				return sizes[*index];
+			});
+
+			durations[policy] = duration;
+			std::cout << "  " << updater::get_scheduling_policy_name(policy) << ": " << duration << " s" << std::endl;
+		}
+
+		for (const auto policy : policies)
+		{
+			if (policy != updater::scheduling_policy::manifest_order)
+			{
+				expect(durations[policy] < durations[updater::scheduling_policy::manifest_order],
+				       std::string(updater::get_scheduling_policy_name(policy)) + " shortens the tail of the manifest order");
+			}
+		}
+	}
+}
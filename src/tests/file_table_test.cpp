@@ -0,0 +1,208 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include "updater/file_table.hpp"
+
+namespace tests
+{
+	namespace
+	{
+		using updater::file_table;
+
+		file_table::hash make_hash(const size_t index)
+		{
+			return utils::cryptography::sha1::compute(std::to_string(index));
+		}
+
+		std::string make_chunk_list(const size_t count)
+		{
+			std::string list{};
+			for (size_t i = 0; i < count; ++i)
+			{
+				list += (i ? ", \"" : "\"") + make_hash(100 + i).to_hex() + "\"";
+			}
+
+			return list;
+		}
+
+		std::string make_chunked_entry(const std::string_view name, const uint64_t size, const uint64_t chunk_size, const size_t chunk_count)
+		{
+			return "[\"" + std::string{name} + "\", " + std::to_string(size) + ", \"" + make_hash(size).to_hex() + "\", {\"chunk_size\": "
+				+ std::to_string(chunk_size) + ", \"chunks\": [" + make_chunk_list(chunk_count) + "]}]";
+		}
+
+		void test_chunk_tables()
+		{
+			// Chunk tables are only kept if they cover the file exactly, ceil(size / chunk_size) hashes
+			const auto json = "[" + make_chunked_entry("exact.bin", 300, 100, 3) + ", "
+				+ make_chunked_entry("partial.bin", 250, 100, 3) + ", "
+				+ make_chunked_entry("short.bin", 250, 100, 2) + ", "
+				+ make_chunked_entry("long.bin", 250, 100, 4) + ", "
+				+ make_chunked_entry("no-size.bin", 250, 0, 3) + ", "
+				+ make_chunked_entry("empty.bin", 0, 100, 1) + "]";
+
+			const auto table = updater::parse_file_table(json);
+			expect(table && table->size() == 6, "manifest with chunk tables is accepted");
+			if (!table || table->size() != 6)
+			{
+				return;
+			}
+
+			const size_t expected_chunks[] = {3, 3, 0, 0, 0, 0};
+			for (size_t i = 0; i < table->size(); ++i)
+			{
+				expect(table->get_chunk_count(i) == expected_chunks[i],
+				       "chunk table of " + std::string{table->get_name(i)} + (expected_chunks[i] ? " is kept" : " is dropped"));
+			}
+
+			const auto info = table->get_file_info(1);
+			expect(info.chunk_size == 100 && info.chunk_hashes.size() == 3 && info.chunk_hashes[2] == make_hash(102),
+			       "file info carries the chunk hashes");
+			expect(table->get_file_info(2).chunk_hashes.empty() && table->get_file_info(2).chunk_size == 0,
+			       "file info of a dropped table has no chunks");
+
+			// The binary image applies the same rule
+			std::vector<utils::manifest::entry> entries(3);
+			entries[0].name = "exact.bin";
+			entries[0].size = 300;
+			entries[0].chunk_size = 100;
+			entries[0].chunk_hashes = {make_hash(1), make_hash(2), make_hash(3)};
+			entries[1].name = "short.bin";
+			entries[1].size = 301;
+			entries[1].chunk_size = 100;
+			entries[1].chunk_hashes = {make_hash(1), make_hash(2), make_hash(3)};
+			entries[2].name = "unchunked.bin";
+			entries[2].size = 301;
+
+			const auto image = utils::manifest::write_binary_manifest(entries);
+			const auto manifest = utils::manifest::binary_manifest::parse(image.data(), image.size());
+			const auto loaded = manifest ? updater::load_file_table(*manifest) : std::nullopt;
+
+			expect(loaded && loaded->size() == 3, "binary manifest with chunk tables is loaded");
+			if (loaded && loaded->size() == 3)
+			{
+				expect(loaded->get_chunk_count(0) == 3 && loaded->get_file_info(0).chunk_hashes[1] == make_hash(2),
+				       "binary chunk table is kept");
+				expect(loaded->get_chunk_count(1) == 0, "binary chunk table that does not cover the file is dropped");
+				expect(loaded->get_chunk_count(2) == 0, "binary entry without chunks has none");
+			}
+
+			// Chunk tables survive the round trip through the applied manifest
+			const auto written = updater::write_binary_manifest(*table);
+			const auto reread = utils::manifest::binary_manifest::parse(written.data(), written.size());
+			const auto reloaded = reread ? updater::load_file_table(*reread) : std::nullopt;
+
+			expect(reloaded && reloaded->size() == table->size(), "table round-trips through the binary manifest");
+			if (reloaded && reloaded->size() == table->size())
+			{
+				// The image is sorted by name, so entries are matched up by their names
+				auto matches = true;
+				for (size_t i = 0; i < table->size(); ++i)
+				{
+					const auto original = table->get_file_info(i);
+					auto found = false;
+
+					for (size_t j = 0; j < reloaded->size(); ++j)
+					{
+						if (reloaded->get_name(j) == original.name)
+						{
+							const auto copy = reloaded->get_file_info(j);
+							found = copy.size == original.size && copy.hash == original.hash && copy.chunk_size == original.chunk_size
+								&& copy.chunk_hashes == original.chunk_hashes;
+						}
+					}
+
+					matches = matches && found;
+				}
+
+				expect(matches, "every entry keeps its chunk table through the round trip");
+			}
+		}
+
+		void test_json_handler()
+		{
+			const auto hash = make_hash(1).to_hex();
+			const auto quoted_hash = "\"" + hash + "\"";
+			const auto entry = "[\"a.txt\", 10, " + quoted_hash + "]";
+
+			const auto accepted = [](const std::string& json, const size_t entries)
+			{
+				const auto table = updater::parse_file_table(json);
+				return table && table->size() == entries;
+			};
+
+			const auto rejected = [](const std::string& json)
+			{
+				return !updater::parse_file_table(json);
+			};
+
+			expect(accepted("[]", 0), "empty manifest is accepted");
+			expect(accepted("[" + entry + ", " + entry + "]", 2), "plain entries are accepted");
+
+			// Unknown trailing elements and object members are skipped whatever they hold
+			expect(accepted("[[\"a.txt\", 10, " + quoted_hash + ", {}, \"extra\", -5, 1.5, null, true, [1, [2, {\"x\": []}]], {\"y\": {}}]]", 1),
+			       "unknown trailing elements are skipped");
+			expect(accepted("[[\"a.txt\", 10, " + quoted_hash + ", {\"future\": [1, {\"a\": -2}], \"other\": \"x\", \"chunk_size\": 100}]]", 1),
+			       "unknown members are skipped");
+			expect(accepted("[[\"a.txt\", 10, " + quoted_hash + ", {\"patches\": [[" + quoted_hash + ", 5, \"extra\"]]}]]", 1),
+			       "unknown trailing patch elements are skipped");
+
+			const auto table = updater::parse_file_table("[[\"a.txt\", 10, " + quoted_hash + ", {\"patches\": [[" + quoted_hash
+				+ ", 5], [\"" + make_hash(2).to_hex() + "\", 6]], \"compressed_size\": 7}]]");
+			expect(table && table->size() == 1 && table->get_patch_count(0) == 2 && table->get_compressed_size(0) == 7,
+			       "patches and the compressed size are read");
+			if (table && table->size() == 1 && table->get_patch_count(0) == 2)
+			{
+				const auto info = table->get_file_info(0);
+				expect(info.patches[1].source_hash == make_hash(2) && info.patches[1].size == 6, "patch fields are read in order");
+			}
+
+			const std::string malformed[] =
+			{
+				"",
+				"{}",
+				"\"x\"",
+				"[",
+				"[" + entry,
+				"[" + entry + "] x",
+				"[" + entry + ", 5]",
+				"[{\"name\": \"a.txt\"}]",
+				"[[\"a.txt\", 10]]",
+				"[[\"a.txt\"]]",
+				"[[]]",
+				"[[\"a.txt\", \"10\", " + quoted_hash + "]]",
+				"[[\"a.txt\", -1, " + quoted_hash + "]]",
+				"[[\"a.txt\", {}, " + quoted_hash + "]]",
+				"[[[\"a.txt\"], 10, " + quoted_hash + "]]",
+				"[[5, 10, " + quoted_hash + "]]",
+				"[[\"a.txt\", 10, \"" + hash.substr(1) + "\"]]",
+				"[[\"a.txt\", 10, \"" + hash.substr(1) + "X\"]]",
+				"[[\"a.txt\", 10, 5]]",
+				"[[\"../a.txt\", 10, " + quoted_hash + "]]",
+				"[[\"\", 10, " + quoted_hash + "]]",
+				"[[\"a.txt\", 10, " + quoted_hash + ", {\"chunks\": [\"zz\"]}]]",
+				"[[\"a.txt\", 10, " + quoted_hash + ", {\"chunks\": [1]}]]",
+				"[[\"a.txt\", 10, " + quoted_hash + ", {\"chunks\": 1}]]",
+				"[[\"a.txt\", 10, " + quoted_hash + ", {\"patches\": [[" + quoted_hash + "]]}]]",
+				"[[\"a.txt\", 10, " + quoted_hash + ", {\"patches\": [[\"zz\", 5]]}]]",
+				"[[\"a.txt\", 10, " + quoted_hash + ", {\"patches\": [5]}]]",
+				"[[\"a.txt\", 10, " + quoted_hash + ", {\"compressed_size\": \"7\"}]]",
+				"[[\"a.txt\", 10, " + quoted_hash + ", {\"chunk_size\": []}]]",
+			};
+
+			for (size_t i = 0; i < std::size(malformed); ++i)
+			{
+				expect(rejected(malformed[i]), "malformed manifest " + std::to_string(i) + " is rejected");
+			}
+
+			// A malformed entry anywhere rejects the whole manifest
+			expect(rejected("[" + entry + ", " + entry + ", [\"../x\", 1, " + quoted_hash + "]]"), "late malformed entry rejects everything");
+		}
+	}
+
+	void run_file_table_tests()
+	{
+		test_chunk_tables();
+		test_json_handler();
+	}
+}
@@ -0,0 +1,42 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include "updater/filesystem_snapshot.hpp"
+
+#include <utils/io.hpp>
+
+namespace tests
+{
+	void run_filesystem_snapshot_tests()
+	{
+		const auto directory = std::filesystem::temp_directory_path() / "xlabs-tests" / "snapshot";
+		std::filesystem::remove_all(directory);
+
+		// Spelled differently than the manifest, Windows resolves both to the same files
+		const auto root = directory.generic_string() + "/";
+		utils::io::write_file(root + "Data/Maps/MP_Test.ff", "map");
+		utils::io::write_file(root + "Data/sound.wav", "sound");
+		utils::io::write_file(root + "Junk.txt", "junk");
+
+		updater::filesystem_snapshot snapshot{root, {"data"}};
+
+		expect(snapshot.get_entry_count() == 5, "recursive directory is found with a different case");
+
+		const auto* map = snapshot.find("data/maps/mp_test.ff");
+		expect(map && !map->is_directory && map->metadata.size == 3, "file is found with a different case");
+		expect(map && map->path == "Data/Maps/MP_Test.ff", "entry keeps the spelling found on disk");
+		expect(snapshot.find("DATA\\SOUND.WAV") != nullptr, "file is found with other separators");
+		expect(snapshot.find("data/maps/mp_test") == nullptr, "prefix of a file is not found");
+
+		const auto listing = snapshot.list("data");
+		expect(listing.size() == 2 && listing[0].first == "Data/Maps" && listing[1].first == "Data/sound.wav",
+		       "listing of a differently cased directory keeps the spelling found on disk");
+		expect(snapshot.list("DATA", true).size() == 3, "recursive listing is found with a different case");
+
+		snapshot.remove("data/MAPS");
+		expect(!snapshot.find("Data/Maps") && !snapshot.find("Data/Maps/MP_Test.ff") && snapshot.get_entry_count() == 3,
+		       "removal folds case and takes the children along");
+
+		std::filesystem::remove_all(directory);
+	}
+}
@@ -0,0 +1,271 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include "updater/hash_cache.hpp"
+#include "updater/file_check.hpp"
+
+#include <utils/io.hpp>
+#include <utils/cryptography.hpp>
+
+namespace tests
+{
+	namespace
+	{
+		using utils::cryptography::sha1::digest;
+
+		constexpr size_t benchmark_file_count = 50'000;
+		constexpr size_t benchmark_invalidated_share = 10;
+
+		std::filesystem::path get_work_directory(const std::string_view name)
+		{
+			auto directory = std::filesystem::temp_directory_path() / "xlabs-tests" / name;
+			std::filesystem::remove_all(directory);
+			std::filesystem::create_directories(directory);
+			return directory;
+		}
+
+		utils::io::file_metadata make_metadata(const size_t index)
+		{
+			return {index, index * 7, index * 13};
+		}
+
+		digest make_hash(const size_t index)
+		{
+			return utils::cryptography::sha1::compute(std::to_string(index));
+		}
+
+		std::string make_path(const size_t index)
+		{
+			return "data/file" + std::to_string(index);
+		}
+
+		// Pseudo random content, every file gets its own size between 256 bytes and 8 KiB
+		std::string make_content(const size_t index, const size_t revision)
+		{
+			auto state = static_cast<uint32_t>(index * 2654435761u + revision * 40503u + 1);
+			const auto next = [&]()
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				return state;
+			};
+
+			std::string data(256 + next() % (8 * 1024 - 256), '\0');
+			for (auto& value : data)
+			{
+				value = static_cast<char>(next());
+			}
+
+			return data;
+		}
+
+		// What the manifest says about a file of the synthetic tree
+		struct tree_file
+		{
+			uint64_t size{};
+			digest hash{};
+		};
+
+		tree_file write_tree_file(const std::filesystem::path& directory, const size_t index, const size_t revision)
+		{
+			const auto content = make_content(index, revision);
+			utils::io::write_file((directory / "data" / std::to_string(index)).string(), content);
+
+			return {content.size(), utils::cryptography::sha1::compute(content)};
+		}
+
+		struct verify_result
+		{
+			size_t hits{0};
+			size_t hashed{0};
+			size_t outdated{0};
+			double milliseconds{0.0};
+		};
+
+		// The updater's check for every data file: the install is enumerated once, the snapshot's metadata decides
+		// whether the cached hash still applies, and the files that changed are hashed in batches
+		verify_result verify_tree(const std::filesystem::path& directory, const std::string& cache_file,
+		                          const std::vector<tree_file>& files)
+		{
+			const auto start = std::chrono::steady_clock::now();
+
+			verify_result result{};
+			updater::hash_cache cache{cache_file};
+			const updater::filesystem_snapshot snapshot{directory.string(), {"data"}};
+
+			updater::batch_hasher hasher{cache, [&](const size_t index, const digest& hash)
+			{
+				++result.hashed;
+				result.outdated += hash != files[index].hash;
+			}};
+
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				const auto name = "data/" + std::to_string(i);
+				const auto path = (directory / name).string();
+
+				utils::io::file_metadata metadata{};
+				const auto cached_result = updater::check_cached_file(cache, path, updater::find_file_metadata(snapshot, name),
+				                                                      files[i].size, files[i].hash, true, metadata);
+				if (cached_result)
+				{
+					++result.hits;
+					result.outdated += *cached_result;
+					continue;
+				}
+
+				if (!hasher.add(i, path, metadata, files[i].size))
+				{
+					++result.outdated;
+				}
+			}
+
+			hasher.flush();
+			cache.save();
+
+			result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			return result;
+		}
+
+		void print_result(const std::string_view name, const verify_result& result)
+		{
+			std::cout << "  " << name << ": " << result.milliseconds << " ms, " << result.hits << " cached, " << result.hashed
+				<< " hashed, " << result.outdated << " outdated" << std::endl;
+		}
+	}
+
+	void run_hash_cache_tests()
+	{
+		const auto directory = get_work_directory("hash-cache");
+		const auto cache_file = (directory / "hash_cache.bin").string();
+
+		{
+			updater::hash_cache cache{cache_file};
+			for (size_t i = 0; i < 100; ++i)
+			{
+				cache.store(make_path(i), make_metadata(i), make_hash(i));
+			}
+
+			cache.save();
+		}
+
+		{
+			updater::hash_cache cache{cache_file};
+
+			auto hits = 0;
+			for (size_t i = 0; i < 100; ++i)
+			{
+				const auto hash = cache.find(make_path(i), make_metadata(i));
+				hits += hash && *hash == make_hash(i);
+			}
+
+			expect(hits == 100, "every stored entry is found after reloading");
+			expect(!cache.find(make_path(1), make_metadata(2)), "changed metadata misses");
+			expect(!cache.find("data/unknown", make_metadata(1)), "unknown path misses");
+		}
+
+		{
+			// Only the entries looked at in this run survive the save
+			updater::hash_cache cache{cache_file};
+			for (size_t i = 0; i < 3; ++i)
+			{
+				cache.find(make_path(i), make_metadata(i));
+			}
+
+			cache.store(make_path(200), make_metadata(200), make_hash(200));
+			cache.save();
+		}
+
+		{
+			updater::hash_cache cache{cache_file};
+
+			auto hits = 0;
+			for (size_t i = 0; i < 100; ++i)
+			{
+				hits += cache.find(make_path(i), make_metadata(i)).has_value();
+			}
+
+			expect(hits == 3, "entries not seen in the last run are pruned");
+			expect(cache.find(make_path(200), make_metadata(200)) == make_hash(200), "stored entry is kept");
+		}
+
+		{
+			std::string data{};
+			expect(utils::io::read_file(cache_file, &data) && data.size() > 16, "cache file is written");
+
+			// Swapping the name references of the first two records breaks the ordering the lookups rely on.
+			// Records are 56 bytes behind a 16 byte header, the name offset and length start at byte 24.
+			constexpr size_t header_size = 16;
+			constexpr size_t record_size = 56;
+			constexpr size_t name_offset = 24;
+
+			if (data.size() > header_size + record_size * 2)
+			{
+				const auto first = data.begin() + header_size + name_offset;
+				std::swap_ranges(first, first + 8, first + record_size);
+				utils::io::write_file(cache_file, data);
+
+				updater::hash_cache cache{cache_file};
+				expect(!cache.find(make_path(200), make_metadata(200)), "unsorted cache file is discarded");
+			}
+		}
+
+		{
+			updater::hash_cache cache{cache_file};
+			cache.store(make_path(300), make_metadata(300), make_hash(300));
+
+			utils::io::file_metadata metadata{};
+			const auto check = [&](const std::optional<utils::io::file_metadata>& current, const uint64_t size, const digest& hash,
+			                       const bool use_cache)
+			{
+				return updater::check_cached_file(cache, make_path(300), current, size, hash, use_cache, metadata);
+			};
+
+			expect(check(make_metadata(300), 300, make_hash(300), true) == false, "cached hash decides an unchanged file");
+			expect(check(make_metadata(300), 300, make_hash(301), true) == true, "cached hash of other content is outdated");
+			expect(check({}, 300, make_hash(300), true) == true, "missing file is outdated");
+			expect(check(make_metadata(300), 301, make_hash(300), true) == true, "size mismatch is outdated");
+			expect(!check(make_metadata(300), 300, make_hash(300), false), "full verify hashes every file");
+			expect(metadata == make_metadata(300), "metadata to store the hash under is returned");
+		}
+
+		std::filesystem::remove_all(directory);
+	}
+
+	void run_hash_cache_benchmark()
+	{
+		const auto directory = get_work_directory("hash-cache-benchmark");
+		const auto cache_file = (directory / "hash_cache.bin").string();
+
+		std::cout << "  Writing " << benchmark_file_count << " files" << std::endl;
+
+		std::vector<tree_file> files{};
+		files.reserve(benchmark_file_count);
+
+		for (size_t i = 0; i < benchmark_file_count; ++i)
+		{
+			files.emplace_back(write_tree_file(directory, i, 0));
+		}
+
+		const auto cold = verify_tree(directory, cache_file, files);
+		print_result("cold", cold);
+		expect(cold.hashed == benchmark_file_count, "cold run hashes every file");
+
+		const auto warm = verify_tree(directory, cache_file, files);
+		print_result("warm", warm);
+		expect(warm.hits == benchmark_file_count, "warm run hashes nothing");
+
+		for (size_t i = 0; i < benchmark_file_count; i += benchmark_invalidated_share)
+		{
+			files[i] = write_tree_file(directory, i, 1);
+		}
+
+		const auto partial = verify_tree(directory, cache_file, files);
+		print_result("partially invalidated", partial);
+		expect(partial.hashed == benchmark_file_count / benchmark_invalidated_share, "only rewritten files are hashed again");
+		expect(cold.outdated + warm.outdated + partial.outdated == 0, "no file is reported outdated");
+
+		std::filesystem::remove_all(directory);
+	}
+}
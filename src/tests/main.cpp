@@ -0,0 +1,85 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+namespace
+{
+	struct suite
+	{
+		const char* name;
+		void (*run)();
+	};
+
+	constexpr suite test_suites[] =
+	{
+		{"hash cache", tests::run_hash_cache_tests},
+		{"download segments", tests::run_segments_tests},
+		{"cryptography", tests::run_cryptography_tests},
+		{"file table", tests::run_file_table_tests},
+		{"binary manifest", tests::run_manifest_tests},
+		{"path index", tests::run_path_index_tests},
+		{"chunk delta", tests::run_chunking_tests},
+		{"patch", tests::run_patch_tests},
+		{"pack index", tests::run_pack_tests},
+		{"filesystem snapshot", tests::run_filesystem_snapshot_tests},
+		{"download scheduler", tests::run_download_scheduler_tests},
+	};
+
+	constexpr suite benchmarks[] =
+	{
+		{"hash cache", tests::run_hash_cache_benchmark},
+		{"download segments", tests::run_segments_benchmark},
+		{"download scheduler", tests::run_download_scheduler_benchmark},
+		{"cryptography", tests::run_cryptography_benchmark},
+		{"binary manifest", tests::run_manifest_benchmark},
+		{"path index", tests::run_path_index_benchmark},
+		{"chunk delta", tests::run_chunking_benchmark},
+		{"patch", tests::run_patch_benchmark},
+		{"pack", tests::run_pack_benchmark},
+	};
+
+	// An empty filter runs every suite
+	void run_suites(const std::span<const suite> suites, const std::string_view filter = {})
+	{
+		for (const auto& current : suites)
+		{
+			if (!filter.empty() && current.name != filter)
+			{
+				continue;
+			}
+
+			std::cout << "Running " << current.name << std::endl;
+
+			try
+			{
+				current.run();
+			}
+			catch (const std::exception& e)
+			{
+				tests::expect(false, e.what());
+			}
+		}
+	}
+}
+
+int main(const int argc, char** argv)
+{
+	const auto run_benchmarks = argc > 1 && argv[1] == "--benchmark"sv;
+
+	run_suites(test_suites);
+
+	if (run_benchmarks)
+	{
+		// A name after the flag picks a single benchmark, e.g. --benchmark "download segments"
+		run_suites(benchmarks, argc > 2 ? argv[2] : ""sv);
+	}
+
+	const auto failures = tests::get_failure_count();
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "All checks passed" << std::endl;
+	return 0;
+}
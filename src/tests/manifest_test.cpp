@@ -0,0 +1,399 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include "updater/file_table.hpp"
+
+#include <utils/manifest.hpp>
+
+#include <rapidjson/document.h>
+
+namespace tests
+{
+	namespace
+	{
+		using utils::manifest::binary_manifest;
+
+		constexpr size_t benchmark_entry_counts[] = {1'000, 10'000, 100'000};
+		constexpr size_t benchmark_runs = 5;
+
+		// Layout of the image, the corruptions below write straight into it
+		constexpr size_t header_size = 24;
+		constexpr size_t entry_size = 56;
+
+		namespace header_field
+		{
+			constexpr size_t magic = 0;
+			constexpr size_t version = 4;
+			constexpr size_t entry_count = 8;
+			constexpr size_t chunk_count = 12;
+			constexpr size_t string_table_size = 16;
+			constexpr size_t patch_count = 20;
+		}
+
+		namespace entry_field
+		{
+			constexpr size_t name_offset = 16;
+			constexpr size_t name_length = 20;
+			constexpr size_t first_chunk = 24;
+			constexpr size_t chunk_count = 28;
+			constexpr size_t first_patch = 52;
+		}
+
+		utils::manifest::entry make_entry(const std::string& name, const uint64_t size)
+		{
+			utils::manifest::entry entry{};
+			entry.name = name;
+			entry.size = size;
+			entry.hash = utils::cryptography::sha1::compute(name);
+			return entry;
+		}
+
+		std::string make_image(const bool with_patches)
+		{
+			std::vector<utils::manifest::entry> entries{};
+			entries.emplace_back(make_entry("a.txt", 10));
+			entries.emplace_back(make_entry("b/c.dll", 2000));
+			entries.emplace_back(make_entry("d.bin", 300));
+
+			entries[2].chunk_size = 100;
+			for (size_t i = 0; i < 3; ++i)
+			{
+				entries[2].chunk_hashes.emplace_back(utils::cryptography::sha1::compute(std::to_string(i)));
+			}
+
+			if (with_patches)
+			{
+				entries[0].patches.push_back({utils::cryptography::sha1::compute("old a"s), 5});
+				entries[1].patches.push_back({utils::cryptography::sha1::compute("old c"s), 50});
+				entries[1].compressed_size = 700;
+			}
+
+			return utils::manifest::write_binary_manifest(std::move(entries));
+		}
+
+		std::string write_uint32(std::string image, const size_t offset, const uint32_t value)
+		{
+			std::memcpy(image.data() + offset, &value, sizeof(value));
+			return image;
+		}
+
+		uint32_t read_uint32(const std::string& image, const size_t offset)
+		{
+			uint32_t value{};
+			std::memcpy(&value, image.data() + offset, sizeof(value));
+			return value;
+		}
+
+		bool parses(const std::string& image)
+		{
+			return binary_manifest::parse(image.data(), image.size()).has_value();
+		}
+
+		size_t get_entry_offset(const size_t index, const size_t field)
+		{
+			return header_size + index * entry_size + field;
+		}
+
+		// Names and sizes spread like a game install, every tenth entry is large enough for a chunk table
+		std::vector<utils::manifest::entry> make_benchmark_entries(const size_t count)
+		{
+			std::vector<utils::manifest::entry> entries{};
+			entries.reserve(count);
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto entry = make_entry("zone/english/folder" + std::to_string(i % 97) + "/asset_file_" + std::to_string(i) + ".ff",
+				                        1024 + (i * 2654435761u) % (4 * 1024 * 1024));
+
+				if (i % 10 == 0)
+				{
+					entry.chunk_size = 1024 * 1024;
+					for (uint64_t offset = 0; offset < entry.size; offset += entry.chunk_size)
+					{
+						entry.chunk_hashes.emplace_back(utils::cryptography::sha1::compute(std::to_string(offset)));
+					}
+				}
+
+				entries.emplace_back(std::move(entry));
+			}
+
+			return entries;
+		}
+
+		std::string write_json_manifest(const std::vector<utils::manifest::entry>& entries)
+		{
+			std::string json = "[";
+			for (const auto& entry : entries)
+			{
+				json += (json.size() > 1 ? ",\n[\"" : "\n[\"") + entry.name + "\", " + std::to_string(entry.size) + ", \"" + entry.hash.to_hex() + "\"";
+
+				if (!entry.chunk_hashes.empty())
+				{
+					json += ", {\"chunk_size\": " + std::to_string(entry.chunk_size) + ", \"chunks\": [";
+					for (size_t i = 0; i < entry.chunk_hashes.size(); ++i)
+					{
+						json += (i ? ", \"" : "\"") + entry.chunk_hashes[i].to_hex() + "\"";
+					}
+
+					json += "]}";
+				}
+
+				json += "]";
+			}
+
+			return json + "\n]";
+		}
+
+		// Routes rapidjson's allocations through operator new, so the DOM is counted like everything else
+		struct counted_allocator
+		{
+			static const bool kNeedFree = true;
+
+			void* Malloc(const size_t size)
+			{
+				return size ? ::operator new(size) : nullptr;
+			}
+
+			void* Realloc(void* original, const size_t original_size, const size_t new_size)
+			{
+				if (new_size == 0)
+				{
+					::operator delete(original);
+					return nullptr;
+				}
+
+				auto* memory = ::operator new(new_size);
+				if (original)
+				{
+					std::memcpy(memory, original, std::min(original_size, new_size));
+					::operator delete(original);
+				}
+
+				return memory;
+			}
+
+			static void Free(void* memory)
+			{
+				::operator delete(memory);
+			}
+		};
+
+		// The entry type and parser the updater used before the file table, kept as the baseline
+		struct legacy_file_info
+		{
+			std::string name;
+			size_t size;
+			std::string hash;
+		};
+
+		std::optional<std::vector<legacy_file_info>> parse_legacy_file_infos(const std::string& json)
+		{
+			rapidjson::GenericDocument<rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<counted_allocator>, counted_allocator> doc{};
+			doc.Parse(json.data(), json.size());
+
+			if (!doc.IsArray())
+			{
+				return {};
+			}
+
+			std::vector<legacy_file_info> files{};
+
+			for (const auto& element : doc.GetArray())
+			{
+				if (!element.IsArray())
+				{
+					continue;
+				}
+
+				auto array = element.GetArray();
+
+				legacy_file_info info{};
+				info.name.assign(array[0].GetString(), array[0].GetStringLength());
+				info.size = array[1].GetInt64();
+				info.hash.assign(array[2].GetString(), array[2].GetStringLength());
+
+				files.emplace_back(std::move(info));
+			}
+
+			return files;
+		}
+
+		struct parse_result
+		{
+			double milliseconds{};
+			size_t peak_bytes{};
+			size_t retained_bytes{};
+			size_t entries{};
+		};
+
+		// Best time of a few runs, the heap figures are the same in every run
+		template <typename Parse>
+		parse_result measure_parse(const Parse& parse)
+		{
+			parse_result result{std::numeric_limits<double>::max()};
+
+			for (size_t run = 0; run < benchmark_runs; ++run)
+			{
+				const auto base = get_allocated_bytes();
+				reset_peak_allocated_bytes();
+
+				std::optional<decltype(parse())> parsed{};
+				const auto milliseconds = measure_milliseconds([&]()
+				{
+					parsed.emplace(parse());
+				});
+
+				result.milliseconds = std::min(result.milliseconds, milliseconds);
+				result.peak_bytes = get_peak_allocated_bytes() - base;
+				result.retained_bytes = get_allocated_bytes() - base;
+				result.entries = *parsed ? (*parsed)->size() : 0;
+			}
+
+			return result;
+		}
+
+		void print_parse_result(const std::string_view name, const parse_result& result)
+		{
+			std::cout << "    " << name << ": " << result.milliseconds << " ms, peak " << result.peak_bytes / 1024 << " KiB, kept "
+				<< result.retained_bytes / 1024 << " KiB" << std::endl;
+		}
+
+		void test_parse()
+		{
+			const auto image = make_image(false);
+			const auto manifest = binary_manifest::parse(image.data(), image.size());
+			expect(manifest && manifest->size() == 3, "valid image parses");
+
+			if (manifest)
+			{
+				const auto entry = manifest->find("b/c.dll");
+				expect(entry && entry->size == 2000 && entry->patch_count == 0 && entry->compressed_size == 0, "entries are found by name");
+				expect(!manifest->find("b"), "prefixes are not found");
+				expect(manifest->get(2).chunk_count == 3 && manifest->get(2).chunk_size == 100, "chunk table is read");
+			}
+
+			const auto extended = make_image(true);
+			const auto extended_manifest = binary_manifest::parse(extended.data(), extended.size());
+			expect(extended_manifest && extended_manifest->size() == 3, "image with patches parses");
+
+			if (extended_manifest)
+			{
+				const auto entry = extended_manifest->get(1);
+				expect(entry.patch_count == 1 && entry.get_patch(0).size == 50 && entry.compressed_size == 700,
+				       "patches and compressed sizes are read");
+				expect(extended_manifest->get(2).patch_count == 0, "patch runs end at the next entry");
+			}
+
+			expect(!binary_manifest::parse(image.data(), 0), "empty image is rejected");
+			expect(!parses(image.substr(0, header_size - 1)), "truncated header is rejected");
+			expect(!parses(image.substr(0, image.size() - 1)), "truncated image is rejected");
+			expect(!parses(image + '\0'), "trailing bytes are rejected");
+			expect(!parses(write_uint32(image, header_field::magic, 0x12345678)), "wrong magic is rejected");
+			expect(!parses(write_uint32(image, header_field::version, 3)), "unknown version is rejected");
+			expect(!parses(write_uint32(image, header_field::patch_count, 1)), "version 1 image with patches is rejected");
+
+			// Counts that would make the tables overflow the image
+			expect(!parses(write_uint32(image, header_field::entry_count, 0x10000000)), "oversized entry count is rejected");
+			expect(!parses(write_uint32(image, header_field::chunk_count, 0xFFFFFFFF)), "oversized chunk count is rejected");
+			expect(!parses(write_uint32(image, header_field::string_table_size, 0xFFFFFFFF)), "oversized string table is rejected");
+
+			const auto string_table_size = read_uint32(image, header_field::string_table_size);
+			expect(!parses(write_uint32(image, get_entry_offset(0, entry_field::name_offset), string_table_size)),
+			       "name starting past the string table is rejected");
+			expect(!parses(write_uint32(image, get_entry_offset(2, entry_field::name_length), string_table_size)),
+			       "name running past the string table is rejected");
+			expect(!parses(write_uint32(image, get_entry_offset(2, entry_field::first_chunk), 1)), "chunk run past the table is rejected");
+			expect(!parses(write_uint32(image, get_entry_offset(2, entry_field::chunk_count), 0xFFFFFFFF)), "huge chunk count is rejected");
+
+			// Lookups are a binary search, so names have to be strictly ascending
+			const auto first_name = read_uint32(image, get_entry_offset(0, entry_field::name_offset));
+			const auto first_length = read_uint32(image, get_entry_offset(0, entry_field::name_length));
+			auto duplicate = write_uint32(image, get_entry_offset(1, entry_field::name_offset), first_name);
+			duplicate = write_uint32(duplicate, get_entry_offset(1, entry_field::name_length), first_length);
+			expect(!parses(duplicate), "duplicate names are rejected");
+
+			auto swapped = write_uint32(image, get_entry_offset(2, entry_field::name_offset), first_name);
+			swapped = write_uint32(swapped, get_entry_offset(2, entry_field::name_length), first_length);
+			expect(!parses(swapped), "unsorted names are rejected");
+
+			expect(!parses(write_uint32(extended, get_entry_offset(2, entry_field::first_patch), 3)), "patch run past the table is rejected");
+			expect(!parses(write_uint32(extended, get_entry_offset(0, entry_field::first_patch), 2)), "descending patch runs are rejected");
+		}
+
+		void test_names()
+		{
+			const std::string_view valid_names[] = {"a.txt", "dir/file.dll", "dir\\file.dll", "..data/x", "a/..b/c", "dir/.hidden"};
+			const std::string_view invalid_names[] =
+			{
+				"../launcher.exe", "..", ".", "C:/x", "x:y", "/abs", "\\abs", "data/../../x", "data//x", "data/./x", "data\\..\\x", "dir/",
+			};
+
+			const auto load = [](const std::string_view name)
+			{
+				std::vector<utils::manifest::entry> entries{};
+				entries.emplace_back(make_entry(std::string{name}, 1));
+
+				const auto image = utils::manifest::write_binary_manifest(std::move(entries));
+				const auto manifest = binary_manifest::parse(image.data(), image.size());
+				return manifest && updater::load_file_table(*manifest).has_value();
+			};
+
+			for (const auto name : valid_names)
+			{
+				expect(load(name), "name " + std::string{name} + " is accepted");
+			}
+
+			for (const auto name : invalid_names)
+			{
+				expect(!load(name), "name " + std::string{name} + " is rejected");
+			}
+		}
+	}
+
+	void run_manifest_tests()
+	{
+		test_parse();
+		test_names();
+	}
+	void run_manifest_benchmark()
+	{
+		for (const auto count : benchmark_entry_counts)
+		{
+			const auto entries = make_benchmark_entries(count);
+			const auto json = write_json_manifest(entries);
+			const auto image = utils::manifest::write_binary_manifest(entries);
+
+			std::cout << "  " << count << " entries, files.json " << json.size() / 1024 << " KiB, binary " << image.size() / 1024
+				<< " KiB" << std::endl;
+
+			const auto json_dom = measure_parse([&]()
+			{
+				return parse_legacy_file_infos(json);
+			});
+
+			const auto json_table = measure_parse([&]()
+			{
+				return updater::parse_file_table(json);
+			});
+
+			const auto binary_view = measure_parse([&]()
+			{
+				return binary_manifest::parse(image.data(), image.size());
+			});
+
+			const auto binary_table = measure_parse([&]()
+			{
+				const auto manifest = binary_manifest::parse(image.data(), image.size());
+				return manifest ? updater::load_file_table(*manifest) : std::nullopt;
+			});
+
+			print_parse_result("files.json as a DOM, the previous parser", json_dom);
+			print_parse_result("files.json into a file table", json_table);
+			print_parse_result("binary manifest, mapped view", binary_view);
+			print_parse_result("binary manifest into a file table", binary_table);
+
+			expect(json_dom.entries == count && json_table.entries == count && binary_view.entries == count && binary_table.entries == count,
+			       "every parser sees all " + std::to_string(count) + " entries");
+		}
+	}
+}
@@ -0,0 +1,387 @@
+#include "std_include.hpp"
+#include "test.hpp"
+#include "transfer_model.hpp"
+
+#include "updater/pack_plan.hpp"
+
+#include <utils/pack.hpp>
+
+#include <numeric>
+
+namespace tests
+{
+	namespace
+	{
+		namespace pack = utils::pack;
+		namespace sha1 = utils::cryptography::sha1;
+
+		// Header: magic, version, pack count, member count
+		constexpr size_t header_size = 16;
+
+		// Pack record: hash, reserved, 64 bit size
+		constexpr size_t pack_record_size = 32;
+
+		// Member record: hash, pack, length, reserved, 64 bit offset
+		constexpr size_t member_record_size = 40;
+		constexpr size_t member_hash_offset = 0;
+		constexpr size_t member_pack_offset = 20;
+		constexpr size_t member_length_offset = 24;
+		constexpr size_t member_offset_offset = 32;
+
+		sha1::digest make_hash(const size_t i)
+		{
+			return sha1::compute(std::to_string(i));
+		}
+
+		pack::index make_index()
+		{
+			pack::index index{};
+			index.packs.push_back({make_hash(1000), 100'000});
+			index.packs.push_back({make_hash(1001), 50'000});
+
+			// Members are written unsorted, write_index sorts them by hash
+			uint64_t offsets[2]{};
+			for (uint32_t i = 0; i < 20; ++i)
+			{
+				const auto pack = i % 2;
+				const auto length = 1000 + i * 10;
+
+				index.members.push_back({make_hash(i), pack, length, offsets[pack]});
+				offsets[pack] += length;
+			}
+
+			return index;
+		}
+
+		template <typename T>
+		std::string with_value(std::string data, const size_t offset, const T value)
+		{
+			std::memcpy(data.data() + offset, &value, sizeof(value));
+			return data;
+		}
+
+		bool rejects(const std::string& data)
+		{
+			return !pack::parse_index(data.data(), data.size());
+		}
+
+		void test_round_trip()
+		{
+			const auto index = make_index();
+			const auto data = pack::write_index(index);
+
+			expect(data.size() == header_size + 2 * pack_record_size + 20 * member_record_size, "index has the documented layout");
+
+			const auto parsed = pack::parse_index(data.data(), data.size());
+			expect(parsed && parsed->packs.size() == 2 && parsed->members.size() == 20, "index round trip");
+
+			if (!parsed)
+			{
+				return;
+			}
+
+			expect(parsed->packs[1].hash == make_hash(1001) && parsed->packs[1].size == 50'000, "pack records are kept in order");
+			expect(std::is_sorted(parsed->members.begin(), parsed->members.end(), [](const pack::member& a, const pack::member& b)
+			{
+				return a.hash < b.hash;
+			}), "members are sorted by hash");
+
+			auto found_all = true;
+			for (const auto& member : index.members)
+			{
+				const auto* found = parsed->find(member.hash);
+				found_all = found_all && found && found->pack == member.pack && found->length == member.length && found->offset == member.offset;
+			}
+
+			expect(found_all, "every member is found by its hash");
+			expect(!parsed->find(make_hash(20)) && !parsed->find(make_hash(1000)), "unknown hashes are not found");
+
+			const auto empty = pack::write_index({});
+			const auto parsed_empty = pack::parse_index(empty.data(), empty.size());
+			expect(parsed_empty && parsed_empty->packs.empty() && parsed_empty->members.empty() && !parsed_empty->find(make_hash(0)),
+			       "empty index round trip");
+
+			expect(pack::get_name(make_hash(1000)) == make_hash(1000).to_hex() + ".pack", "packs are named after their hash");
+		}
+
+		void test_rejection()
+		{
+			const auto data = pack::write_index(make_index());
+			const auto first_member = header_size + 2 * pack_record_size;
+			const auto second_member = first_member + member_record_size;
+
+			expect(rejects(""), "empty data is rejected");
+			expect(rejects(data.substr(0, header_size - 1)), "truncated header is rejected");
+			expect(rejects(data.substr(0, data.size() - 1)), "truncated record is rejected");
+			expect(rejects(data.substr(0, data.size() - member_record_size)), "missing member is rejected");
+			expect(rejects(data + std::string(member_record_size, '\0')), "extra record is rejected");
+			expect(rejects(with_value<uint32_t>(data, 0, 0)), "bad magic is rejected");
+			expect(rejects(with_value<uint32_t>(data, 4, 2)), "unknown version is rejected");
+			expect(rejects(with_value<uint32_t>(data, 8, 3)), "wrong pack count is rejected");
+			expect(rejects(with_value<uint32_t>(data, 12, 0xFFFFFFFF)), "huge member count is rejected");
+
+			expect(rejects(with_value<uint32_t>(data, first_member + member_pack_offset, 2)), "member of a missing pack is rejected");
+			expect(rejects(with_value<uint32_t>(data, first_member + member_length_offset, 0)), "empty member is rejected");
+			expect(rejects(with_value<uint32_t>(data, first_member + member_length_offset, static_cast<uint32_t>(pack::max_member_size + 1))),
+			       "oversized member is rejected");
+			expect(rejects(with_value<uint64_t>(data, first_member + member_offset_offset, 100'000)), "member past its pack is rejected");
+			expect(rejects(with_value<uint64_t>(data, first_member + member_offset_offset, ~uint64_t(0))), "wrapping member offset is rejected");
+
+			// Packs shrinking below their members invalidate them as well
+			expect(rejects(with_value<uint64_t>(data, header_size + 24, 0)), "member past a shrunk pack is rejected");
+
+			const auto second_hash = data.substr(second_member + member_hash_offset, sha1::digest_size);
+			auto duplicate = data;
+			duplicate.replace(first_member + member_hash_offset, sha1::digest_size, second_hash);
+			expect(rejects(duplicate), "duplicate member hash is rejected");
+
+			auto unsorted = data;
+			unsorted.replace(second_member, member_record_size, data.substr(first_member, member_record_size));
+			unsorted.replace(first_member, member_record_size, data.substr(second_member, member_record_size));
+			expect(rejects(unsorted), "unsorted members are rejected");
+
+			expect(!rejects(with_value<uint32_t>(data, first_member + 28, 0xFFFFFFFF)), "reserved member field is ignored");
+		}
+
+		// Per-file downloads start at the concurrency controller's initial limit, pack ranges at max_range_requests
+		constexpr size_t file_worker_count = 4;
+		constexpr size_t range_request_count = 8;
+
+		// Small files are bound by the round trip of each request, not by the link
+		constexpr link_model benchmark_link{12.5 * 1000 * 1000, 5.0 * 1024 * 1024, 0.1};
+
+		constexpr size_t installed_file_count = 20'000;
+		constexpr size_t outdated_file_count = 2'000;
+
+		// Small files packed in manifest order, the way the manifest generator writes them
+		pack::index make_installed_index()
+		{
+			uint32_t state = 0x2545F491;
+			pack::index index{};
+			uint64_t pack_size = 0;
+
+			for (size_t i = 0; i < installed_file_count; ++i)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+
+				const auto length = 1024 + state % (63 * 1024);
+				if (pack_size + length > pack::max_pack_size)
+				{
+					index.packs.push_back({make_hash(index.packs.size()), pack_size});
+					pack_size = 0;
+				}
+
+				index.members.push_back({make_hash(i), static_cast<uint32_t>(index.packs.size()), length, pack_size});
+				pack_size += length;
+			}
+
+			index.packs.push_back({make_hash(index.packs.size()), pack_size});
+			return index;
+		}
+
+		// An update that touches a few folders changes runs of neighbouring files
+		std::vector<size_t> make_clustered_update()
+		{
+			std::vector<size_t> members{};
+			for (size_t run = 0; run < 20; ++run)
+			{
+				for (size_t i = 0; i < outdated_file_count / 20; ++i)
+				{
+					members.emplace_back(run * (installed_file_count / 20) + i);
+				}
+			}
+
+			return members;
+		}
+
+		// Every tenth file, spread over all packs
+		std::vector<size_t> make_scattered_update()
+		{
+			std::vector<size_t> members{};
+			for (size_t i = 0; i < outdated_file_count; ++i)
+			{
+				members.emplace_back(i * (installed_file_count / outdated_file_count));
+			}
+
+			return members;
+		}
+
+		struct planned_pack
+		{
+			uint64_t size;
+			updater::pack_plan plan;
+		};
+
+		struct pack_update
+		{
+			std::vector<planned_pack> packs{};
+			std::vector<uint64_t> file_sizes{};
+		};
+
+		// Plans the packs the way update_packed_files does, members of packs that are not worth it are fetched on
+		// their own
+		pack_update plan_update(const pack::index& index, const std::vector<size_t>& outdated)
+		{
+			std::unordered_map<uint32_t, updater::pack_plan> packs{};
+			for (const auto i : outdated)
+			{
+				const auto& member = index.members[i];
+				updater::file_info file{};
+				file.name = std::to_string(i);
+				file.size = member.length;
+				file.hash = member.hash;
+
+				packs[member.pack].members.emplace_back(updater::pack_member{std::move(file), {}, {}, member.offset, false});
+			}
+
+			pack_update update{};
+			for (auto& [pack, plan] : packs)
+			{
+				updater::plan_pack(plan, index.packs[pack].size);
+
+				if (updater::is_pack_worthwhile(plan))
+				{
+					update.packs.emplace_back(planned_pack{index.packs[pack].size, std::move(plan)});
+					continue;
+				}
+
+				for (const auto& member : plan.members)
+				{
+					update.file_sizes.emplace_back(member.file.size);
+				}
+			}
+
+			return update;
+		}
+
+		double simulate_files(const std::vector<uint64_t>& sizes)
+		{
+			size_t next_file = 0;
+			return simulate_transfers(benchmark_link, file_worker_count, [&](size_t) -> std::optional<uint64_t>
+			{
+				if (next_file >= sizes.size())
+				{
+					return {};
+				}
+
+				return sizes[next_file++];
+			});
+		}
+
+		// All packs are fetched at once, each with up to range_request_count requests, next to the workers that
+		// download the leftover files
+		double simulate_update(const pack_update& update)
+		{
+			std::vector<std::vector<uint64_t>> requests{};
+			std::vector<size_t> worker_requests{};
+
+			for (const auto& [size, plan] : update.packs)
+			{
+				std::vector<uint64_t> sizes{};
+				if (plan.whole_pack)
+				{
+					sizes.emplace_back(size);
+				}
+				else
+				{
+					for (const auto& range : plan.ranges)
+					{
+						sizes.emplace_back(range.end - range.start);
+					}
+				}
+
+				const auto workers = std::min(range_request_count, sizes.size());
+				for (size_t i = 0; i < workers; ++i)
+				{
+					worker_requests.emplace_back(requests.size());
+				}
+
+				requests.emplace_back(std::move(sizes));
+			}
+
+			for (size_t i = 0; i < std::min(file_worker_count, update.file_sizes.size()); ++i)
+			{
+				worker_requests.emplace_back(requests.size());
+			}
+
+			requests.emplace_back(update.file_sizes);
+
+			std::vector<size_t> next_request(requests.size(), 0);
+			return simulate_transfers(benchmark_link, worker_requests.size(), [&](const size_t worker) -> std::optional<uint64_t>
+			{
+				const auto list = worker_requests[worker];
+				if (next_request[list] >= requests[list].size())
+				{
+					return {};
+				}
+
+				return requests[list][next_request[list]++];
+			});
+		}
+	}
+
+	void run_pack_tests()
+	{
+		test_round_trip();
+		test_rejection();
+	}
+	void run_pack_benchmark()
+	{
+		const auto index = make_installed_index();
+
+		// Scattered files are too far apart to coalesce, they have to fall back to single files at no extra cost
+		const std::tuple<const char*, std::vector<size_t>, bool> updates[] =
+		{
+			{"clustered", make_clustered_update(), true},
+			{"scattered", make_scattered_update(), false},
+		};
+
+		std::cout << "  " << installed_file_count << " installed small files in " << index.packs.size() << " packs, "
+			<< outdated_file_count << " outdated" << std::endl;
+
+		for (const auto& [name, outdated, coalesces] : updates)
+		{
+			std::vector<uint64_t> sizes{};
+			uint64_t file_bytes = 0;
+			for (const auto i : outdated)
+			{
+				sizes.emplace_back(index.members[i].length);
+				file_bytes += index.members[i].length;
+			}
+
+			pack_update update{};
+			const auto plan_time = measure_milliseconds([&]()
+			{
+				update = plan_update(index, outdated);
+			});
+
+			auto requests = update.file_sizes.size();
+			auto pack_bytes = std::accumulate(update.file_sizes.begin(), update.file_sizes.end(), uint64_t(0));
+			for (const auto& [size, plan] : update.packs)
+			{
+				requests += plan.whole_pack ? 1 : plan.ranges.size();
+				pack_bytes += plan.whole_pack ? size : plan.range_size;
+			}
+
+			const auto per_file_time = simulate_files(sizes);
+			const auto pack_time = simulate_update(update);
+
+			std::cout << "  " << name << ": per file " << outdated.size() << " requests, " << file_bytes / 1024 << " KiB, "
+				<< per_file_time << " s; packs " << requests << " requests (" << update.packs.size() << " packs, "
+				<< update.file_sizes.size() << " files on their own), " << pack_bytes / 1024 << " KiB, " << pack_time
+				<< " s; planned in " << plan_time << " ms" << std::endl;
+
+			if (coalesces)
+			{
+				expect(requests * 10 < outdated.size(), "packs need far fewer requests than single files");
+				expect(pack_time * 2 < per_file_time, "packs finish well before single files");
+			}
+			else
+			{
+				expect(update.packs.empty() && requests == outdated.size(), "scattered files are fetched on their own");
+			}
+		}
+	}
+}
@@ -0,0 +1,326 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include <utils/patch.hpp>
+
+#include <zlib.h>
+
+namespace tests
+{
+	namespace
+	{
+		namespace patch = utils::patch;
+
+		constexpr size_t benchmark_file_sizes[] = {1024 * 1024, 8 * 1024 * 1024};
+		constexpr size_t benchmark_instruction_size = 16;
+		constexpr size_t benchmark_inserted_code = 4096;
+
+		std::string make_data(const size_t size, const uint32_t seed)
+		{
+			auto state = seed * 2654435761u + 1;
+
+			std::string data(size, '\0');
+			for (auto& byte : data)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				byte = static_cast<char>(state);
+			}
+
+			return data;
+		}
+
+		// A rebuilt file: some bytes changed in place, a block inserted, one removed and a tail appended
+		std::string make_new_version(std::string data)
+		{
+			for (size_t i = 0; i < data.size(); i += 997)
+			{
+				data[i] = static_cast<char>(data[i] + 1);
+			}
+
+			data.insert(data.size() / 3, make_data(3000, 7));
+			data.erase(2 * data.size() / 3, 2000);
+			data.append(make_data(500, 8));
+
+			return data;
+		}
+
+		// Code-like data: instructions from a small set, each with an absolute address operand that points
+		// a little ahead of it
+		std::string make_code(const size_t size, const uint32_t seed, const uint32_t base_address)
+		{
+			const auto opcodes = make_data(32 * 8, 9);
+			auto state = seed * 2654435761u + 1;
+
+			std::string code(size, '\0');
+			for (size_t offset = 0; offset + benchmark_instruction_size <= size; offset += benchmark_instruction_size)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+
+				const auto address = base_address + static_cast<uint32_t>(offset) + (state & 0xFF0);
+				std::memcpy(code.data() + offset, opcodes.data() + (state >> 27) * 8, 8);
+				std::memcpy(code.data() + offset + 8, &address, sizeof(address));
+				std::memset(code.data() + offset + 12, static_cast<int>(state >> 24 & 0x3), 4);
+			}
+
+			return code;
+		}
+
+		// The next release: a function was added a third into the file, which moves every address behind it,
+		// and one instruction in a hundred changed
+		std::string make_next_release(const std::string& code)
+		{
+			const auto insert_at = code.size() / 3 / benchmark_instruction_size * benchmark_instruction_size;
+
+			auto result = code.substr(0, insert_at) + make_code(benchmark_inserted_code, 10, static_cast<uint32_t>(insert_at));
+			for (size_t offset = insert_at; offset + benchmark_instruction_size <= code.size(); offset += benchmark_instruction_size)
+			{
+				auto instruction = code.substr(offset, benchmark_instruction_size);
+
+				uint32_t address{};
+				std::memcpy(&address, instruction.data() + 8, sizeof(address));
+				address += benchmark_inserted_code;
+				std::memcpy(instruction.data() + 8, &address, sizeof(address));
+
+				result += instruction;
+			}
+
+			for (size_t offset = 0; offset < result.size(); offset += 100 * benchmark_instruction_size)
+			{
+				result[offset] = static_cast<char>(result[offset] ^ 0x5A);
+			}
+
+			return result;
+		}
+
+		size_t get_compressed_size(const std::string& data)
+		{
+			auto length = compressBound(static_cast<uLong>(data.size()));
+			std::string compressed(length, '\0');
+			if (compress2(reinterpret_cast<Bytef*>(compressed.data()), &length, reinterpret_cast<const Bytef*>(data.data()),
+			              static_cast<uLong>(data.size()), Z_BEST_COMPRESSION) != Z_OK)
+			{
+				return 0;
+			}
+
+			return length;
+		}
+
+		// Header: magic, reserved, old size, new size, then the raw and compressed sizes of the control, diff and extra streams
+		constexpr size_t header_size = 72;
+		constexpr size_t stream_sizes_offset = 24;
+		constexpr size_t compressed_sizes_offset = 48;
+
+		// Control entries: diff length, extra length and seek, all signed 64 bit
+		constexpr size_t control_entry_size = 24;
+		constexpr size_t seek_offset = 16;
+
+		// Rebuilds the patch with the seek of one control entry replaced, the streams stay valid so only the seek check can reject it
+		std::string with_seek(const std::string& data, const size_t entry, const int64_t seek)
+		{
+			uint64_t control_size{};
+			uint64_t compressed_size{};
+			std::memcpy(&control_size, data.data() + stream_sizes_offset, sizeof(control_size));
+			std::memcpy(&compressed_size, data.data() + compressed_sizes_offset, sizeof(compressed_size));
+
+			std::string control(static_cast<size_t>(control_size), '\0');
+			auto length = static_cast<uLongf>(control.size());
+			if (uncompress(reinterpret_cast<Bytef*>(control.data()), &length, reinterpret_cast<const Bytef*>(data.data() + header_size),
+			               static_cast<uLong>(compressed_size)) != Z_OK || (entry + 1) * control_entry_size > control.size())
+			{
+				return {};
+			}
+
+			std::memcpy(control.data() + entry * control_entry_size + seek_offset, &seek, sizeof(seek));
+
+			std::string compressed(compressBound(static_cast<uLong>(control.size())), '\0');
+			auto compressed_length = static_cast<uLongf>(compressed.size());
+			if (compress2(reinterpret_cast<Bytef*>(compressed.data()), &compressed_length, reinterpret_cast<const Bytef*>(control.data()),
+			              static_cast<uLong>(control.size()), Z_BEST_COMPRESSION) != Z_OK)
+			{
+				return {};
+			}
+
+			compressed.resize(compressed_length);
+
+			auto result = data.substr(0, header_size);
+			const uint64_t new_compressed_size = compressed.size();
+			std::memcpy(result.data() + compressed_sizes_offset, &new_compressed_size, sizeof(new_compressed_size));
+
+			return result + compressed + data.substr(header_size + static_cast<size_t>(compressed_size));
+		}
+
+		int64_t get_seek(const std::string& data, const size_t entry)
+		{
+			uint64_t compressed_size{};
+			std::memcpy(&compressed_size, data.data() + compressed_sizes_offset, sizeof(compressed_size));
+
+			std::string control((entry + 1) * control_entry_size, '\0');
+			auto length = static_cast<uLongf>(control.size());
+			uncompress(reinterpret_cast<Bytef*>(control.data()), &length, reinterpret_cast<const Bytef*>(data.data() + header_size),
+			           static_cast<uLong>(compressed_size));
+
+			int64_t seek{};
+			std::memcpy(&seek, control.data() + entry * control_entry_size + seek_offset, sizeof(seek));
+			return seek;
+		}
+
+		bool round_trips(const std::string& old_data, const std::string& new_data)
+		{
+			const auto result = patch::apply(old_data, patch::create(old_data, new_data), new_data.size());
+			return result && *result == new_data;
+		}
+
+		// Corrupted patches have to fail cleanly, the updater then falls back to a full download
+		bool is_rejected(const std::string& old_data, const std::string_view corrupted, const uint64_t expected_size)
+		{
+			try
+			{
+				return !patch::apply(old_data, corrupted, expected_size);
+			}
+			catch (...)
+			{
+				return false;
+			}
+		}
+
+		void test_round_trip()
+		{
+			const auto old_data = make_data(256 * 1024, 1);
+			const auto new_data = make_new_version(old_data);
+
+			expect(round_trips(old_data, new_data), "patch round trip");
+			expect(round_trips(old_data, old_data), "unchanged file round trip");
+			expect(round_trips("", new_data), "patch from an empty file");
+			expect(round_trips(old_data, ""), "patch to an empty file");
+			expect(round_trips("", ""), "patch between empty files");
+			expect(round_trips("abc", "abd"), "patch between tiny files");
+			expect(round_trips(make_data(100'000, 2), make_data(100'000, 3)), "patch between unrelated files");
+
+			const auto data = patch::create(old_data, new_data);
+			expect(data.size() < new_data.size() / 10, "similar files give small patches");
+
+			std::string streamed{};
+			size_t calls = 0;
+
+			const auto applied = patch::apply(old_data, data, new_data.size(), [&](const void* buffer, const size_t length)
+			{
+				streamed.append(static_cast<const char*>(buffer), length);
+				++calls;
+			});
+
+			expect(applied && streamed == new_data && calls > 1, "streaming apply produces the file in pieces");
+		}
+
+		void test_rejection()
+		{
+			const auto old_data = make_data(64 * 1024, 4);
+			const auto new_data = make_new_version(old_data);
+			const auto data = patch::create(old_data, new_data);
+
+			expect(is_rejected(old_data, data, new_data.size() + 1), "wrong expected size is rejected");
+			expect(is_rejected(old_data, data, new_data.size() - 1), "short expected size is rejected");
+			expect(is_rejected(old_data.substr(1), data, new_data.size()), "wrong old file is rejected");
+			expect(is_rejected(old_data, "", new_data.size()), "empty patch is rejected");
+			expect(is_rejected(old_data, make_data(data.size(), 5), new_data.size()), "random data is rejected");
+
+			auto truncations_rejected = true;
+			for (size_t size = 0; size < data.size(); size += 7)
+			{
+				truncations_rejected = truncations_rejected && is_rejected(old_data, std::string_view(data).substr(0, size), new_data.size());
+			}
+
+			expect(truncations_rejected, "truncated patches are rejected");
+
+			// Every byte but the reserved header field is covered by the size checks or the stream checksums
+			constexpr size_t reserved_offset = 4;
+			constexpr size_t reserved_size = 4;
+
+			size_t accepted = 0;
+			for (size_t i = 0; i < data.size(); ++i)
+			{
+				if (i >= reserved_offset && i < reserved_offset + reserved_size)
+				{
+					continue;
+				}
+
+				auto corrupted = data;
+				corrupted[i] = static_cast<char>(corrupted[i] ^ 0x55);
+
+				if (!is_rejected(old_data, corrupted, new_data.size()))
+				{
+					++accepted;
+				}
+			}
+
+			expect(accepted == 0, "corrupted patches are rejected");
+
+			// Seeks far outside of the old file would overflow the position, they have to be rejected before they are applied
+			const auto seek = get_seek(data, 0);
+			const auto unchanged = with_seek(data, 0, seek);
+			expect(patch::apply(old_data, unchanged, new_data.size()) == new_data, "rebuilt patch with the original seek is accepted");
+
+			const auto limit = static_cast<int64_t>(old_data.size() + new_data.size());
+			const int64_t corrupted_seeks[] =
+			{
+				std::numeric_limits<int64_t>::max(),
+				std::numeric_limits<int64_t>::min(),
+				std::numeric_limits<int64_t>::max() - seek,
+				limit * 2,
+				-limit * 2,
+			};
+
+			auto seeks_rejected = true;
+			for (const auto corrupted_seek : corrupted_seeks)
+			{
+				const auto corrupted = with_seek(data, 0, corrupted_seek);
+				seeks_rejected = seeks_rejected && !corrupted.empty() && is_rejected(old_data, corrupted, new_data.size());
+			}
+
+			expect(seeks_rejected, "out of range seeks are rejected");
+		}
+	}
+
+	void run_patch_tests()
+	{
+		test_round_trip();
+		test_rejection();
+	}
+	void run_patch_benchmark()
+	{
+		for (const auto size : benchmark_file_sizes)
+		{
+			const auto old_data = make_code(size, 11, 0x400000);
+			const auto new_data = make_next_release(old_data);
+
+			std::string patch_data{};
+			const auto create_time = measure_milliseconds([&]()
+			{
+				patch_data = patch::create(old_data, new_data);
+			});
+
+			// Applied the way the updater does, streamed into the output and hashed on the way
+			utils::cryptography::sha1::context context{};
+			auto applied = false;
+			const auto apply_time = measure_milliseconds([&]()
+			{
+				applied = patch::apply(old_data, patch_data, new_data.size(), [&](const void* data, const size_t length)
+				{
+					context.update(data, length);
+				});
+			});
+
+			const auto compressed_size = get_compressed_size(new_data);
+
+			std::cout << "  " << size / 1024 << " KiB: patch " << patch_data.size() / 1024 << " KiB, the gzip variant "
+				<< compressed_size / 1024 << " KiB, the file " << new_data.size() / 1024 << " KiB, created in " << create_time
+				<< " ms, applied in " << apply_time << " ms" << std::endl;
+
+			expect(applied && context.final() == utils::cryptography::sha1::compute(new_data), "patch rebuilds the next release");
+			expect(patch_data.size() < compressed_size, "patch is smaller than the compressed file");
+		}
+	}
+}
@@ -0,0 +1,183 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include "updater/path_index.hpp"
+
+namespace tests
+{
+	namespace
+	{
+		constexpr size_t benchmark_manifest_size = 50'000;
+		constexpr size_t benchmark_stray_share = 10;
+		constexpr size_t benchmark_directory_count = 500;
+
+		// The previous cleanup compared every entry with every manifest path, a sample of entries is timed and scaled up
+		constexpr size_t benchmark_baseline_file_sample = 200;
+		constexpr size_t benchmark_baseline_directory_sample = 4;
+
+		std::string make_manifest_path(const size_t index)
+		{
+			return "zone/dlc" + std::to_string(index % 7) + "/folder" + std::to_string(index % benchmark_directory_count) + "/File_"
+				+ std::to_string(index) + ".ff";
+		}
+
+		// How the previous cleanup decided whether a directory may stay
+		bool is_inside_folder(const std::filesystem::path& file, const std::filesystem::path& folder)
+		{
+			const auto relative = std::filesystem::relative(file, folder);
+			const auto start = relative.begin();
+			return start != relative.end() && start->string() != "..";
+		}
+	}
+
+	void run_path_index_tests()
+	{
+		using updater::path_index;
+
+		expect(path_index::normalize("Data\\Maps\\MP_Test.FF") == "data/maps/mp_test.ff", "separators and case are folded");
+		expect(path_index::normalize("//data\\\\maps//") == "data/maps", "repeated and trailing separators are dropped");
+		expect(path_index::normalize("\xC3\x84" "BC") == "\xC3\x84" "bc", "only ASCII letters are folded");
+		expect(path_index::normalize("").empty() && path_index::normalize("/\\/").empty(), "empty paths stay empty");
+
+		path_index index{};
+		expect(!index.contains_directory(""), "empty index has no root");
+
+		index.add_file("Data/Maps/mp_test.ff");
+		index.add_file("data\\maps\\MP_OTHER.ff");
+		index.add_file("DATA/sound/a.wav");
+		index.add_file("root.txt");
+		index.add_file("ROOT.TXT");
+		index.add_file("\\/");
+
+		expect(index.size() == 4, "differently cased duplicates count once");
+
+		expect(index.contains_file("data/maps/mp_test.ff"), "file is found in folded form");
+		expect(index.contains_file("DATA\\MAPS\\MP_TEST.FF"), "file is found with other case and separators");
+		expect(index.contains_file("data/maps/mp_other.ff"), "file added with backslashes is found");
+		expect(index.contains_file("Root.txt"), "top level file is found");
+		expect(!index.contains_file("data/maps"), "directory is not a file");
+		expect(!index.contains_file("data/maps/mp_test"), "prefix of a file is not a file");
+		expect(!index.contains_file("maps/mp_test.ff"), "suffix of a path is not a file");
+
+		expect(index.contains_directory(""), "root holds the files");
+		expect(index.contains_directory("Data"), "top level directory is found");
+		expect(index.contains_directory("DATA\\Maps\\"), "nested directory is found with other case and separators");
+		expect(index.contains_directory("data/sound"), "sibling directory is found");
+		expect(!index.contains_directory("data/ma"), "prefix of a directory is not a directory");
+		expect(!index.contains_directory("maps"), "nested directory is not found at the top level");
+		expect(!index.contains_directory("data/maps/mp_test.ff"), "file is not a directory");
+		expect(!index.contains_directory("root.txt"), "top level file is not a directory");
+		expect(!index.contains_directory("sound"), "directory names are keyed by their parent");
+	}
+	void run_path_index_benchmark()
+	{
+		std::vector<std::string> manifest{};
+		for (size_t i = 0; i < benchmark_manifest_size; ++i)
+		{
+			manifest.emplace_back(make_manifest_path(i));
+		}
+
+		// As many files on disk as in the manifest, every tenth one is stray, plus every directory of the tree
+		std::vector<std::string> disk_files{};
+		std::set<std::string> disk_directories{};
+
+		for (size_t i = 0; i < benchmark_manifest_size; ++i)
+		{
+			disk_files.emplace_back(i % benchmark_stray_share ? manifest[i] : make_manifest_path(i + benchmark_manifest_size));
+
+			const auto path = std::filesystem::path(disk_files.back()).parent_path();
+			for (auto directory = path; !directory.empty(); directory = directory.parent_path())
+			{
+				disk_directories.emplace(directory.generic_string());
+			}
+		}
+
+		std::cout << "  " << manifest.size() << " manifest entries, " << disk_files.size() << " files and " << disk_directories.size()
+			<< " directories on disk" << std::endl;
+
+		updater::path_index index{};
+		const auto build_time = measure_milliseconds([&]()
+		{
+			for (const auto& path : manifest)
+			{
+				index.add_file(path);
+			}
+		});
+
+		size_t legal_files = 0;
+		size_t legal_directories = 0;
+		const auto lookup_time = measure_milliseconds([&]()
+		{
+			for (const auto& path : disk_files)
+			{
+				legal_files += index.contains_file(path);
+			}
+
+			for (const auto& path : disk_directories)
+			{
+				legal_directories += index.contains_directory(path);
+			}
+		});
+
+		std::cout << "  path index: " << build_time << " ms to build, " << lookup_time << " ms for every entry" << std::endl;
+
+		expect(legal_files == benchmark_manifest_size - benchmark_manifest_size / benchmark_stray_share, "stray files are found");
+		expect(legal_directories == disk_directories.size(), "every directory holds a legal file");
+
+		const auto base = std::filesystem::temp_directory_path() / "xlabs-tests" / "path-index-benchmark" / "data";
+
+		std::vector<std::filesystem::path> legal_paths{};
+		legal_paths.reserve(manifest.size());
+
+		for (const auto& path : manifest)
+		{
+			legal_paths.emplace_back(std::filesystem::absolute(base / path));
+		}
+
+		const auto file_step = disk_files.size() / benchmark_baseline_file_sample;
+		size_t baseline_mismatches = 0;
+
+		const auto baseline_file_time = measure_milliseconds([&]()
+		{
+			for (size_t i = 0; i < disk_files.size(); i += file_step)
+			{
+				const auto file = base / disk_files[i];
+				const auto is_legal = std::ranges::any_of(legal_paths, [&](const std::filesystem::path& legal_path)
+				{
+					return legal_path == file;
+				});
+
+				baseline_mismatches += is_legal != index.contains_file(disk_files[i]);
+			}
+		});
+
+		const std::vector<std::string> directories{disk_directories.begin(), disk_directories.end()};
+		const auto directory_step = directories.size() / benchmark_baseline_directory_sample;
+
+		const auto baseline_directory_time = measure_milliseconds([&]()
+		{
+			for (size_t i = 0; i < directories.size(); i += directory_step)
+			{
+				const auto& directory = directories[i];
+				const auto folder = base / directory;
+				const auto is_legal = std::ranges::any_of(legal_paths, [&](const std::filesystem::path& legal_path)
+				{
+					return is_inside_folder(legal_path, folder);
+				});
+
+				baseline_mismatches += is_legal != index.contains_directory(directory);
+			}
+		});
+
+		const auto sampled_files = (disk_files.size() + file_step - 1) / file_step;
+		const auto sampled_directories = (directories.size() + directory_step - 1) / directory_step;
+		const auto estimated_baseline = baseline_file_time / static_cast<double>(sampled_files) * static_cast<double>(disk_files.size())
+			+ baseline_directory_time / static_cast<double>(sampled_directories) * static_cast<double>(directories.size());
+
+		std::cout << "  linear scan: " << baseline_file_time << " ms for " << sampled_files << " files, " << baseline_directory_time
+			<< " ms for " << sampled_directories << " directories, about " << estimated_baseline / 1000
+			<< " s for every entry" << std::endl;
+
+		expect(baseline_mismatches == 0, "the index agrees with the linear scan on the sample");
+	}
+}
@@ -0,0 +1,127 @@
+#include "std_include.hpp"
+#include "test.hpp"
+#include "transfer_model.hpp"
+
+#include "updater/segments.hpp"
+
+namespace tests
+{
+	namespace
+	{
+		// Segments have to cover the file exactly once, in order and without gaps
+		bool covers(const std::vector<updater::segment>& segments, const size_t size)
+		{
+			size_t end = 0;
+			for (const auto& segment : segments)
+			{
+				if (segment.start != end || segment.length == 0 || segment.written != 0)
+				{
+					return false;
+				}
+
+				end += segment.length;
+			}
+
+			return end == size;
+		}
+
+		// A fast link behind a server that throttles every connection, the case segmented downloads are for
+		constexpr link_model throttled_link{100.0 * 1024 * 1024, 5.0 * 1024 * 1024};
+	}
+
+	void run_segments_tests()
+	{
+		using updater::min_segment_size;
+		using updater::max_segment_count;
+
+		expect(updater::get_segments(0).empty(), "empty file has no segments");
+		expect(updater::get_segments(1).size() == 1, "small file is a single segment");
+
+		const size_t sizes[] =
+		{
+			updater::segmented_download_threshold - 1,
+			updater::segmented_download_threshold,
+			updater::segmented_download_threshold + 1,
+			3 * min_segment_size - 1,
+			max_segment_count * min_segment_size,
+			max_segment_count * min_segment_size + 7,
+			1024ull * 1024 * 1024 + 3,
+		};
+
+		for (const auto size : sizes)
+		{
+			const auto segments = updater::get_segments(size);
+			const auto description = "segments of " + std::to_string(size) + " bytes";
+
+			expect(covers(segments, size), description + " cover the file");
+			expect(!segments.empty() && segments.size() <= max_segment_count, description + " stay within the count");
+
+			// Splitting rounds up, so only the last segment can fall short of the minimum, and not by much
+			const auto small = std::count_if(segments.begin(), segments.end() - 1, [](const updater::segment& segment)
+			{
+				return segment.length < min_segment_size;
+			});
+
+			expect(small == 0, description + " are large enough");
+		}
+
+		expect(updater::get_segments(updater::segmented_download_threshold).size() == 2, "threshold file is split in two");
+		expect(updater::get_segments(1024ull * 1024 * 1024).size() == max_segment_count, "large file uses every segment");
+
+		updater::file_info file{};
+		file.size = 10 * 100 + 50;
+		file.chunk_size = 100;
+
+		const auto damaged = updater::get_damaged_segments(file, {0, 1, 2, 5, 7, 8, 10});
+		expect(damaged.size() == 4, "adjacent damaged chunks are merged");
+		expect(damaged.size() == 4 && damaged[0].start == 0 && damaged[0].length == 300, "first run spans three chunks");
+		expect(damaged.size() == 4 && damaged[1].start == 500 && damaged[1].length == 100, "single chunk stays alone");
+		expect(damaged.size() == 4 && damaged[2].start == 700 && damaged[2].length == 200, "second run spans two chunks");
+		expect(damaged.size() == 4 && damaged[3].start == 1000 && damaged[3].length == 50, "last chunk ends with the file");
+	}
+	void run_segments_benchmark()
+	{
+		const size_t sizes[] =
+		{
+			updater::segmented_download_threshold,
+			64ull * 1024 * 1024,
+			256ull * 1024 * 1024,
+			1024ull * 1024 * 1024,
+		};
+
+		for (const auto size : sizes)
+		{
+			const auto segments = updater::get_segments(size);
+
+			auto single_stream_done = false;
+			const auto single_stream = simulate_transfers(throttled_link, 1, [&](size_t) -> std::optional<uint64_t>
+			{
+				if (single_stream_done)
+				{
+					return {};
+				}
+
+				single_stream_done = true;
+				return size;
+			});
+
+			// Every segment is its own range request, they all run at once
+			std::vector<bool> segment_done(segments.size(), false);
+			const auto segmented = simulate_transfers(throttled_link, segments.size(), [&](const size_t worker) -> std::optional<uint64_t>
+			{
+				if (segment_done[worker])
+				{
+					return {};
+				}
+
+				segment_done[worker] = true;
+				return segments[worker].length;
+			});
+
+			std::cout << "  " << size / (1024 * 1024) << " MiB: single stream " << single_stream << " s, " << segments.size()
+				<< " segments " << segmented << " s" << std::endl;
+
+			expect(segmented < single_stream, "segments finish before a single throttled stream");
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// Also stands in for the launcher's header when its updater sources are built into the tests,
+// so they compile without the browser and UI headers
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+using namespace std::literals;
@@ -0,0 +1,152 @@
+#include "std_include.hpp"
+#include "test.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace tests
+{
+	namespace
+	{
+		std::atomic<size_t> failure_count{0};
+
+		// Every allocation carries its size in front of it, so deletes can be counted without the sized overloads
+		constexpr size_t allocation_header = alignof(std::max_align_t);
+
+		std::atomic<size_t> allocated_bytes{0};
+		std::atomic<size_t> peak_allocated_bytes{0};
+	}
+
+	void expect(const bool condition, const std::string_view description, const std::source_location& location)
+	{
+		if (condition)
+		{
+			return;
+		}
+
+		++failure_count;
+		std::cout << "  FAILED: " << description << " (" << location.file_name() << ":" << location.line() << ")" << std::endl;
+	}
+
+	size_t get_failure_count()
+	{
+		return failure_count;
+	}
+
+	double measure_milliseconds(const std::function<void()>& callback)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		callback();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	size_t get_allocated_bytes()
+	{
+		return allocated_bytes;
+	}
+
+	size_t get_peak_allocated_bytes()
+	{
+		return peak_allocated_bytes;
+	}
+
+	void reset_peak_allocated_bytes()
+	{
+		peak_allocated_bytes = allocated_bytes.load();
+	}
+
+	namespace
+	{
+		void* allocate(const size_t size) noexcept
+		{
+			auto* block = static_cast<uint8_t*>(std::malloc(size + allocation_header));
+			if (!block)
+			{
+				return nullptr;
+			}
+
+			*reinterpret_cast<size_t*>(block) = size;
+
+			const auto current = allocated_bytes += size;
+			auto peak = peak_allocated_bytes.load();
+			while (current > peak && !peak_allocated_bytes.compare_exchange_weak(peak, current))
+			{
+			}
+
+			return block + allocation_header;
+		}
+
+		void release(void* memory) noexcept
+		{
+			if (!memory)
+			{
+				return;
+			}
+
+			auto* block = static_cast<uint8_t*>(memory) - allocation_header;
+			allocated_bytes -= *reinterpret_cast<size_t*>(block);
+			std::free(block);
+		}
+
+		void* allocate_or_throw(const size_t size)
+		{
+			auto* memory = allocate(size);
+			if (!memory)
+			{
+				throw std::bad_alloc();
+			}
+
+			return memory;
+		}
+	}
+}
+
+void* operator new(const size_t size)
+{
+	return tests::allocate_or_throw(size);
+}
+
+void* operator new[](const size_t size)
+{
+	return tests::allocate_or_throw(size);
+}
+
+void* operator new(const size_t size, const std::nothrow_t&) noexcept
+{
+	return tests::allocate(size);
+}
+
+void* operator new[](const size_t size, const std::nothrow_t&) noexcept
+{
+	return tests::allocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	tests::release(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	tests::release(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	tests::release(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	tests::release(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	tests::release(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	tests::release(memory);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string_view>
+#include <source_location>
+#include <functional>
+
+namespace tests
+{
+	// Failed checks are reported and counted, the remaining checks still run
+	void expect(bool condition, std::string_view description, const std::source_location& location = std::source_location::current());
+	size_t get_failure_count();
+
+	// Wall time of a single run, for the benchmarks
+	double measure_milliseconds(const std::function<void()>& callback);
+
+	// Heap usage through operator new, for the memory figures of the benchmarks
+	size_t get_allocated_bytes();
+	size_t get_peak_allocated_bytes();
+	void reset_peak_allocated_bytes();
+
+	// Every file of the suite registers its cases here, main runs them in this order
+	void run_hash_cache_tests();
+	void run_segments_tests();
+	void run_cryptography_tests();
+	void run_file_table_tests();
+	void run_manifest_tests();
+	void run_path_index_tests();
+	void run_chunking_tests();
+	void run_patch_tests();
+	void run_pack_tests();
+	void run_filesystem_snapshot_tests();
+	void run_download_scheduler_tests();
+
+	// Benchmarks touch the disk and take a while, they only run when asked for
+	void run_hash_cache_benchmark();
+	void run_segments_benchmark();
+	void run_download_scheduler_benchmark();
+	void run_cryptography_benchmark();
+	void run_manifest_benchmark();
+	void run_path_index_benchmark();
+	void run_chunking_benchmark();
+	void run_patch_benchmark();
+	void run_pack_benchmark();
+}
@@ -0,0 +1,87 @@
+#include "std_include.hpp"
+#include "transfer_model.hpp"
+
+#include <limits>
+
+namespace tests
+{
+	double simulate_transfers(const link_model& link, const size_t worker_count, const next_transfer& next)
+	{
+		struct transfer
+		{
+			size_t worker;
+			double remaining;
+			double latency;
+		};
+
+		// Leftovers of floating point steps, anything below is done
+		constexpr double epsilon = 1e-9;
+
+		std::vector<transfer> active{};
+		std::vector<size_t> idle{};
+
+		for (size_t worker = 0; worker < worker_count; ++worker)
+		{
+			idle.emplace_back(worker);
+		}
+
+		double time = 0.0;
+
+		while (true)
+		{
+			for (const auto worker : idle)
+			{
+				const auto size = next(worker);
+				if (size)
+				{
+					active.emplace_back(transfer{worker, static_cast<double>(*size), link.request_latency});
+				}
+			}
+
+			idle.clear();
+
+			if (active.empty())
+			{
+				return time;
+			}
+
+			const auto receiving = static_cast<size_t>(std::count_if(active.begin(), active.end(), [](const transfer& entry)
+			{
+				return entry.latency <= 0.0;
+			}));
+
+			// Rates only change when a transfer ends or starts receiving, so the model jumps from one such event
+			// to the next
+			const auto rate = receiving ? std::min(link.connection_rate, link.link_rate / static_cast<double>(receiving)) : 0.0;
+
+			auto step = std::numeric_limits<double>::infinity();
+			for (const auto& entry : active)
+			{
+				step = std::min(step, entry.latency > 0.0 ? entry.latency : entry.remaining / rate);
+			}
+
+			time += step;
+
+			for (auto entry = active.begin(); entry != active.end();)
+			{
+				if (entry->latency > 0.0)
+				{
+					entry->latency = entry->latency - step > epsilon ? entry->latency - step : 0.0;
+				}
+				else
+				{
+					entry->remaining -= step * rate;
+				}
+
+				if (entry->latency > 0.0 || entry->remaining > epsilon)
+				{
+					++entry;
+					continue;
+				}
+
+				idle.emplace_back(entry->worker);
+				entry = active.erase(entry);
+			}
+		}
+	}
+}
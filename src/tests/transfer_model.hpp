@@ -0,0 +1,20 @@
+#pragma once
+
+namespace tests
+{
+	// Model of a download link for the transfer benchmarks. Every open connection gets an equal share of the
+	// link, but never more than the per-connection cap that a server or a congested route imposes. Each transfer
+	// first waits out the request latency without using the link.
+	struct link_model
+	{
+		double link_rate;            // bytes per second
+		double connection_rate;      // bytes per second
+		double request_latency{0.0}; // seconds
+	};
+
+	// Hands a worker the size of its next transfer, nothing once it has no more work
+	using next_transfer = std::function<std::optional<uint64_t>(size_t worker)>;
+
+	// Runs the workers' transfers over the link and returns the seconds until the last one is done
+	double simulate_transfers(const link_model& link, size_t worker_count, const next_transfer& next);
+}